@@ -0,0 +1,70 @@
+#ifndef _AFFINE_H_
+#define _AFFINE_H_
+
+#include "matrix.h"
+#include "point3d.h"
+
+#define AFFINE_ELEMS 12
+
+//A 3D affine transform stored as the top three rows of its 4x4, homogeneous, row-major matrix; the
+//last row is always (0 0 0 1), so it is left implicit
+typedef struct
+{
+	double m[AFFINE_ELEMS];
+} affine_t;
+
+/*
+ * affine_identity - sets the affine transform to the identity
+ * @param a - the affine transform to set
+ */
+void affine_identity(affine_t *a);
+
+/*
+ * affine_from_matrix - sets the affine transform from the top three rows of a 4x4 matrix
+ * @param a - the affine transform to set
+ * @param m - the 4x4 matrix, whose last row must be (0 0 0 1)
+ */
+void affine_from_matrix(affine_t *a, matrix_t *m);
+
+/*
+ * affine_to_matrix - returns the full 4x4, homogeneous matrix for the affine transform
+ * @param a - the affine transform to convert
+ * @return - the new 4x4 matrix, or NULL if out of memory
+ */
+matrix_t *affine_to_matrix(affine_t *a);
+
+/*
+ * affine_to_matrix_assign - assigns the full 4x4, homogeneous matrix for the affine transform to
+ * the given matrix
+ * @param m - the 4x4 matrix to which to assign
+ * @param a - the affine transform to convert
+ */
+void affine_to_matrix_assign(matrix_t *m, affine_t *a);
+
+/*
+ * affine_compose - composes two affine transforms, c = ab, i.e., b followed by a, using 36
+ * multiplies instead of the 64 of a 4x4 product. c may alias a or b.
+ * @param c - the affine transform in which to store the result
+ * @param a - the left-hand transform
+ * @param b - the right-hand transform
+ */
+void affine_compose(affine_t *c, affine_t *a, affine_t *b);
+
+/*
+ * affine_transform_point - applies the affine transform to a point, translation included
+ * @param a   - the transform to apply
+ * @param in  - the point to transform
+ * @param out - the point into which to place the result; may alias in
+ */
+void affine_transform_point(affine_t *a, point3d_t *in, point3d_t *out);
+
+/*
+ * affine_transform_direction - applies only the linear part of the affine transform, as for a
+ * direction, which is unaffected by translation
+ * @param a   - the transform to apply
+ * @param in  - the direction to transform
+ * @param out - the direction into which to place the result; may alias in
+ */
+void affine_transform_direction(affine_t *a, point3d_t *in, point3d_t *out);
+
+#endif
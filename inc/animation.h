@@ -0,0 +1,63 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include <stdio.h>
+
+#include "robot.h"
+#include "status.h"
+
+typedef struct
+{
+	double time;
+	double thetas[ROBOT_JOINTS];
+} keyframe_t;
+
+typedef struct
+{
+	keyframe_t *keys;
+	size_t size;
+} keyframes_t;
+
+/*
+ * keyframes_read - reads keyframes from a file in the format:
+ * time0 theta1 theta2 theta3
+ * time1 theta1 theta2 theta3
+ * ...
+ * with the angles in degrees and the times strictly increasing. Blank lines are skipped.
+ * @param stream - the file stream from which to read the keyframes
+ * @param keys   - the keyframes to fill; the angles are converted to radians
+ * @return - an indication of whether an error occurred
+ */
+status_t keyframes_read(FILE *stream, keyframes_t *keys);
+
+/*
+ * keyframes_uninitialize - frees the keyframes read by keyframes_read
+ * @param keys - the keyframes to uninitialize
+ */
+void keyframes_uninitialize(keyframes_t *keys);
+
+/*
+ * keyframes_interpolate - linearly interpolates the joint angles at the given time, holding the first
+ * and last keyframes outside of their range
+ * @param keys   - the keyframes from which to interpolate
+ * @param time   - the time at which to interpolate
+ * @param thetas - the ROBOT_JOINTS angles into which to place the result
+ */
+void keyframes_interpolate(keyframes_t *keys, double time, double *thetas);
+
+/*
+ * animation_render - evaluates num_frames frames evenly spaced from the first to the last keyframe
+ * across the given number of threads and writes them out in order while later frames are still
+ * being evaluated
+ * @param lengths     - the ROBOT_JOINTS link lengths
+ * @param keys        - the keyframes to interpolate
+ * @param num_frames  - the number of frames to render
+ * @param num_threads - the number of threads with which to evaluate frames
+ * @param prefix      - if not NULL, each frame is written to its own file, named prefixNNNN.iv;
+ *                      otherwise, all of the frames are written in order to stdout
+ * @param precision   - the number of digits to write after the decimal point
+ * @return - an indication of whether the function failed or not
+ */
+status_t animation_render(double *lengths, keyframes_t *keys, size_t num_frames, size_t num_threads, char *prefix, int precision);
+
+#endif
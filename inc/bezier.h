@@ -1,13 +1,14 @@
 #ifndef _BEZIER_H_
 #define _BEZIER_H_
 
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
 #include "polyline.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
-	point3d_vec_t *ctrl;
+	point3d_buffer_t *ctrl;
 } bezier_t;
 
 /*
@@ -44,11 +45,12 @@ status_t bezier_from_hermite(bezier_t *bezier, point3d_t *p0, point3d_t *p3, poi
 
 /*
  * bezier_print_to_iv - prints the Bezier curve using spheres for its control poitns in OpenInventor
- * format to the given stream
+ * format to the given writer
  * @param bezier - the curve to print
  * @param radius - the radius size to use for the spheres
- * @param stream - the stream to which to print
+ * @param style  - how to draw the control points
+ * @param writer - the writer to which to print
  */
-void bezier_print_to_iv(bezier_t *bezier, double radius, FILE *stream);
+void bezier_print_to_iv(bezier_t *bezier, double radius, point3d_style_t style, writer_t *writer);
 
 #endif
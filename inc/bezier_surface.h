@@ -1,18 +1,23 @@
 #ifndef _BEZIER_SURFACE_H_
 #define _BEZIER_SURFACE_H_
 
+#include <stdint.h>
+
 #include "mesh.h"
+#include "point3d_buffer.h"
 #include "point3d_vec.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
-	point3d_vec_t *ctrls;
+	point3d_buffer_t *ctrls;
 } bezier_surface_t;
 
 bezier_surface_t *bezier_surface_initialize(void);
 void bezier_surface_uninitialize(bezier_surface_t *surface);
-void bezier_surface_print_to_iv(bezier_surface_t *surface, double radius, FILE *stream);
+void bezier_surface_print_to_iv(bezier_surface_t *surface, double radius, point3d_style_t style, writer_t *writer);
 status_t bezier_surface_calculate_mesh_points(bezier_surface_t *surface, mesh_t *mesh, size_t num_u, size_t num_v);
 status_t bezier_surface_calculate_mesh_normals(bezier_surface_t *bezier, mesh_t *mesh);
+void bezier_surface_source_initialize(mesh_source_t *source, bezier_surface_t *surface, size_t num_u, size_t num_v, uint8_t has_normals);
 #endif
@@ -1,13 +1,14 @@
 #ifndef _CATMULLROM_H_
 #define _CATMULLROM_H_
 
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
 #include "polyline.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
-	point3d_vec_t *ctrl;
+	point3d_buffer_t *ctrl;
 	point3d_t *t0;
 	point3d_t *tN;
 } catmullrom_t;
@@ -35,11 +36,12 @@ status_t catmullrom_calculate_polyline(catmullrom_t *catmullrom, polyline_t *pol
 
 /*
  * catmullrom_print_to_iv - prints the Catmull-Rom spline using spheres for its control points in
- * OpenInventor format to the given stream
+ * OpenInventor format to the given writer
  * @param catmullrom - the spline to print
  * @param radius     - the radius size to use for the control points
- * @param stream     - the stream to which to print
+ * @param style      - how to draw the control points
+ * @param writer     - the writer to which to print
  */
-void catmullrom_print_to_iv(catmullrom_t *catmullrom, double radius, FILE *stream);
+void catmullrom_print_to_iv(catmullrom_t *catmullrom, double radius, point3d_style_t style, writer_t *writer);
 
 #endif
@@ -1,9 +1,8 @@
 #ifndef _CUBOID_H_
 #define _CUBOID_H_
 
-#include "matrix.h"
 #include "point3d.h"
-#include "status.h"
+#include "writer.h"
 
 typedef struct
 {
@@ -16,10 +15,9 @@ typedef struct
 cuboid_t *cuboid_initialize(void);
 void cuboid_uninitialize(cuboid_t *cuboid);
 void cuboid_set_corners(cuboid_t *cuboid, point3d_t *lowleft, point3d_t *upright);
-void cuboid_print_to_iv(cuboid_t *cuboid, FILE *stream);
+void cuboid_print_to_iv(cuboid_t *cuboid, writer_t *writer);
 
-status_t cuboid_initialize_matrices(matrix_t **matrices, double *ll, double *ur);
-void cuboid_uninitialize_matrices(matrix_t **matrices);
-void cuboid_print_matrices_to_iv(matrix_t **matrices, FILE *stream);
+void cuboid_corners(point3d_t *points, double *ll, double *ur);
+void cuboid_print_points_to_iv(point3d_t *points, writer_t *writer);
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef _DRAW_LIST_H_
+#define _DRAW_LIST_H_
+
+#include "affine.h"
+#include "hierarchical.h"
+#include "status.h"
+#include "writer.h"
+
+typedef struct
+{
+	model_t *model;
+	affine_t transform;
+} draw_record_t;
+
+//A list of (model, world transform) pairs produced by traversing a hierarchy. Traversal only
+//appends to the list, so it does no I/O; draw_list_emit then writes all of the records in one pass.
+typedef struct draw_list_t
+{
+	draw_record_t *records;
+	size_t size;
+	size_t capacity;
+} draw_list_t;
+
+/*
+ * draw_list_initialize - creates a new, empty draw list with room for the given number of records
+ * @param capacity - the number of records for which to preallocate space
+ * @return - the new draw list, or NULL if out of memory
+ */
+draw_list_t *draw_list_initialize(size_t capacity);
+
+/*
+ * draw_list_uninitialize - uninitializes the draw list; the models it refers to are left untouched
+ * @param list - the draw list to uninitialize
+ */
+void draw_list_uninitialize(draw_list_t *list);
+
+/*
+ * draw_list_clear - removes all of the records from the draw list, keeping its capacity
+ * @param list - the draw list to clear
+ */
+void draw_list_clear(draw_list_t *list);
+
+/*
+ * draw_list_append - appends a record to the draw list, growing it if it is already full
+ * @param list      - the draw list to which to append
+ * @param model     - the model to draw
+ * @param transform - the world transform with which to draw the model
+ * @return - an indication of whether the function failed or not
+ */
+status_t draw_list_append(draw_list_t *list, model_t *model, affine_t *transform);
+
+/*
+ * draw_list_emit - writes every record in the draw list, in order, by calling each model's emit
+ * function, stopping at the first failure
+ * @param list   - the draw list to emit
+ * @param writer - the writer to which to write
+ * @return - an indication of whether the function failed or not
+ */
+status_t draw_list_emit(draw_list_t *list, writer_t *writer);
+
+#endif
@@ -5,27 +5,83 @@
 #include <stdio.h>
 
 #include "point3d.h"
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
 #include "status.h"
+#include "writer.h"
 
 /*
- * read_points - read in a series of points from a file in the format:
+ * Binary points format, all little-endian:
+ *   header - points_binary_header_t
+ *   points - count points, each three coordinates (x, y, z) of scalar_size bytes: floats when 4 and
+ *            doubles when 8
+ */
+#define POINTS_BINARY_MAGIC "CGPT"
+#define POINTS_BINARY_VERSION 1
+
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t scalar_size;
+	uint32_t reserved;
+	uint64_t count;
+} points_binary_header_t;
+
+/*
+ * read_points - read in a series of points, from the stream's current position to its end, in the
+ * format:
  * x0 y0 z0
  * x1 y1 z1
  * ...
  * xn yn zn
- * Note that on error, the function will not free the points it has already placed in the vector
+ * Coordinates may be separated by any run of spaces or tabs, lines may end in either LF or CRLF, the
+ * last line need not end in a newline, and blank lines are skipped. Regular files are mapped into
+ * memory rather than read through the stream. Points in the binary format are also accepted; when
+ * they are doubles in a regular file and the buffer is empty, the buffer adopts the mapping and the
+ * points are used in place without being copied.
+ * Note that on error, the function will not remove the points it has already placed in the buffer
  * @param stream - the file stream from which to read the points
- * @param points - the vector into which to place the points
+ * @param points - the buffer onto which to append the points
  * @return       - an indication of whether an error occured
  */
-status_t read_points(FILE *stream, point3d_vec_t *points);
+status_t read_points(FILE *stream, point3d_buffer_t *points);
+
+/*
+ * read_points_parallel - reads points exactly as read_points does, but splits the text at line
+ * boundaries into chunks of at least a megabyte, parses the chunks on up to num_threads threads,
+ * and appends the points in file order. Formatting errors report the line number within the file,
+ * counting any lines already read through the stream; only unmappable streams (like pipes) that
+ * had been read from beforehand leave the line unnumbered.
+ * @param stream      - the file stream from which to read the points
+ * @param points      - the buffer onto which to append the points
+ * @param num_threads - the most threads with which to parse; 0 is treated as 1
+ * @return            - an indication of whether an error occured
+ */
+status_t read_points_parallel(FILE *stream, point3d_buffer_t *points, size_t num_threads);
+
+/*
+ * points_stream_is_binary - determines whether the stream, at its current position, holds points in
+ * the binary format rather than as text, without consuming anything
+ * @param stream - the stream to check
+ * @return       - 1 if the points are binary; 0 otherwise
+ */
+uint8_t points_stream_is_binary(FILE *stream);
+
+/*
+ * write_points_binary - writes the points in the binary format
+ * @param points      - the points to write
+ * @param scalar_size - the size of each written coordinate: 4 for floats or 8 for doubles
+ * @param writer      - the writer to which to write
+ * @return            - an indication of whether an error occurred
+ */
+status_t write_points_binary(point3d_buffer_t *points, size_t scalar_size, writer_t *writer);
 
 /*
  * parse_point - given a line from a file containing point data, reads it into the point3d_t
- * structure
- * @param stream - the file stream from which to read the point
- * @param point  - the point of which to fill the coordinates
+ * structure, accepting the same formatting as read_points
+ * @param line  - the line, including its newline if it has one
+ * @param point - the point of which to fill the coordinates
+ * @return      - FILE_FORMAT_ERROR if the line does not hold exactly one point; SUCCESS otherwise
  */
 status_t parse_point(char *line, point3d_t *point);
 
@@ -1,23 +1,116 @@
 #ifndef _HIERARCHAL_H_
 #define _HIERARCHAL_H_
 
-#include "matrix.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#include "affine.h"
+#include "point3d.h"
 #include "status.h"
+#include "writer.h"
 
-typedef struct
+typedef struct model_t
 {
-	matrix_t **matrices;
+	point3d_t *points;
+	//Writes the model, transformed by the given world transform, to the writer
+	status_t (*emit)(struct model_t *model, affine_t *transform, writer_t *writer);
 } model_t;
 
+struct draw_list_t;
+
 typedef struct hierarchical_t
 {
 	model_t model;
-	matrix_t *from_parent;
-	void (*draw)(model_t *, matrix_t *transform);
+	affine_t from_parent;
+	//Cached product of every from_parent transform from the root down to this node; only valid when
+	//dirty is 0. A dirty node always has an entirely dirty subtree.
+	affine_t world;
+	uint8_t dirty;
 	struct hierarchical_t *sibling;
 	struct hierarchical_t *child;
 } hierarchical_t;
 
-status_t hierarchical_draw(hierarchical_t *model, matrix_t *transform);
+#define HIERARCHICAL_NO_PARENT SIZE_MAX
+
+//A hierarchical_t tree compiled into arrays in pre-order, i.e., the order in which hierarchical_draw
+//visits the nodes, so every parent comes before all of its children.
+typedef struct
+{
+	size_t size;
+	affine_t *locals;
+	affine_t *worlds;
+	size_t *parents;
+	hierarchical_t **nodes;
+	uint8_t *dirty;
+} hierarchical_flat_t;
+
+/*
+ * hierarchical_draw - draws the model, its siblings, and all of their children by appending a record
+ * for each to the draw list, recomputing the cached world transform only for those nodes which are
+ * dirty. Note that the cache assumes the transform passed for the root does not change between
+ * draws; if it does, the root must be marked dirty first.
+ * @param model     - the model to draw
+ * @param transform - the world transform of the model's parent
+ * @param list      - the draw list to which to append the records
+ * @return - an indication of whether the function failed or not
+ */
+status_t hierarchical_draw(hierarchical_t *model, affine_t *transform, struct draw_list_t *list);
+
+/*
+ * hierarchical_mark_dirty - marks the model and its entire subtree (but not its siblings) as
+ * needing their world transforms recomputed on the next draw
+ * @param model - the model to mark dirty
+ */
+void hierarchical_mark_dirty(hierarchical_t *model);
+
+/*
+ * hierarchical_set_from_parent - changes the model's local transform and marks its subtree dirty
+ * @param model       - the model of which to change the local transform
+ * @param from_parent - the new transform from the model's parent to the model
+ */
+void hierarchical_set_from_parent(hierarchical_t *model, affine_t *from_parent);
+
+/*
+ * hierarchical_compile - flattens the tree rooted at the given model (including the root's
+ * siblings) into a hierarchical_flat_t, copying each node's from_parent transform as its local transform
+ * @param model - the root of the tree to compile
+ * @return - the new flattened tree, or NULL if out of memory
+ */
+hierarchical_flat_t *hierarchical_compile(hierarchical_t *model);
+
+/*
+ * hierarchical_flat_uninitialize - uninitializes the flattened tree; the nodes it refers to are
+ * left untouched
+ * @param flat - the flattened tree to uninitialize
+ */
+void hierarchical_flat_uninitialize(hierarchical_flat_t *flat);
+
+/*
+ * hierarchical_flat_set_local - changes the local transform of the node at the given index and
+ * marks it dirty; its descendants are recomputed along with it on the next update
+ * @param flat  - the flattened tree
+ * @param index - the pre-order index of the node to change
+ * @param local - the new transform from the node's parent to the node
+ */
+void hierarchical_flat_set_local(hierarchical_flat_t *flat, size_t index, affine_t *local);
+
+/*
+ * hierarchical_flat_update - recomputes the world transforms of all dirty nodes in one forward pass
+ * over the arrays. As with hierarchical_draw, the root transform is assumed not to change between
+ * updates unless the roots have been marked dirty.
+ * @param flat      - the flattened tree
+ * @param transform - the world transform of the roots' parent
+ */
+void hierarchical_flat_update(hierarchical_flat_t *flat, affine_t *transform);
+
+/*
+ * hierarchical_flat_draw - updates the world transforms and then appends a record for every node,
+ * in order, to the draw list
+ * @param flat      - the flattened tree to draw
+ * @param transform - the world transform of the roots' parent
+ * @param list      - the draw list to which to append the records
+ * @return - an indication of whether the function failed or not
+ */
+status_t hierarchical_flat_draw(hierarchical_flat_t *flat, affine_t *transform, struct draw_list_t *list);
 
 #endif
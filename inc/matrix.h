@@ -52,6 +52,15 @@ void matrix_uninitialize(matrix_t *m);
  */
 void matrix_assign_from_array(matrix_t *m, double *array);
 
+/*
+ * matrix_copy_to_array - copies the values of the matrix, in row-major form, into the given array.
+ * Note that no bounds checking can be done, so the array must be at least as large as the number of
+ * rows and columns in the matrix.
+ * @param m     - the matrix from which to copy
+ * @param array - the array into which to copy the values
+ */
+void matrix_copy_to_array(matrix_t *m, double *array);
+
 /*
  * matrix_assign - assigns the values in the source matrix to the destination
  * matrix. Note that no bounds checking is done so note that the matrices must
@@ -114,6 +123,18 @@ void matrix_set(matrix_t *m, size_t row, size_t col, double val);
  */
 void matrix_multiply(matrix_t *c, matrix_t *a, matrix_t *b);
 
+/*
+ * matrix_multiply_array - performs the same multiplication as matrix_multiply, but on raw arrays
+ * treated as being in row-major form, i.e., c = ab. Note that c cannot alias either a or b.
+ * @param c     - the array in which to store the result, of size arows * bcols
+ * @param a     - the left-hand array in the multiplication, of size arows * acols
+ * @param b     - the right-hand array in the multiplication, of size acols * bcols
+ * @param arows - the number of rows in a
+ * @param acols - the number of columns in a, which is also the number of rows in b
+ * @param bcols - the number of columns in b
+ */
+void matrix_multiply_array(double *c, double *a, double *b, size_t arows, size_t acols, size_t bcols);
+
 /*
  * matrix_multiply_alis - performs a matrix multiplication between a and b and
  * stores the value in c, i.e., c = ab. Note that no bounds checking is done,
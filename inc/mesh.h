@@ -1,15 +1,93 @@
 #ifndef _MESH_H_
 #define _MESH_H_
 
+#include <stdint.h>
+
 #include "mesh_face_vec.h"
 #include "point3d_vec.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct mesh_face_t
 {
 	size_t vertices[3];
 } mesh_face_t;
 
+typedef enum
+{
+	MESH_FORMAT_IV, MESH_FORMAT_PLY, MESH_FORMAT_STL,
+} mesh_format_t;
+
+typedef enum
+{
+	MESH_TOPOLOGY_GRID, MESH_TOPOLOGY_POLES,
+} mesh_topology_t;
+
+typedef enum
+{
+	MESH_NORMALS_AREA, MESH_NORMALS_ANGLE,
+} mesh_normal_weighting_t;
+
+typedef struct mesh_source_t
+{
+	mesh_topology_t topology;
+	size_t num_u;
+	size_t num_v;
+	uint8_t has_normals;
+	void *surface;
+	//generator state, reset by rewind
+	size_t row;
+	double param;
+	void (*rewind)(struct mesh_source_t *source);
+	//either points or normals may be NULL when only the other is wanted
+	status_t (*next_row)(struct mesh_source_t *source, point3d_t *points, point3d_t *normals);
+} mesh_source_t;
+
+//How a program writes its mesh
+typedef struct
+{
+	mesh_format_t format;
+	int precision;
+	//formats an iv mesh in place in a mapping of the whole output, with up to num_threads threads
+	uint8_t fixed_width;
+	size_t num_threads;
+	uint8_t strips;
+	//draws whatever goes along with the mesh in an iv scene, given scene, or NULL for nothing
+	void (*print_iv_scene)(void *scene, writer_t *writer);
+	void *scene;
+} mesh_output_t;
+
+//Ends each strip in mesh_strips_t
+#define MESH_STRIP_END SIZE_MAX
+
+typedef struct
+{
+	//the vertices of every strip in turn, each strip followed by MESH_STRIP_END
+	size_t *indices;
+	size_t num_indices;
+	size_t num_strips;
+} mesh_strips_t;
+
+//Stands in mesh_adjacency_t for the twin of a half-edge on the boundary
+#define MESH_NO_TWIN SIZE_MAX
+
+/*
+ * Which faces meet at each vertex and along each edge of a mesh. Half-edge 3 * f + j runs from
+ * corner j of face f to corner (j + 1) % 3. The ring of a vertex, its neighbours, holds at most
+ * twice as many vertices as there are faces around it.
+ */
+typedef struct
+{
+	size_t num_points;
+	size_t num_faces;
+	//the faces around vertex v are faces[offsets[v]] through faces[offsets[v + 1] - 1], in order
+	size_t *offsets;
+	size_t *faces;
+	//the half-edge running back along each half-edge, or MESH_NO_TWIN where no single face does;
+	//NULL unless asked for, as the boundary functions need
+	size_t *twins;
+} mesh_adjacency_t;
+
 struct mesh_face_vec_t;
 typedef struct
 {
@@ -24,5 +102,37 @@ mesh_t *mesh_initialize(void);
 void mesh_uninitialize(mesh_t *mesh);
 status_t mesh_calculate_faces(mesh_t *mesh);
 status_t mesh_calculate_sellipsoid_faces(mesh_t *mesh);
-void mesh_print_to_iv(mesh_t *mesh, FILE *stream);
+void mesh_print_to_iv(mesh_t *mesh, writer_t *writer);
+status_t mesh_write_iv_mapped(mesh_t *mesh, int fd, int precision, size_t num_threads);
+void mesh_print_strips_to_iv(mesh_t *mesh, mesh_strips_t *strips, writer_t *writer);
+void mesh_print_to_ply(mesh_t *mesh, writer_t *writer);
+void mesh_print_strips_to_ply(mesh_t *mesh, mesh_strips_t *strips, writer_t *writer);
+void mesh_print_to_stl(mesh_t *mesh, writer_t *writer);
+size_t mesh_source_num_rows(mesh_source_t *source);
+size_t mesh_source_num_points(mesh_source_t *source);
+size_t mesh_source_num_faces(mesh_source_t *source);
+size_t mesh_source_max_row_size(mesh_source_t *source);
+size_t mesh_source_row_size(mesh_source_t *source, size_t row);
+size_t mesh_source_row_start(mesh_source_t *source, size_t row);
+status_t mesh_stream_to_iv(mesh_source_t *source, writer_t *writer);
+status_t mesh_stream_to_ply(mesh_source_t *source, writer_t *writer);
+status_t mesh_stream_to_stl(mesh_source_t *source, writer_t *writer);
+status_t mesh_print_output(mesh_t *mesh, mesh_output_t *output, int fd);
+status_t mesh_stream_output(mesh_source_t *source, mesh_output_t *output, int fd);
+status_t mesh_weld(mesh_t *mesh, double tolerance);
+status_t mesh_adjacency_build(mesh_t *mesh, size_t num_threads, uint8_t twins, mesh_adjacency_t *adjacency);
+void mesh_adjacency_release(mesh_adjacency_t *adjacency);
+size_t mesh_adjacency_ring(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t vertex, size_t *ring);
+uint8_t mesh_adjacency_on_boundary(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t vertex);
+size_t mesh_adjacency_next_boundary(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t half_edge);
+status_t mesh_compute_vertex_normals(mesh_t *mesh, mesh_normal_weighting_t weighting, size_t num_threads);
+status_t mesh_acmr(mesh_t *mesh, size_t cache_size, double *acmr);
+status_t mesh_reorder_faces(mesh_t *mesh, size_t cache_size);
+status_t mesh_reorder_vertices(mesh_t *mesh);
+status_t mesh_reorder(mesh_t *mesh, size_t cache_size, uint8_t reorder_vertices, double *before, double *after);
+status_t mesh_stripify(mesh_t *mesh, mesh_strips_t *strips);
+void mesh_strips_release(mesh_strips_t *strips);
+status_t mesh_decimate(mesh_t *mesh, size_t target_faces, double max_error, size_t num_threads);
+status_t mesh_parse_normal_weighting(char *string, mesh_normal_weighting_t *weighting);
+status_t mesh_parse_format(char *string, mesh_format_t *format);
 #endif
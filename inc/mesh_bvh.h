@@ -0,0 +1,129 @@
+#ifndef _MESH_BVH_H_
+#define _MESH_BVH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mesh.h"
+#include "status.h"
+
+//The most rays traced together by mesh_bvh_intersect_packet
+#define MESH_BVH_PACKET_SIZE 8
+//Stands in for the face when a query finds nothing
+#define MESH_BVH_NO_HIT SIZE_MAX
+
+//A box around some of the triangles; the root is nodes[0]
+typedef struct
+{
+	double min[3];
+	double max[3];
+	//a leaf's first triangle, or an interior node's second child, the first following it directly
+	size_t index;
+	//the number of triangles in a leaf, or 0 for an interior node
+	uint32_t count;
+	//the axis along which an interior node's children were split
+	uint32_t axis;
+} mesh_bvh_node_t;
+
+/*
+ * A bounding volume hierarchy over the triangles of a mesh, split by the surface area heuristic
+ * and flattened depth first into an array. It keeps its own copy of the triangles, so it does not
+ * change along with the mesh.
+ */
+typedef struct
+{
+	mesh_bvh_node_t *nodes;
+	size_t num_nodes;
+	//the corners of every triangle in the order the leaves hold them, nine coordinates apiece
+	double *triangles;
+	//the face of the mesh each triangle came from
+	size_t *faces;
+	size_t num_triangles;
+} mesh_bvh_t;
+
+typedef struct
+{
+	double origin[3];
+	double direction[3];
+	//only hits between these distances, measured in lengths of the direction, count
+	double t_min;
+	double t_max;
+} mesh_bvh_ray_t;
+
+typedef struct
+{
+	//the face hit, or MESH_BVH_NO_HIT
+	size_t face;
+	double t;
+	//the weights of the face's second and third vertices at the hit
+	double u;
+	double v;
+} mesh_bvh_hit_t;
+
+typedef struct
+{
+	//the nearest face, or MESH_BVH_NO_HIT
+	size_t face;
+	double point[3];
+	double distance;
+} mesh_bvh_closest_t;
+
+/*
+ * mesh_bvh_build - builds the hierarchy over the faces of a mesh
+ * @param mesh        - the mesh; faces that refer past its last point, or to a point that is not
+ *                      finite, are left out
+ * @param num_threads - the most threads with which to build the subtrees
+ * @param bvh         - out param; the hierarchy, to be released with mesh_bvh_release
+ * @return - OUT_OF_MEM if there was not enough memory; SUCCESS otherwise. The hierarchy is the
+ *           same however many threads build it.
+ */
+status_t mesh_bvh_build(mesh_t *mesh, size_t num_threads, mesh_bvh_t *bvh);
+
+/*
+ * mesh_bvh_release - frees a hierarchy made by mesh_bvh_build
+ * @param bvh - the hierarchy to release
+ */
+void mesh_bvh_release(mesh_bvh_t *bvh);
+
+/*
+ * mesh_bvh_intersect - finds the nearest triangle hit by a ray, from either side
+ * @param bvh - the hierarchy
+ * @param ray - the ray
+ * @param hit - out param; the nearest hit
+ * @return - 1 if the ray hits anything; 0 otherwise
+ */
+uint8_t mesh_bvh_intersect(mesh_bvh_t *bvh, mesh_bvh_ray_t *ray, mesh_bvh_hit_t *hit);
+
+/*
+ * mesh_bvh_intersect_packet - like mesh_bvh_intersect, for several rays at once that go down the
+ * hierarchy together, which pays off when they start and head in about the same way, e.g., the
+ * rays through neighbouring pixels
+ * @param bvh      - the hierarchy
+ * @param rays     - the rays
+ * @param num_rays - the number of rays, at most MESH_BVH_PACKET_SIZE; 4 and 8 suit SIMD units best
+ * @param hits     - out param; the nearest hit of each ray
+ */
+void mesh_bvh_intersect_packet(mesh_bvh_t *bvh, mesh_bvh_ray_t *rays, size_t num_rays, mesh_bvh_hit_t *hits);
+
+/*
+ * mesh_bvh_closest_point - finds the point on the mesh nearest to a point
+ * @param bvh          - the hierarchy
+ * @param point        - the point, as three coordinates
+ * @param max_distance - the furthest to look, or HUGE_VAL for no limit
+ * @param closest      - out param; the nearest point on the mesh
+ * @return - 1 if any triangle is within max_distance; 0 otherwise
+ */
+uint8_t mesh_bvh_closest_point(mesh_bvh_t *bvh, double *point, double max_distance, mesh_bvh_closest_t *closest);
+
+/*
+ * mesh_bvh_overlap - finds the triangles that overlap a box
+ * @param bvh      - the hierarchy
+ * @param min      - the lowest corner of the box, as three coordinates
+ * @param max      - the highest corner of the box, as three coordinates
+ * @param faces    - out param; the faces of the first capacity triangles found
+ * @param capacity - the most faces to write
+ * @return - the number of triangles that overlap the box, which may be more than capacity
+ */
+size_t mesh_bvh_overlap(mesh_bvh_t *bvh, double *min, double *max, size_t *faces, size_t capacity);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mesh.h"
+#include "point3d.h"
+#include "status.h"
+
+#define MESH_CACHE_DEFAULT_MAX_SIZE ((size_t) 256 << 20)
+
+/*
+ * An on-disk cache of tessellated meshes. Each entry is a file in the directory named by the hash
+ * of its key and holding the packed points and normals of the mesh; the faces follow from the
+ * topology, so they are not stored. Entries are used in place through a read-only mapping, and
+ * when the files together grow past max_size, the least recently used are removed.
+ */
+typedef struct
+{
+	const char *directory;
+	size_t max_size;
+} mesh_cache_t;
+
+/*
+ * Everything that determines a mesh: its shape and sampling, and the bytes describing the surface
+ * itself, e.g., the control points or the superellipsoid parameters. The bytes are taken as
+ * doubles, so that -0 and 0 make the same key.
+ */
+typedef struct
+{
+	mesh_topology_t topology;
+	size_t num_u;
+	size_t num_v;
+	uint8_t has_normals;
+	const void *surface;
+	size_t surface_size;
+} mesh_cache_key_t;
+
+//A mapped cache entry
+typedef struct
+{
+	void *mapping;
+	size_t mapping_size;
+	point3d_t *points;
+	point3d_t *normals;
+	//the next point handed out by a source reading the entry
+	size_t cursor;
+} mesh_cache_entry_t;
+
+/*
+ * mesh_cache_lookup - finds and maps the entry for the key, marking it as the most recently used
+ * @param cache - the cache in which to look
+ * @param key   - the key of the mesh
+ * @param entry - out param; the mapped entry on a hit, to be released with mesh_cache_release
+ * @return - 1 on a hit; 0 if there is no entry, or no usable one, for the key
+ */
+uint8_t mesh_cache_lookup(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_cache_entry_t *entry);
+
+/*
+ * mesh_cache_release - unmaps an entry returned by mesh_cache_lookup
+ * @param entry - the entry to release
+ */
+void mesh_cache_release(mesh_cache_entry_t *entry);
+
+/*
+ * mesh_cache_source_initialize - sets up a mesh source that reads its rows out of a cache entry, so
+ * that the cached mesh can be written with the mesh_stream_to_* functions
+ * @param source - the source to set up
+ * @param key    - the key with which the entry was found
+ * @param entry  - the entry to read, which must outlive the source
+ */
+void mesh_cache_source_initialize(mesh_source_t *source, mesh_cache_key_t *key, mesh_cache_entry_t *entry);
+
+/*
+ * mesh_cache_store - adds the mesh to the cache under the key, replacing any entry already there,
+ * and evicts the least recently used entries if the cache has grown too large
+ * @param cache - the cache to which to add the mesh
+ * @param key   - the key of the mesh
+ * @param mesh  - the mesh, whose points (and normals, if the key calls for them) are stored
+ * @return - an indication of whether an error occurred; a mesh larger than the whole cache, or
+ *           with a different number of points than the key calls for, is silently not stored
+ */
+status_t mesh_cache_store(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_t *mesh);
+
+/*
+ * mesh_cache_store_source - like mesh_cache_store, but generates the mesh one row at a time from a
+ * source rather than from a mesh held in memory
+ * @param cache  - the cache to which to add the mesh
+ * @param key    - the key of the mesh
+ * @param source - the source of the mesh, matching the key
+ * @return - an indication of whether an error occurred
+ */
+status_t mesh_cache_store_source(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_source_t *source);
+
+/*
+ * mesh_cache_output - writes the mesh for the key straight out of the cache, if it is there
+ * @param cache     - the cache
+ * @param key       - the key of the mesh
+ * @param generator - the source of a mesh that is streamed, and so never held in memory, from which
+ *                    it is added to the cache on a miss and then played back; NULL otherwise
+ * @param output    - how to write the mesh
+ * @param fd        - the file to which to write it
+ * @param hit       - out param; whether the mesh was written
+ * @return - an indication of whether an error occurred: in writing the mesh if it was written, and
+ *           otherwise in adding it to the cache, after which it is still left to be written
+ */
+status_t mesh_cache_output(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_source_t *generator, mesh_output_t *output,
+	int fd, uint8_t *hit);
+
+/*
+ * mesh_cache_parse_max_size - parses a command line argument giving the largest the cache may grow,
+ * in megabytes
+ * @param string   - the argument to parse
+ * @param max_size - where to place the size, in bytes
+ * @return - ARGS_ERROR if the argument is not a positive integer
+ */
+status_t mesh_cache_parse_max_size(char *string, size_t *max_size);
+
+#endif
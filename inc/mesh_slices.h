@@ -0,0 +1,21 @@
+#ifndef _MESH_SLICES_H_
+#define _MESH_SLICES_H_
+
+#include <stddef.h>
+
+/*
+ * Splitting work on a mesh among threads, shared by the mesh modules. The work is cut into an
+ * array of slices, structures of the caller's own choosing, each handed to a thread of its own.
+ */
+
+/*
+ * mesh_run_slices - runs the work on every slice, each on its own thread except the first, which
+ * runs on the calling thread along with any whose thread could not be started
+ * @param slices     - the array of slices
+ * @param slice_size - the size of each slice
+ * @param num_slices - the number of slices
+ * @param work       - the work to run, given a pointer to its slice
+ */
+void mesh_run_slices(void *slices, size_t slice_size, size_t num_slices, void *(*work)(void *));
+
+#endif
@@ -1,9 +1,8 @@
 #ifndef _POINT3D_H_
 #define _POINT3D_H_
 
-#include <stdio.h>
-
 #include "matrix.h"
+#include "writer.h"
 
 typedef struct
 {
@@ -12,6 +11,14 @@ typedef struct
 	double z;
 } point3d_t;
 
+//How point3d_print_array_to_iv draws a set of points
+typedef enum
+{
+	POINT3D_STYLE_SPHERES, //a complete, self-contained sphere per point
+	POINT3D_STYLE_INSTANCED, //one shared sphere, placed at each point with only a translation
+	POINT3D_STYLE_POINTSET, //a single PointSet of all the points, ignoring the radius
+} point3d_style_t;
+
 /*
  * point3d_initialize - returns a new instance of a 3D point, with all coordinates set to 0
  * @return - the new 3D point
@@ -80,10 +87,30 @@ void point3d_fmad(point3d_t *dst, point3d_t *src, double s);
 /*
  * point3d_print_to_iv - prints the point as a white sphere in the OpenInventor file format
  * @param point - the point to print
- * @param file  - the file to which to print
- * @param r     - the radius for the printed sphere
+ * @param writer - the writer to which to print
+ * @param r      - the radius for the printed sphere
+ */
+void point3d_print_to_iv(point3d_t *point, writer_t *writer, double r);
+
+/*
+ * point3d_print_array_to_iv - prints the points as white spheres or as a point set in the
+ * OpenInventor file format
+ * @param points - the points to print
+ * @param count  - the number of points
+ * @param r      - the radius for the printed spheres
+ * @param style  - how to draw the points
+ * @param writer - the writer to which to print
+ */
+void point3d_print_array_to_iv(point3d_t *points, size_t count, double r, point3d_style_t style, writer_t *writer);
+
+/*
+ * point3d_parse_style - parses the name of a style for point3d_print_array_to_iv: "spheres",
+ * "instanced", or "points"
+ * @param string - the name to parse
+ * @param style  - out param; the style named by the string
+ * @return       - ARGS_ERROR if the string does not name a style; SUCCESS otherwise
  */
-void point3d_print_to_iv(point3d_t *point, FILE *file, double r);
+status_t point3d_parse_style(char *string, point3d_style_t *style);
 
 /*
  * point3d_initialize_matrix - initializes a homogeneous matrix representation of the point
@@ -97,8 +124,8 @@ status_t point3d_initialize_matrix(matrix_t **m, double *pos);
  * point3d_print_matrix_to_iv - prints the given matrix/vector as a point, i.e., a white sphere,
  * in the OpenInventor file format
  * @param point - the point to print
- * @param file  - the file to which to print
- * @param r     - the radius for the printed sphere
+ * @param writer - the writer to which to print
+ * @param r      - the radius for the printed sphere
  */
-void point3d_print_matrix_to_iv(matrix_t *m, FILE *file, double r);
+void point3d_print_matrix_to_iv(matrix_t *m, writer_t *writer, double r);
 #endif
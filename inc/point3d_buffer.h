@@ -0,0 +1,88 @@
+#ifndef _POINT3D_BUFFER_H_
+#define _POINT3D_BUFFER_H_
+
+#include <stddef.h>
+
+#include "point3d.h"
+#include "status.h"
+
+/*
+ * A growable array of points stored contiguously by value, for large point sets that would
+ * otherwise cost one allocation per point in a point3d_vec_t. The points may instead live in a
+ * memory mapping the buffer has adopted, in which case they are copied out the first time the
+ * buffer has to grow.
+ */
+typedef struct
+{
+	point3d_t *points;
+	size_t size;
+	size_t capacity;
+	void *mapping;
+	size_t mapping_size;
+} point3d_buffer_t;
+
+/*
+ * point3d_buffer_initialize - returns a new, empty point buffer
+ * @return - the new buffer, or NULL if out of memory
+ */
+point3d_buffer_t *point3d_buffer_initialize(void);
+
+/*
+ * point3d_buffer_uninitialize - uninitializes a point buffer, freeing the points along with it
+ * @param buffer - the buffer to uninitialize
+ */
+void point3d_buffer_uninitialize(point3d_buffer_t *buffer);
+
+/*
+ * point3d_buffer_reserve - ensures the buffer can hold at least capacity points without growing
+ * @param buffer   - the buffer to grow
+ * @param capacity - the number of points the buffer must be able to hold
+ * @return         - OUT_OF_MEM if the buffer could not be grown; SUCCESS otherwise
+ */
+status_t point3d_buffer_reserve(point3d_buffer_t *buffer, size_t capacity);
+
+/*
+ * point3d_buffer_adopt_mapping - makes the buffer use points stored in place inside a memory mapping,
+ * discarding anything the buffer held; the buffer unmaps the mapping when it no longer needs it
+ * @param buffer       - the buffer
+ * @param mapping      - the start of the mapping, as returned by mmap
+ * @param mapping_size - the length of the mapping
+ * @param points       - the first point, inside the mapping and suitably aligned
+ * @param count        - the number of points
+ */
+void point3d_buffer_adopt_mapping(point3d_buffer_t *buffer, void *mapping, size_t mapping_size, point3d_t *points, size_t count);
+
+/*
+ * point3d_buffer_drop_front - removes the first count points from the buffer, shifting the rest down
+ * @param buffer - the buffer
+ * @param count  - the number of points to remove, at most point3d_buffer_size(buffer)
+ */
+void point3d_buffer_drop_front(point3d_buffer_t *buffer, size_t count);
+
+/*
+ * point3d_buffer_push_back - appends the point (x, y, z) to the end of the buffer
+ * @param buffer - the buffer to which to append
+ * @param x      - the x coordinate
+ * @param y      - the y coordinate
+ * @param z      - the z coordinate
+ * @return       - OUT_OF_MEM if the buffer had to grow and could not; SUCCESS otherwise
+ */
+status_t point3d_buffer_push_back(point3d_buffer_t *buffer, double x, double y, double z);
+
+/*
+ * point3d_buffer_get - returns the point at the given index; the pointer is invalidated by any
+ * later growth of the buffer
+ * @param buffer - the buffer from which to get the point
+ * @param index  - the index of the point, less than point3d_buffer_size(buffer)
+ * @return       - a pointer to the point
+ */
+point3d_t *point3d_buffer_get(point3d_buffer_t *buffer, size_t index);
+
+/*
+ * point3d_buffer_size - returns the number of points in the buffer
+ * @param buffer - the buffer
+ * @return       - the number of points
+ */
+size_t point3d_buffer_size(point3d_buffer_t *buffer);
+
+#endif
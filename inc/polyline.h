@@ -6,6 +6,7 @@
 #include "point3d.h"
 #include "point3d_vec.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
@@ -39,9 +40,21 @@ void polyline_append_point(polyline_t *poly, point3d_t *point);
 status_t polyline_copy_and_append_point(polyline_t *poly, point3d_t *point);
 
 /*
- * polyline_print - prints the polyline in OpenInventor format to the given stream
+ * polyline_weld - removes every point that lies within the tolerance of the point kept before it,
+ * such as the end point each segment of a spline repeats from the one before; since the order of
+ * the points is what connects them, points that merely revisit an earlier spot are kept
+ * @param poly      - the polyline to weld
+ * @param tolerance - the largest distance at which two points are the same; 0 removes only exact
+ *                    repeats
+ * @return - OUT_OF_MEM if there was not enough memory, leaving the polyline untouched; SUCCESS
+ *           otherwise
+ */
+status_t polyline_weld(polyline_t *poly, double tolerance);
+
+/*
+ * polyline_print - prints the polyline in OpenInventor format to the given writer
  * @param poly   - the polyline to print
- * @param stream - the stream to which to print
+ * @param writer - the writer to which to print
  */
-void polyline_print_to_iv(polyline_t *poly, FILE *stream);
+void polyline_print_to_iv(polyline_t *poly, writer_t *writer);
 #endif
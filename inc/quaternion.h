@@ -0,0 +1,158 @@
+#ifndef _QUATERNION_H_
+#define _QUATERNION_H_
+
+#include <stddef.h>
+
+#include "matrix.h"
+#include "transforms.h"
+
+//A rotation stored as the unit quaternion w + xi + yj + zk
+typedef struct
+{
+	double w;
+	double x;
+	double y;
+	double z;
+} quaternion_t;
+
+/*
+ * quaternion_identity - sets the quaternion to the identity rotation
+ * @param q - the quaternion to set
+ */
+void quaternion_identity(quaternion_t *q);
+
+/*
+ * quaternion_from_axis_angle - sets the quaternion to the rotation around the given axis
+ * @param q    - the quaternion to set
+ * @param axis - the three components of the axis around which to rotate; need not be unit length,
+ *               but must not be zero
+ * @param t    - the angle to rotate around the axis, in radians
+ */
+void quaternion_from_axis_angle(quaternion_t *q, double *axis, double t);
+
+/*
+ * quaternion_from_rotation - sets the quaternion to the rotation around one of the coordinate axes,
+ * i.e., the same rotation as rotation_matrix(t, dir)
+ * @param q   - the quaternion to set
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void quaternion_from_rotation(quaternion_t *q, double t, rotatedir_t dir);
+
+/*
+ * quaternion_to_axis_angle - converts the unit quaternion to a unit axis and an angle in [0, 2pi];
+ * the identity rotation gives the x-axis and an angle of 0
+ * @param q    - the quaternion to convert
+ * @param axis - the three element array into which to place the axis
+ * @param t    - where to place the angle, in radians
+ */
+void quaternion_to_axis_angle(quaternion_t *q, double *axis, double *t);
+
+/*
+ * quaternion_multiply - composes two rotations, c = ab, i.e., the rotation b followed by a. c may
+ * alias a or b.
+ * @param c - the quaternion in which to store the result
+ * @param a - the left-hand quaternion
+ * @param b - the right-hand quaternion
+ */
+void quaternion_multiply(quaternion_t *c, quaternion_t *a, quaternion_t *b);
+
+/*
+ * quaternion_conjugate - replaces the quaternion with its conjugate, which for a unit quaternion is
+ * the inverse rotation
+ * @param q - the quaternion to conjugate
+ */
+void quaternion_conjugate(quaternion_t *q);
+
+/*
+ * quaternion_normalize - scales the quaternion to unit length, undoing drift from long chains of
+ * compositions
+ * @param q - the quaternion to normalize
+ */
+void quaternion_normalize(quaternion_t *q);
+
+/*
+ * quaternion_slerp - spherically, linearly interpolates along the shorter arc between two unit
+ * quaternions at constant angular velocity. c may alias a or b.
+ * @param c - the quaternion in which to store the result
+ * @param a - the rotation at t = 0
+ * @param b - the rotation at t = 1
+ * @param t - the interpolation parameter, usually in [0, 1]
+ */
+void quaternion_slerp(quaternion_t *c, quaternion_t *a, quaternion_t *b, double t);
+
+/*
+ * quaternion_rotate_point - rotates a point (or direction) by the unit quaternion
+ * @param q   - the rotation
+ * @param in  - the three coordinates to rotate
+ * @param out - the three element array into which to place the result; may alias in
+ */
+void quaternion_rotate_point(quaternion_t *q, double *in, double *out);
+
+/*
+ * quaternion_to_array - converts the unit quaternion to a 4x4, homogeneous, row-major rotation array
+ * @param q     - the quaternion to convert
+ * @param array - the 16 element array into which to place the matrix
+ */
+void quaternion_to_array(quaternion_t *q, double *array);
+
+/*
+ * quaternion_to_array_3x4 - converts the unit quaternion to the top three rows of the 4x4 rotation,
+ * i.e., a 3x4, row-major affine array with no translation
+ * @param q     - the quaternion to convert
+ * @param array - the 12 element array into which to place the matrix
+ */
+void quaternion_to_array_3x4(quaternion_t *q, double *array);
+
+/*
+ * quaternion_to_matrix - returns the 4x4, homogeneous rotation matrix for the unit quaternion
+ * @param q - the quaternion to convert
+ * @return - the new matrix, or NULL if out of memory
+ */
+matrix_t *quaternion_to_matrix(quaternion_t *q);
+
+/*
+ * quaternion_to_matrix_assign - assigns the 4x4, homogeneous rotation matrix for the unit quaternion
+ * to the given matrix
+ * @param m - the 4x4 matrix to which to assign
+ * @param q - the quaternion to convert
+ */
+void quaternion_to_matrix_assign(matrix_t *m, quaternion_t *q);
+
+/*
+ * quaternion_array_multiply - composes n pairs of rotations, c[i] = a[i]b[i]. c may alias a or b.
+ * @param c - the n quaternions in which to store the results
+ * @param a - the n left-hand quaternions
+ * @param b - the n right-hand quaternions
+ * @param n - the number of pairs
+ */
+void quaternion_array_multiply(quaternion_t *c, quaternion_t *a, quaternion_t *b, size_t n);
+
+/*
+ * quaternion_array_chain - composes a chain of joint rotations, so that world[i] is the product
+ * local[0]local[1]...local[i]. world may alias local.
+ * @param world - the n quaternions in which to store the accumulated rotations
+ * @param local - the n rotations of the joints, from the root outward
+ * @param n     - the number of joints
+ */
+void quaternion_array_chain(quaternion_t *world, quaternion_t *local, size_t n);
+
+/*
+ * quaternion_array_to_arrays - converts n unit quaternions to 4x4, homogeneous, row-major rotation
+ * arrays, packed back to back
+ * @param q      - the quaternions to convert
+ * @param n      - the number of quaternions
+ * @param arrays - the 16 * n doubles into which to place the matrices
+ */
+void quaternion_array_to_arrays(quaternion_t *q, size_t n, double *arrays);
+
+/*
+ * quaternion_array_to_arrays_3x4 - converts n unit quaternions to 3x4, row-major affine arrays with
+ * no translation, packed back to back
+ * @param q      - the quaternions to convert
+ * @param n      - the number of quaternions
+ * @param arrays - the 12 * n doubles into which to place the matrices
+ */
+void quaternion_array_to_arrays_3x4(quaternion_t *q, size_t n, double *arrays);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _ROBOT_H_
+#define _ROBOT_H_
+
+#include "affine.h"
+#include "draw_list.h"
+#include "hierarchical.h"
+#include "status.h"
+#include "transforms.h"
+
+//The robot arm is a base cuboid with three links stacked on top of it, each rotating around
+//robot_joint_axes[k] at the top of the previous piece, and a sphere at either end of the arm.
+#define ROBOT_JOINTS 3
+#define ROBOT_NODES (ROBOT_JOINTS + 3)
+#define ROBOT_BASE_HEIGHT 1.0
+
+extern const rotatedir_t robot_joint_axes[ROBOT_JOINTS];
+
+typedef struct
+{
+	double lengths[ROBOT_JOINTS];
+	hierarchical_t models[ROBOT_NODES];
+	hierarchical_flat_t *flat;
+	affine_t base;
+	affine_t local;
+} robot_t;
+
+/*
+ * robot_initialize - builds the hierarchy for the robot arm with the given link lengths, posed at the
+ * given joint angles
+ * @param robot   - the robot to initialize
+ * @param lengths - the ROBOT_JOINTS link lengths, from the base outward
+ * @param thetas  - the ROBOT_JOINTS joint angles, in radians
+ * @return - an indication of whether the function failed or not
+ */
+status_t robot_initialize(robot_t *robot, double *lengths, double *thetas);
+
+/*
+ * robot_uninitialize - uninitializes the robot arm
+ * @param robot - the robot to uninitialize
+ */
+void robot_uninitialize(robot_t *robot);
+
+/*
+ * robot_set_angles - reposes the robot arm; only the joints whose angles are set are recomputed on
+ * the next draw
+ * @param robot  - the robot to repose
+ * @param thetas - the ROBOT_JOINTS joint angles, in radians
+ */
+void robot_set_angles(robot_t *robot, double *thetas);
+
+/*
+ * robot_draw - appends the records for every piece of the robot arm to the draw list
+ * @param robot - the robot to draw
+ * @param list  - the draw list to which to append
+ * @return - an indication of whether the function failed or not
+ */
+status_t robot_draw(robot_t *robot, draw_list_t *list);
+
+#endif
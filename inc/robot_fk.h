@@ -0,0 +1,94 @@
+#ifndef _ROBOT_FK_H_
+#define _ROBOT_FK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "robot.h"
+#include "status.h"
+
+//Number of samples evaluated together, in structure-of-arrays form, by robot_fk_evaluate
+#define ROBOT_FK_BLOCK 256
+
+typedef enum
+{
+	FK_GRID, FK_RANDOM,
+} fk_sampling_t;
+
+typedef struct
+{
+	fk_sampling_t sampling;
+	//Number of evenly spaced angles per joint for FK_GRID, for steps^ROBOT_JOINTS samples in total
+	size_t steps;
+	//Number of samples for FK_RANDOM, each drawn uniformly from the joint ranges
+	size_t count;
+	uint64_t seed;
+	double lo[ROBOT_JOINTS];
+	double hi[ROBOT_JOINTS];
+} robot_fk_samples_t;
+
+typedef struct
+{
+	double min[3];
+	double max[3];
+} robot_bounds_t;
+
+/*
+ * Binary point cloud format written by robot_fk_run, all little-endian:
+ *   header      - robot_fk_header_t
+ *   positions   - count end-effector positions, each three floats (x, y, z)
+ *   link bounds - if flags has ROBOT_FK_HAS_BOUNDS, ROBOT_JOINTS robot_bounds_t, one per link
+ */
+#define ROBOT_FK_MAGIC "CGFK"
+#define ROBOT_FK_VERSION 1
+#define ROBOT_FK_HAS_BOUNDS 0x1
+
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t count;
+} robot_fk_header_t;
+
+/*
+ * robot_fk_num_samples - returns the total number of joint angle tuples described by the samples
+ * @param samples - the sampling description
+ * @return - the number of samples
+ */
+size_t robot_fk_num_samples(robot_fk_samples_t *samples);
+
+/*
+ * robot_fk_sample_angles - generates the joint angles of a consecutive range of samples. Each sample
+ * only depends on its index, so ranges can be generated independently and in any order.
+ * @param samples - the sampling description
+ * @param first   - the index of the first sample to generate
+ * @param n       - the number of samples to generate
+ * @param thetas  - ROBOT_JOINTS arrays of n angles each, in radians, into which to place the angles
+ */
+void robot_fk_sample_angles(robot_fk_samples_t *samples, size_t first, size_t n, double **thetas);
+
+/*
+ * robot_fk_evaluate - computes the end-effector position of the robot arm for each joint angle tuple
+ * @param lengths   - the ROBOT_JOINTS link lengths
+ * @param thetas    - ROBOT_JOINTS arrays of n angles each, in radians
+ * @param n         - the number of tuples to evaluate
+ * @param positions - 3 * n floats into which to place the (x, y, z) positions
+ * @param bounds    - ROBOT_JOINTS bounds to grow by the centerline of each link, or NULL
+ */
+void robot_fk_evaluate(double *lengths, double **thetas, size_t n, float *positions, robot_bounds_t *bounds);
+
+/*
+ * robot_fk_run - evaluates every sample across the given number of threads and writes the binary
+ * point cloud to the stream
+ * @param lengths     - the ROBOT_JOINTS link lengths
+ * @param samples     - the joint angle tuples to evaluate
+ * @param num_threads - the number of threads to use
+ * @param with_bounds - whether to include the per-link bounds
+ * @param stream      - the stream to which to write the point cloud
+ * @return - an indication of whether the function failed or not
+ */
+status_t robot_fk_run(double *lengths, robot_fk_samples_t *samples, size_t num_threads, uint8_t with_bounds, FILE *stream);
+
+#endif
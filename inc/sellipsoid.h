@@ -1,7 +1,10 @@
 #ifndef _SELLIPSOID_H_
 #define _SELLIPSOID_H_
 
+#include <stdint.h>
+
 #include "mesh.h"
+#include "point3d.h"
 #include "status.h"
 
 typedef struct
@@ -13,7 +16,27 @@ typedef struct
 	double C;
 } sellipsoid_t;
 
+typedef struct
+{
+	point3d_t origin;
+	point3d_t direction;
+	//only hits between these distances, measured in lengths of the direction, count
+	double t_min;
+	double t_max;
+} sellipsoid_ray_t;
+
+typedef struct
+{
+	//the distance to the first crossing of the surface, or HUGE_VAL for a ray that misses
+	double t;
+	//the unit normal of the surface there, facing out
+	point3d_t normal;
+} sellipsoid_hit_t;
+
 status_t sellipsoid_calculate_mesh_points(sellipsoid_t *sellipsoid, mesh_t *mesh, size_t num_u, size_t num_v);
 status_t sellipsoid_calculate_mesh_normals(sellipsoid_t *sellipsoid, mesh_t *mesh);
+void sellipsoid_source_initialize(mesh_source_t *source, sellipsoid_t *sellipsoid, size_t num_u, size_t num_v, uint8_t has_normals);
+void sellipsoid_inside_outside(sellipsoid_t *sellipsoid, point3d_t *points, size_t num_points, double *values);
+size_t sellipsoid_intersect_rays(sellipsoid_t *sellipsoid, sellipsoid_ray_t *rays, size_t num_rays, sellipsoid_hit_t *hits);
 
 #endif
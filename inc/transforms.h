@@ -1,6 +1,7 @@
 #ifndef _TRANSFORMS_H_
 #define _TRANSFORMS_H_
 
+#include "affine.h"
 #include "matrix.h"
 
 typedef enum
@@ -37,6 +38,15 @@ void translation_matrix_assign(matrix_t *m, double x, double y, double z);
  */
 matrix_t *rotation_matrix(double t, rotatedir_t dir);
 
+/*
+ * rotation_matrix_assign - assigns the 3D, homogeneous rotation matrix around the given axis for the
+ * given angle to the given matrix
+ * @param m   - the matrix to which to assign the rotation matrix
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void rotation_matrix_assign(matrix_t *m, double t, rotatedir_t dir);
+
 /*
  * rotation_matrix_x - returns the 3D, homogeneous rotation matrix around the
  * x-axis for the given angle
@@ -85,4 +95,142 @@ matrix_t *rotation_matrix_z(double t);
  */
 void rotation_matrix_z_assign(matrix_t *m, double t);
 
+/*
+ * translation_rotation_matrix - returns the 3D, homogeneous matrix that rotates around the given axis
+ * and then translates, i.e., the product translation * rotation, computed directly
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ * @return - the appropriate 4x4 matrix
+ */
+matrix_t *translation_rotation_matrix(double x, double y, double z, double t, rotatedir_t dir);
+
+/*
+ * translation_rotation_matrix_assign - assigns the matrix returned by translation_rotation_matrix
+ * for the given values to the given matrix
+ * @param m   - the matrix to which to assign
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void translation_rotation_matrix_assign(matrix_t *m, double x, double y, double z, double t, rotatedir_t dir);
+
+/*
+ * rotation_translation_matrix - returns the 3D, homogeneous matrix that translates and then rotates
+ * around the given axis, i.e., the product rotation * translation, computed directly
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ * @return - the appropriate 4x4 matrix
+ */
+matrix_t *rotation_translation_matrix(double t, rotatedir_t dir, double x, double y, double z);
+
+/*
+ * rotation_translation_matrix_assign - assigns the matrix returned by rotation_translation_matrix
+ * for the given values to the given matrix
+ * @param m   - the matrix to which to assign
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ */
+void rotation_translation_matrix_assign(matrix_t *m, double t, rotatedir_t dir, double x, double y, double z);
+
+/*
+ * trs_matrix - returns the 3D, homogeneous matrix that scales, rotates around the given axis, and then
+ * translates, i.e., the product translation * rotation * scale, computed directly
+ * @param translate - the three translation values
+ * @param t         - the angle to rotate around the axis, in radians
+ * @param dir       - the axis around which to rotate
+ * @param scale     - the three scale factors
+ * @return - the appropriate 4x4 matrix
+ */
+matrix_t *trs_matrix(double *translate, double t, rotatedir_t dir, double *scale);
+
+/*
+ * trs_matrix_assign - assigns the matrix returned by trs_matrix for the given values to the given
+ * matrix
+ * @param m         - the matrix to which to assign
+ * @param translate - the three translation values
+ * @param t         - the angle to rotate around the axis, in radians
+ * @param dir       - the axis around which to rotate
+ * @param scale     - the three scale factors
+ */
+void trs_matrix_assign(matrix_t *m, double *translate, double t, rotatedir_t dir, double *scale);
+
+/*
+ * transform_rotate - rotates the 4x4 transform in place around the given axis of its own frame,
+ * i.e., m = m * rotation, without building the rotation matrix
+ * @param m   - the transform to rotate
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void transform_rotate(matrix_t *m, double t, rotatedir_t dir);
+
+/*
+ * transform_translate - translates the 4x4 transform in place along the axes of its own frame,
+ * i.e., m = m * translation, without building the translation matrix
+ * @param m - the transform to translate
+ * @param x - the x-direction translation
+ * @param y - the y-direction translation
+ * @param z - the z-direction translation
+ */
+void transform_translate(matrix_t *m, double x, double y, double z);
+
+/*
+ * translation_affine - sets the affine transform to the translation by the given x, y, and z values
+ * @param a - the affine transform to set
+ * @param x - the x-direction translation
+ * @param y - the y-direction translation
+ * @param z - the z-direction translation
+ */
+void translation_affine(affine_t *a, double x, double y, double z);
+
+/*
+ * rotation_affine - sets the affine transform to the rotation around the given axis
+ * @param a   - the affine transform to set
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void rotation_affine(affine_t *a, double t, rotatedir_t dir);
+
+/*
+ * translation_rotation_affine - the affine counterpart of translation_rotation_matrix
+ * @param a   - the affine transform to set
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ */
+void translation_rotation_affine(affine_t *a, double x, double y, double z, double t, rotatedir_t dir);
+
+/*
+ * rotation_translation_affine - the affine counterpart of rotation_translation_matrix
+ * @param a   - the affine transform to set
+ * @param t   - the angle to rotate around the axis, in radians
+ * @param dir - the axis around which to rotate
+ * @param x   - the x-direction translation
+ * @param y   - the y-direction translation
+ * @param z   - the z-direction translation
+ */
+void rotation_translation_affine(affine_t *a, double t, rotatedir_t dir, double x, double y, double z);
+
+/*
+ * trs_affine - the affine counterpart of trs_matrix
+ * @param a         - the affine transform to set
+ * @param translate - the three translation values
+ * @param t         - the angle to rotate around the axis, in radians
+ * @param dir       - the axis around which to rotate
+ * @param scale     - the three scale factors
+ */
+void trs_affine(affine_t *a, double *translate, double t, rotatedir_t dir, double *scale);
+
 #endif
@@ -0,0 +1,146 @@
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+#include <stddef.h>
+
+#include "status.h"
+
+#define WRITER_BUFFER_SIZE (1 << 16)
+#define WRITER_DEFAULT_PRECISION 6
+#define WRITER_MAX_PRECISION 17
+//Passed as the file descriptor to keep everything in memory rather than writing it out
+#define WRITER_NO_FD (-1)
+
+//A buffered text writer for the output formats. Doubles are formatted by hand with a fixed number
+//of digits after the decimal point, matching printf's "%.*f" exactly, and the buffer goes out in
+//large write() calls. Errors are sticky: once one occurs, everything else is dropped and
+//writer_error (and writer_flush) report it.
+typedef struct
+{
+	int fd;
+	char *buffer;
+	size_t size;
+	size_t capacity;
+	int precision;
+	status_t error;
+} writer_t;
+
+/*
+ * writer_initialize - creates a new writer
+ * @param fd        - the file descriptor to which to write, or WRITER_NO_FD to accumulate everything
+ *                    in the buffer, which then grows as needed
+ * @param precision - the number of digits to print after the decimal point for doubles, from 0 to
+ *                    WRITER_MAX_PRECISION
+ * @return - the new writer, or NULL if out of memory
+ */
+writer_t *writer_initialize(int fd, int precision);
+
+/*
+ * writer_uninitialize - uninitializes the writer without flushing it; the file descriptor is not
+ * closed
+ * @param writer - the writer to uninitialize
+ */
+void writer_uninitialize(writer_t *writer);
+
+/*
+ * writer_flush - writes out everything in the buffer; does nothing for in-memory writers
+ * @param writer - the writer to flush
+ * @return - the first error the writer encountered, if any
+ */
+status_t writer_flush(writer_t *writer);
+
+/*
+ * writer_clear - discards everything in the buffer, e.g., to reuse an in-memory writer
+ * @param writer - the writer to clear
+ */
+void writer_clear(writer_t *writer);
+
+/*
+ * writer_error - returns the first error the writer encountered, if any
+ * @param writer - the writer to check
+ * @return - the error, or SUCCESS
+ */
+status_t writer_error(writer_t *writer);
+
+/*
+ * writer_bytes - writes the given bytes
+ * @param writer - the writer to which to write
+ * @param data   - the bytes to write
+ * @param length - the number of bytes
+ */
+void writer_bytes(writer_t *writer, const char *data, size_t length);
+
+/*
+ * writer_string - writes the given NUL-terminated string
+ * @param writer - the writer to which to write
+ * @param string - the string to write
+ */
+void writer_string(writer_t *writer, const char *string);
+
+/*
+ * writer_double - writes the double as with printf("%.*f", precision, value)
+ * @param writer - the writer to which to write
+ * @param value  - the value to write
+ */
+void writer_double(writer_t *writer, double value);
+
+/*
+ * writer_point - writes the three coordinates separated by single spaces
+ * @param writer - the writer to which to write
+ * @param x      - the x coordinate
+ * @param y      - the y coordinate
+ * @param z      - the z coordinate
+ */
+void writer_point(writer_t *writer, double x, double y, double z);
+
+/*
+ * writer_size - writes the unsigned integer in decimal
+ * @param writer - the writer to which to write
+ * @param value  - the value to write
+ */
+void writer_size(writer_t *writer, size_t value);
+
+/*
+ * writer_double_length - returns the number of characters writer_double writes for the value
+ * @param value     - the value to measure
+ * @param precision - the number of digits after the decimal point
+ * @return - the length of the formatted value
+ */
+size_t writer_double_length(double value, int precision);
+
+/*
+ * writer_format_double - formats the value as writer_double would directly into memory,
+ * right-aligned in a field of exactly width characters padded with spaces
+ * @param out       - where to place the characters; no NUL is added
+ * @param value     - the value to format
+ * @param precision - the number of digits after the decimal point
+ * @param width     - the width of the field, at least writer_double_length(value, precision)
+ */
+void writer_format_double(char *out, double value, int precision, size_t width);
+
+/*
+ * writer_size_length - returns the number of digits writer_size writes for the value
+ * @param value - the value to measure
+ * @return - the number of digits
+ */
+size_t writer_size_length(size_t value);
+
+/*
+ * writer_format_size - formats the unsigned integer in decimal directly into memory, right-aligned
+ * in a field of exactly width characters padded with spaces
+ * @param out   - where to place the characters; no NUL is added
+ * @param value - the value to format
+ * @param width - the width of the field, at least writer_size_length(value)
+ */
+void writer_format_size(char *out, size_t value, size_t width);
+
+/*
+ * writer_parse_precision - parses a command line argument giving the number of digits to print
+ * after the decimal point
+ * @param string    - the argument to parse
+ * @param precision - where to place the precision
+ * @return - ARGS_ERROR if the argument is not an integer from 0 to WRITER_MAX_PRECISION
+ */
+status_t writer_parse_precision(char *string, int *precision);
+
+#endif
@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include "affine.h"
+
+#include "matrix.h"
+#include "point3d.h"
+
+void affine_identity(affine_t *a)
+{
+	double *m = a->m;
+	memset(m, 0, sizeof a->m);
+	m[0] = m[5] = m[10] = 1.0;
+}
+
+void affine_from_matrix(affine_t *a, matrix_t *m)
+{
+	double array[16];
+	matrix_copy_to_array(m, array);
+	memcpy(a->m, array, sizeof a->m);
+}
+
+matrix_t *affine_to_matrix(affine_t *a)
+{
+	matrix_t *m = matrix_initialize(4, 4);
+	if (m != NULL)
+	{
+		affine_to_matrix_assign(m, a);
+	}
+
+	return m;
+}
+
+void affine_to_matrix_assign(matrix_t *m, affine_t *a)
+{
+	double array[16];
+	memcpy(array, a->m, sizeof a->m);
+	array[12] = array[13] = array[14] = 0.0;
+	array[15] = 1.0;
+	matrix_assign_from_array(m, array);
+}
+
+void affine_compose(affine_t *c, affine_t *a, affine_t *b)
+{
+	double *x = a->m, *y = b->m;
+	double r[AFFINE_ELEMS];
+
+	size_t row;
+	for (row = 0; row < 3; row++)
+	{
+		double *ar = x + 4 * row;
+		double a0 = ar[0], a1 = ar[1], a2 = ar[2];
+		r[4 * row + 0] = a0 * y[0] + a1 * y[4] + a2 * y[8];
+		r[4 * row + 1] = a0 * y[1] + a1 * y[5] + a2 * y[9];
+		r[4 * row + 2] = a0 * y[2] + a1 * y[6] + a2 * y[10];
+		//b's implicit last row contributes a's translation, unscaled
+		r[4 * row + 3] = a0 * y[3] + a1 * y[7] + a2 * y[11] + ar[3];
+	}
+
+	memcpy(c->m, r, sizeof r);
+}
+
+void affine_transform_point(affine_t *a, point3d_t *in, point3d_t *out)
+{
+	double *m = a->m;
+	double x = in->x, y = in->y, z = in->z;
+	out->x = m[0] * x + m[1] * y + m[2] * z + m[3];
+	out->y = m[4] * x + m[5] * y + m[6] * z + m[7];
+	out->z = m[8] * x + m[9] * y + m[10] * z + m[11];
+}
+
+void affine_transform_direction(affine_t *a, point3d_t *in, point3d_t *out)
+{
+	double *m = a->m;
+	double x = in->x, y = in->y, z = in->z;
+	out->x = m[0] * x + m[1] * y + m[2] * z;
+	out->y = m[4] * x + m[5] * y + m[6] * z;
+	out->z = m[8] * x + m[9] * y + m[10] * z;
+}
@@ -0,0 +1,453 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "animation.h"
+
+#include "awh44_math.h"
+#include "draw_list.h"
+#include "robot.h"
+#include "status.h"
+#include "writer.h"
+
+//How many frames, per worker thread, may be finished but not yet written before the workers wait
+#define FRAMES_IN_FLIGHT 2
+
+status_t keyframes_read(FILE *stream, keyframes_t *keys)
+{
+	status_t error = SUCCESS;
+
+	keys->keys = NULL;
+	keys->size = 0;
+	size_t capacity = 0;
+
+	char *line = NULL;
+	size_t size = 0;
+	size_t line_num = 0;
+
+	while (getline(&line, &size, stream) > 0)
+	{
+		line_num++;
+
+		char *start = line;
+		while (isspace((unsigned char) *start))
+		{
+			start++;
+		}
+
+		if (*start == '\0')
+		{
+			continue;
+		}
+
+		if (keys->size == capacity)
+		{
+			capacity = capacity ? 2 * capacity : 16;
+			keyframe_t *grown;
+			INITIALIZE_OR_OUT_OF_MEM(grown, realloc(keys->keys, capacity * sizeof *grown), error, exit1);
+			keys->keys = grown;
+		}
+
+		double values[ROBOT_JOINTS + 1];
+		size_t i;
+		char *end = start;
+		for (i = 0; i < ROBOT_JOINTS + 1; i++)
+		{
+			values[i] = strtod(start, &end);
+			if (end == start)
+			{
+				break;
+			}
+			start = end;
+		}
+
+		while (isspace((unsigned char) *end))
+		{
+			end++;
+		}
+
+		keyframe_t *key = keys->keys + keys->size;
+		if (i < ROBOT_JOINTS + 1 || *end != '\0' || (keys->size > 0 && values[0] <= key[-1].time))
+		{
+			fprintf(stderr, "ERROR: incorrect keyframe in line %zu\n", line_num);
+			error = FILE_FORMAT_ERROR;
+			goto exit1;
+		}
+
+		key->time = values[0];
+		for (i = 0; i < ROBOT_JOINTS; i++)
+		{
+			key->thetas[i] = TO_RAD(values[i + 1]);
+		}
+		keys->size++;
+	}
+
+	if (!feof(stream))
+	{
+		fprintf(stderr, "ERROR: could not read from file\n");
+		error = FILE_READ_ERROR;
+		goto exit1;
+	}
+
+	if (keys->size == 0)
+	{
+		fprintf(stderr, "ERROR: no keyframes given\n");
+		error = FILE_FORMAT_ERROR;
+		goto exit1;
+	}
+
+	goto exit0;
+
+exit1:
+	free(keys->keys);
+	keys->keys = NULL;
+	keys->size = 0;
+exit0:
+	free(line);
+	return error;
+}
+
+void keyframes_uninitialize(keyframes_t *keys)
+{
+	free(keys->keys);
+}
+
+void keyframes_interpolate(keyframes_t *keys, double time, double *thetas)
+{
+	keyframe_t *first = keys->keys;
+	keyframe_t *last = keys->keys + keys->size - 1;
+
+	keyframe_t *a = first, *b = first;
+	double t = 0.0;
+	if (time >= last->time)
+	{
+		a = b = last;
+	}
+	else if (time > first->time)
+	{
+		//Find the pair of keyframes surrounding the time by binary search
+		size_t lo = 0, hi = keys->size - 1;
+		while (hi - lo > 1)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (keys->keys[mid].time <= time)
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		a = keys->keys + lo;
+		b = keys->keys + hi;
+		t = (time - a->time) / (b->time - a->time);
+	}
+
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		thetas[i] = a->thetas[i] + t * (b->thetas[i] - a->thetas[i]);
+	}
+}
+
+typedef struct
+{
+	writer_t *writer;
+	uint8_t ready;
+} frame_slot_t;
+
+typedef struct
+{
+	double *lengths;
+	keyframes_t *keys;
+	size_t num_frames;
+	char *prefix;
+	int precision;
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	size_t next_frame;
+	size_t next_write;
+	size_t window;
+	frame_slot_t *slots;
+	status_t error;
+} animation_t;
+
+static double frame_time(animation_t *animation, size_t frame)
+{
+	keyframes_t *keys = animation->keys;
+	double start = keys->keys[0].time;
+	double end = keys->keys[keys->size - 1].time;
+	double denom = animation->num_frames > 1 ? (double) (animation->num_frames - 1) : 1.0;
+	return start + (end - start) * (frame / denom);
+}
+
+//Renders the whole frame, header included, into a new in-memory writer for the slot
+static status_t render_frame(animation_t *animation, robot_t *robot, draw_list_t *list, size_t frame, frame_slot_t *slot)
+{
+	status_t error = SUCCESS;
+
+	double thetas[ROBOT_JOINTS];
+	keyframes_interpolate(animation->keys, frame_time(animation, frame), thetas);
+
+	robot_set_angles(robot, thetas);
+	draw_list_clear(list);
+	IF_ERROR_GOTO(robot_draw(robot, list), error, exit0);
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(WRITER_NO_FD, animation->precision), error, exit0);
+	if (animation->prefix != NULL)
+	{
+		writer_string(writer, "#Inventor V2.0 ascii\n");
+	}
+	else
+	{
+		writer_string(writer, "# frame ");
+		writer_size(writer, frame);
+		writer_string(writer, "\n");
+	}
+
+	if ((error = draw_list_emit(list, writer)))
+	{
+		writer_uninitialize(writer);
+		goto exit0;
+	}
+
+	slot->writer = writer;
+
+exit0:
+	return error;
+}
+
+static void *animation_worker(void *arg)
+{
+	animation_t *animation = arg;
+	status_t error = SUCCESS;
+
+	//Each worker poses its own copy of the robot, so frames never share any mutable state
+	double zeros[ROBOT_JOINTS] = { 0 };
+	robot_t robot;
+	IF_ERROR_GOTO(robot_initialize(&robot, animation->lengths, zeros), error, exit0);
+
+	draw_list_t *list;
+	INITIALIZE_OR_OUT_OF_MEM(list, draw_list_initialize(ROBOT_NODES), error, exit1);
+
+	while (1)
+	{
+		pthread_mutex_lock(&animation->lock);
+		while (!animation->error && animation->next_frame < animation->num_frames &&
+			animation->next_frame >= animation->next_write + animation->window)
+		{
+			pthread_cond_wait(&animation->changed, &animation->lock);
+		}
+
+		if (animation->error || animation->next_frame >= animation->num_frames)
+		{
+			pthread_mutex_unlock(&animation->lock);
+			break;
+		}
+
+		size_t frame = animation->next_frame++;
+		pthread_mutex_unlock(&animation->lock);
+
+		frame_slot_t rendered = { 0 };
+		error = render_frame(animation, &robot, list, frame, &rendered);
+
+		pthread_mutex_lock(&animation->lock);
+		if (error)
+		{
+			animation->error = error;
+		}
+		else
+		{
+			rendered.ready = 1;
+			animation->slots[frame % animation->window] = rendered;
+		}
+		pthread_cond_broadcast(&animation->changed);
+		pthread_mutex_unlock(&animation->lock);
+
+		if (error)
+		{
+			break;
+		}
+	}
+
+	draw_list_uninitialize(list);
+exit1:
+	robot_uninitialize(&robot);
+exit0:
+	if (error)
+	{
+		pthread_mutex_lock(&animation->lock);
+		animation->error = error;
+		pthread_cond_broadcast(&animation->changed);
+		pthread_mutex_unlock(&animation->lock);
+	}
+	return NULL;
+}
+
+static status_t write_frame(char *prefix, size_t frame, writer_t *rendered, writer_t *out)
+{
+	status_t error = SUCCESS;
+
+	if (prefix == NULL)
+	{
+		writer_bytes(out, rendered->buffer, rendered->size);
+		error = writer_error(out);
+		goto exit0;
+	}
+
+	size_t size = strlen(prefix) + 32;
+	char *filename;
+	INITIALIZE_OR_OUT_OF_MEM(filename, malloc(size), error, exit0);
+	snprintf(filename, size, "%s%04zu.iv", prefix, frame);
+
+	int fd;
+	if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", filename);
+		error = FILE_OPEN_ERROR;
+		goto exit1;
+	}
+
+	writer_t *file;
+	INITIALIZE_OR_OUT_OF_MEM(file, writer_initialize(fd, 0), error, exit2);
+	writer_bytes(file, rendered->buffer, rendered->size);
+	error = writer_flush(file);
+	writer_uninitialize(file);
+
+exit2:
+	if (close(fd) && !error)
+	{
+		error = FILE_WRITE_ERROR;
+	}
+exit1:
+	free(filename);
+exit0:
+	return error;
+}
+
+status_t animation_render(double *lengths, keyframes_t *keys, size_t num_frames, size_t num_threads, char *prefix, int precision)
+{
+	status_t error = SUCCESS;
+
+	if (num_threads == 0)
+	{
+		num_threads = 1;
+	}
+
+	animation_t animation =
+	{
+		.lengths = lengths,
+		.keys = keys,
+		.num_frames = num_frames,
+		.prefix = prefix,
+		.precision = precision,
+		.next_frame = 0,
+		.next_write = 0,
+		.window = FRAMES_IN_FLIGHT * num_threads,
+		.error = SUCCESS,
+	};
+
+	INITIALIZE_OR_OUT_OF_MEM(animation.slots, calloc(animation.window, sizeof *animation.slots), error, exit0);
+
+	pthread_t *threads;
+	INITIALIZE_OR_OUT_OF_MEM(threads, malloc(num_threads * sizeof *threads), error, exit1);
+
+	writer_t *out;
+	INITIALIZE_OR_OUT_OF_MEM(out, writer_initialize(STDOUT_FILENO, precision), error, exit2);
+
+	pthread_mutex_init(&animation.lock, NULL);
+	pthread_cond_init(&animation.changed, NULL);
+
+	size_t started;
+	for (started = 0; started < num_threads; started++)
+	{
+		if (pthread_create(threads + started, NULL, animation_worker, &animation))
+		{
+			break;
+		}
+	}
+
+	if (started == 0)
+	{
+		error = OUT_OF_MEM;
+		goto exit3;
+	}
+
+	//The calling thread writes the frames out in order as soon as each one is ready
+	size_t frame;
+	for (frame = 0; frame < num_frames; frame++)
+	{
+		frame_slot_t *slot = animation.slots + frame % animation.window;
+
+		pthread_mutex_lock(&animation.lock);
+		while (!animation.error && !slot->ready)
+		{
+			pthread_cond_wait(&animation.changed, &animation.lock);
+		}
+		error = animation.error;
+		frame_slot_t ready = *slot;
+		slot->ready = 0;
+		slot->writer = NULL;
+		pthread_mutex_unlock(&animation.lock);
+
+		if (error)
+		{
+			break;
+		}
+
+		error = write_frame(prefix, frame, ready.writer, out);
+		writer_uninitialize(ready.writer);
+
+		pthread_mutex_lock(&animation.lock);
+		if (error)
+		{
+			animation.error = error;
+		}
+		animation.next_write++;
+		pthread_cond_broadcast(&animation.changed);
+		pthread_mutex_unlock(&animation.lock);
+
+		if (error)
+		{
+			break;
+		}
+	}
+
+	size_t i;
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	if (!error)
+	{
+		error = writer_flush(out);
+	}
+
+	for (i = 0; i < animation.window; i++)
+	{
+		if (animation.slots[i].writer != NULL)
+		{
+			writer_uninitialize(animation.slots[i].writer);
+		}
+	}
+
+exit3:
+	pthread_cond_destroy(&animation.changed);
+	pthread_mutex_destroy(&animation.lock);
+	writer_uninitialize(out);
+exit2:
+	free(threads);
+exit1:
+	free(animation.slots);
+exit0:
+	return error;
+}
@@ -5,7 +5,8 @@
 #include "bezier.h"
 
 #include "awh44_math.h"
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
+#include "writer.h"
 #include "polyline.h"
 #include "status.h"
 
@@ -19,7 +20,7 @@ bezier_t *bezier_initialize(void)
 		return NULL;
 	}
 
-	bezier->ctrl = point3d_vec_initialize();
+	bezier->ctrl = point3d_buffer_initialize();
 	if (bezier->ctrl == NULL)
 	{
 		free(bezier);
@@ -31,14 +32,7 @@ bezier_t *bezier_initialize(void)
 
 void bezier_uninitialize(bezier_t *bezier)
 {
-	size_t num_ctrl = point3d_vec_size(bezier->ctrl);
-	size_t i;
-	for (i = 0; i < num_ctrl; i++)
-	{
-		point3d_uninitialize(point3d_vec_get(bezier->ctrl, i));
-	}
-
-	point3d_vec_uninitialize(bezier->ctrl);
+	point3d_buffer_uninitialize(bezier->ctrl);
 	free(bezier);
 }
 
@@ -48,7 +42,7 @@ status_t bezier_calculate_polyline(bezier_t *bezier, polyline_t *poly, double in
 	double u;
 
 	//The first point is just the first control point
-	if ((error = polyline_copy_and_append_point(poly, point3d_vec_get(bezier->ctrl, 0))))
+	if ((error = polyline_copy_and_append_point(poly, point3d_buffer_get(bezier->ctrl, 0))))
 	{
 		goto exit0;
 	}
@@ -64,8 +58,8 @@ status_t bezier_calculate_polyline(bezier_t *bezier, polyline_t *poly, double in
 	}
 
 	//Make sure to handle u == 1.0 - just the last control point
-	size_t last = point3d_vec_size(bezier->ctrl) - 1;
-	if ((error = polyline_copy_and_append_point(poly, point3d_vec_get(bezier->ctrl, last))))
+	size_t last = point3d_buffer_size(bezier->ctrl) - 1;
+	if ((error = polyline_copy_and_append_point(poly, point3d_buffer_get(bezier->ctrl, last))))
 	{
 		goto exit0;
 	}
@@ -86,12 +80,12 @@ static status_t calculate_polyline_at_u(bezier_t *bezier, double u, point3d_t **
 		goto exit0;
 	}
 
-	size_t k = point3d_vec_size(bezier->ctrl) - 1;
+	size_t k = point3d_buffer_size(bezier->ctrl) - 1;
 	size_t i;
 	for (i = 0; i <= k; i++)
 	{
 		double scalar = bernstein_polynomial(k, i, u);
-		point3d_t *ctrl_point = point3d_vec_get(bezier->ctrl, i);
+		point3d_t *ctrl_point = point3d_buffer_get(bezier->ctrl, i);
 		point3d_fmad(*draw, ctrl_point, scalar);
 	}
 
@@ -102,56 +96,30 @@ exit0:
 status_t bezier_from_hermite(bezier_t *bezier, point3d_t *p0, point3d_t *p3, point3d_t *t0, point3d_t *t1)
 {
 	status_t error = SUCCESS;
-	point3d_t *p0_copy = point3d_copy(p0);
-	point3d_t *p3_copy = point3d_copy(p3);
-	if (p0_copy == NULL || p3_copy == NULL)
-	{
-		goto error0;
-	}
 
 	// p1 = p0 + 1/3 * t0
-	point3d_t *p1 = point3d_copy(t0);
-	if (p1 == NULL)
-	{
-		goto error1;
-	}
-	point3d_scale(p1, 1.0 / 3.0);
-	point3d_add(p1, p0);
+	point3d_t p1 = *t0;
+	point3d_scale(&p1, 1.0 / 3.0);
+	point3d_add(&p1, p0);
 
 	// p2 = p3 - 1/3 * t1
-	point3d_t *p2 = point3d_copy(t1);
-	if (p2 == NULL)
-	{
-		goto error2;
-	}
-	point3d_scale(p2, -1.0 / 3.0);
-	point3d_add(p2, p3);
-
-	point3d_vec_push_back(bezier->ctrl, p0_copy);
-	point3d_vec_push_back(bezier->ctrl, p1);
-	point3d_vec_push_back(bezier->ctrl, p2);
-	point3d_vec_push_back(bezier->ctrl, p3_copy);
-	goto exit0;
-
-error2:
-	free(p2);
-error1:
-	free(p1);
-error0:
-	free(p3_copy);
-	free(p0_copy);
-	error = OUT_OF_MEM;
+	point3d_t p2 = *t1;
+	point3d_scale(&p2, -1.0 / 3.0);
+	point3d_add(&p2, p3);
+
+	point3d_buffer_t *ctrl = bezier->ctrl;
+	IF_ERROR_GOTO(point3d_buffer_reserve(ctrl, point3d_buffer_size(ctrl) + 4), error, exit0);
+	point3d_buffer_push_back(ctrl, p0->x, p0->y, p0->z);
+	point3d_buffer_push_back(ctrl, p1.x, p1.y, p1.z);
+	point3d_buffer_push_back(ctrl, p2.x, p2.y, p2.z);
+	point3d_buffer_push_back(ctrl, p3->x, p3->y, p3->z);
 
 exit0:
 	return error;
 }
 
-void bezier_print_to_iv(bezier_t *bezier, double radius, FILE *stream)
+void bezier_print_to_iv(bezier_t *bezier, double radius, point3d_style_t style, writer_t *writer)
 {
-	size_t num = point3d_vec_size(bezier->ctrl);
-	size_t i;
-	for (i = 0; i < num; i++)
-	{
-		point3d_print_to_iv(point3d_vec_get(bezier->ctrl, i), stream, radius);
-	}
+	point3d_buffer_t *ctrl = bezier->ctrl;
+	point3d_print_array_to_iv(ctrl->points, point3d_buffer_size(ctrl), radius, style, writer);
 }
@@ -5,7 +5,9 @@
 
 #include "awh44_math.h"
 #include "point3d.h"
+#include "point3d_buffer.h"
 #include "point3d_vec.h"
+#include "writer.h"
 
 bezier_surface_t *bezier_surface_initialize(void)
 {
@@ -15,7 +17,7 @@ bezier_surface_t *bezier_surface_initialize(void)
 		goto error0;
 	}
 
-	if ((surface->ctrls = point3d_vec_initialize()) == NULL)
+	if ((surface->ctrls = point3d_buffer_initialize()) == NULL)
 	{
 		goto error1;
 	}
@@ -33,15 +35,30 @@ success:
 
 void bezier_surface_uninitialize(bezier_surface_t *surface)
 {
-	size_t num_ctrl = point3d_vec_size(surface->ctrls);
-	size_t i;
-	for (i = 0; i < num_ctrl; i++)
+	point3d_buffer_uninitialize(surface->ctrls);
+	free(surface);
+}
+
+static void evaluate_point(bezier_surface_t *surface, double u, double v, point3d_t *point)
+{
+	point3d_buffer_t *ctrls = surface->ctrls;
+	*point = (point3d_t) { 0.0, 0.0, 0.0 };
+
+	size_t j;
+	for (j = 0; j < 4; j++)
 	{
-		point3d_uninitialize(point3d_vec_get(surface->ctrls, i));
-	}
+		double bernstein_m_j = bernstein_polynomial(3, j, v);
 
-	point3d_vec_uninitialize(surface->ctrls);
-	free(surface);
+		size_t i;
+		for (i = 0; i < 4; i++)
+		{
+			double bernstein_n_i = bernstein_polynomial(3, i, u);
+			double scalar = bernstein_n_i * bernstein_m_j;
+
+			point3d_t *ctrl = point3d_buffer_get(ctrls, i + 4 * j);
+			point3d_fmad(point, ctrl, scalar);
+		}
+	}
 }
 
 status_t bezier_surface_calculate_mesh_points(bezier_surface_t *surface, mesh_t *mesh, size_t num_u, size_t num_v)
@@ -51,7 +68,6 @@ status_t bezier_surface_calculate_mesh_points(bezier_surface_t *surface, mesh_t
 	double du = 1 / (((double) num_u) - 1);
 	double dv = 1 / (((double) num_v) - 1);
 
-	point3d_vec_t *ctrls = surface->ctrls;
 	point3d_vec_t *points = mesh->points;
 
 	double u;
@@ -67,22 +83,7 @@ status_t bezier_surface_calculate_mesh_points(bezier_surface_t *surface, mesh_t
 				goto exit0;
 			}
 
-			size_t j;
-			for (j = 0; j < 4; j++)
-			{
-				double bernstein_m_j = bernstein_polynomial(3, j, v);
-
-				size_t i;
-				for (i = 0; i < 4; i++)
-				{
-					double bernstein_n_i = bernstein_polynomial(3, i, u);
-					double scalar = bernstein_n_i * bernstein_m_j;
-
-					point3d_t *ctrl = point3d_vec_get(ctrls, i + 4 * j);
-					point3d_fmad(new_point, ctrl, scalar);
-				}
-			}
-
+			evaluate_point(surface, u, v, new_point);
 			point3d_vec_push_back(points, new_point);
 		}
 	}
@@ -94,7 +95,7 @@ exit0:
 	return error;
 }
 
-static status_t calculate_partial(bezier_surface_t *bezier, double u, double v, uint8_t is_u_partial, point3d_t *result)
+static void calculate_partial(bezier_surface_t *bezier, double u, double v, uint8_t is_u_partial, point3d_t *result)
 {
 	/*
 		a = -3 * (1 - u)^2
@@ -115,7 +116,6 @@ static status_t calculate_partial(bezier_surface_t *bezier, double u, double v,
 			d * (B(3, 0, u) * p[3] + B(3, 1, u) * p[7] + B(3, 2, u) * p[11] + B(3, 3, u) * p[15])
 	*/
 
-	status_t error = SUCCESS;
 	double bernsteins[4] =
 	{
 		bernstein_polynomial(3, 0, v),
@@ -149,29 +149,31 @@ static status_t calculate_partial(bezier_surface_t *bezier, double u, double v,
 		inner_index = &j;
 	}
 
-	point3d_vec_t *ctrls = bezier->ctrls;
+	point3d_buffer_t *ctrls = bezier->ctrls;
 	for (*outer_index = 0; *outer_index < 4; (*outer_index)++)
 	{
-		point3d_t *temp = point3d_initialize();
-		if (temp == NULL)
-		{
-			error = OUT_OF_MEM;
-			goto exit0;
-		}
-
+		point3d_t temp = { 0.0, 0.0, 0.0 };
 		for (*inner_index = 0; *inner_index < 4; (*inner_index)++)
 		{
-			point3d_t *point = point3d_vec_get(ctrls, i + j * 4);
-			point3d_fmad(temp, point, bernsteins[*inner_index]);
+			point3d_t *point = point3d_buffer_get(ctrls, i + j * 4);
+			point3d_fmad(&temp, point, bernsteins[*inner_index]);
 		}
 
-		point3d_scale(temp, scalars_for_partial[*outer_index]);
-		point3d_add(result, temp);
-		point3d_uninitialize(temp);
+		point3d_scale(&temp, scalars_for_partial[*outer_index]);
+		point3d_add(result, &temp);
 	}
+}
 
-exit0:
-	return error;
+static void evaluate_normal(bezier_surface_t *bezier, double u, double v, point3d_t *normal)
+{
+	point3d_t partial_u = { 0.0, 0.0, 0.0 };
+	point3d_t partial_v = { 0.0, 0.0, 0.0 };
+	calculate_partial(bezier, u, v, 1, &partial_u);
+	calculate_partial(bezier, v, u, 0, &partial_v);
+
+	normal->x = partial_u.y * partial_v.z - partial_v.y * partial_u.z;
+	normal->y = partial_u.z * partial_v.x - partial_v.z * partial_u.x;
+	normal->z = partial_u.x * partial_v.y - partial_v.x * partial_u.y;
 }
 
 status_t bezier_surface_calculate_mesh_normals(bezier_surface_t *bezier, mesh_t *mesh)
@@ -187,47 +189,15 @@ status_t bezier_surface_calculate_mesh_normals(bezier_surface_t *bezier, mesh_t
 		double v;
 		for (v = 0; v <= 1.0; v += dv)
 		{
-			point3d_t *partial_u;
-			point3d_t *partial_v;
-			if ((partial_u = point3d_initialize()) == NULL)
-			{
-				error = OUT_OF_MEM;
-				goto loop_exit0;
-			}
-
-			if ((partial_v = point3d_initialize()) == NULL)
-			{
-				error = OUT_OF_MEM;
-				goto loop_exit1;
-			}
-
-			if ((error = calculate_partial(bezier, u, v, 1, partial_u)) ||
-			    (error = calculate_partial(bezier, v, u, 0, partial_v)))
-			{
-				goto loop_exit2;
-			}
-
 			point3d_t *normal;
 			if ((normal = point3d_initialize()) == NULL)
 			{
-				goto loop_exit2;
+				error = OUT_OF_MEM;
+				goto exit0;
 			}
 
-			normal->x = partial_u->y * partial_v->z - partial_v->y * partial_u->z;
-			normal->y = partial_u->z * partial_v->x - partial_v->z * partial_u->x;
-			normal->z = partial_u->x * partial_v->y - partial_v->x * partial_u->y;
-
+			evaluate_normal(bezier, u, v, normal);
 			point3d_vec_push_back(mesh->normals, normal);
-
-loop_exit2:
-			point3d_uninitialize(partial_v);
-loop_exit1:
-			point3d_uninitialize(partial_u);
-loop_exit0:
-			if (error)
-			{
-				goto exit0;
-			}
 		}
 	}
 
@@ -235,12 +205,53 @@ exit0:
 	return error;
 }
 
-void bezier_surface_print_to_iv(bezier_surface_t *surface, double radius, FILE *stream)
+static void source_rewind(mesh_source_t *source)
 {
-	size_t num = point3d_vec_size(surface->ctrls);
-	size_t i;
-	for (i = 0; i < num; i++)
+	source->row = 0;
+	source->param = 0.0;
+}
+
+static status_t source_next_row(mesh_source_t *source, point3d_t *points, point3d_t *normals)
+{
+	bezier_surface_t *surface = source->surface;
+	double u = source->param;
+	double dv = 1 / (((double) source->num_v) - 1);
+
+	//u and v accumulate exactly as in bezier_surface_calculate_mesh_points so the streamed rows
+	//match the materialized mesh bit for bit, but every row has exactly num_v points.
+	size_t j;
+	double v;
+	for (j = 0, v = 0.0; j < source->num_v; j++, v += dv)
 	{
-		point3d_print_to_iv(point3d_vec_get(surface->ctrls, i), stream, radius);
+		if (points != NULL)
+		{
+			evaluate_point(surface, u, v, points + j);
+		}
+		if (normals != NULL)
+		{
+			evaluate_normal(surface, u, v, normals + j);
+		}
 	}
+
+	source->row++;
+	source->param += 1 / (((double) source->num_u) - 1);
+	return SUCCESS;
+}
+
+void bezier_surface_source_initialize(mesh_source_t *source, bezier_surface_t *surface, size_t num_u, size_t num_v, uint8_t has_normals)
+{
+	source->topology = MESH_TOPOLOGY_GRID;
+	source->num_u = num_u;
+	source->num_v = num_v;
+	source->has_normals = has_normals;
+	source->surface = surface;
+	source->rewind = source_rewind;
+	source->next_row = source_next_row;
+	source_rewind(source);
+}
+
+void bezier_surface_print_to_iv(bezier_surface_t *surface, double radius, point3d_style_t style, writer_t *writer)
+{
+	point3d_buffer_t *ctrl = surface->ctrls;
+	point3d_print_array_to_iv(ctrl->points, point3d_buffer_size(ctrl), radius, style, writer);
 }
@@ -4,7 +4,8 @@
 #include "catmullrom.h"
 #include "bezier.h"
 #include "point3d.h"
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
+#include "writer.h"
 
 catmullrom_t *catmullrom_initialize(void)
 {
@@ -14,7 +15,7 @@ catmullrom_t *catmullrom_initialize(void)
 		goto error0;
 	}
 
-	if ((catmullrom->ctrl = point3d_vec_initialize()) == NULL)
+	if ((catmullrom->ctrl = point3d_buffer_initialize()) == NULL)
 	{
 		goto error1;
 	}
@@ -34,7 +35,7 @@ catmullrom_t *catmullrom_initialize(void)
 error3:
 	point3d_uninitialize(catmullrom->t0);
 error2:
-	point3d_vec_uninitialize(catmullrom->ctrl);
+	point3d_buffer_uninitialize(catmullrom->ctrl);
 error1:
 	free(catmullrom);
 	catmullrom = NULL;
@@ -47,13 +48,7 @@ exit0:
 
 void catmullrom_uninitialize(catmullrom_t *catmullrom)
 {
-	size_t num_ctrl = point3d_vec_size(catmullrom->ctrl);
-	size_t i;
-	for (i = 0; i < num_ctrl; i++)
-	{
-		point3d_uninitialize(point3d_vec_get(catmullrom->ctrl, i));
-	}
-	point3d_vec_uninitialize(catmullrom->ctrl);
+	point3d_buffer_uninitialize(catmullrom->ctrl);
 	point3d_uninitialize(catmullrom->t0);
 	point3d_uninitialize(catmullrom->tN);
 	free(catmullrom);
@@ -62,8 +57,8 @@ void catmullrom_uninitialize(catmullrom_t *catmullrom)
 status_t catmullrom_calculate_polyline(catmullrom_t *catmullrom, polyline_t *poly, double inc)
 {
 	status_t error = SUCCESS;
-	point3d_vec_t *ctrl = catmullrom->ctrl;
-	size_t num_ctrl = point3d_vec_size(ctrl);
+	point3d_buffer_t *ctrl = catmullrom->ctrl;
+	size_t num_ctrl = point3d_buffer_size(ctrl);
 
 	point3d_t *t0 = point3d_copy(catmullrom->t0);
 	if (t0 == NULL)
@@ -75,9 +70,9 @@ status_t catmullrom_calculate_polyline(catmullrom_t *catmullrom, polyline_t *pol
 	size_t k;
 	for (k = 0; k < num_ctrl - 2; k++)
 	{
-		point3d_t *pk = point3d_vec_get(ctrl, k);
-		point3d_t *pk_plus1 = point3d_vec_get(ctrl, k + 1);
-		point3d_t *pk_plus2 = point3d_vec_get(ctrl, k + 2);
+		point3d_t *pk = point3d_buffer_get(ctrl, k);
+		point3d_t *pk_plus1 = point3d_buffer_get(ctrl, k + 1);
+		point3d_t *pk_plus2 = point3d_buffer_get(ctrl, k + 2);
 
 		//t1 = 0.5 * (pk+2 - pk)
 		point3d_t *t1;
@@ -132,8 +127,8 @@ loop_error0:
 	}
 
 	error = bezier_from_hermite(bezier,
-		point3d_vec_get(ctrl, num_ctrl - 2),
-		point3d_vec_get(ctrl, num_ctrl - 1),
+		point3d_buffer_get(ctrl, num_ctrl - 2),
+		point3d_buffer_get(ctrl, num_ctrl - 1),
 		t0,
 		catmullrom->tN);
 	if (error)
@@ -153,12 +148,8 @@ exit0:
 	return error;
 }
 
-void catmullrom_print_to_iv(catmullrom_t *catmullrom, double radius, FILE *stream)
+void catmullrom_print_to_iv(catmullrom_t *catmullrom, double radius, point3d_style_t style, writer_t *writer)
 {
-	size_t num = point3d_vec_size(catmullrom->ctrl);
-	size_t i;
-	for (i = 0; i < num; i++)
-	{
-		point3d_print_to_iv(point3d_vec_get(catmullrom->ctrl, i), stream, radius);
-	}
+	point3d_buffer_t *ctrl = catmullrom->ctrl;
+	point3d_print_array_to_iv(ctrl->points, point3d_buffer_size(ctrl), radius, style, writer);
 }
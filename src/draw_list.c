@@ -0,0 +1,101 @@
+#include <stdlib.h>
+
+#include "draw_list.h"
+
+#include "affine.h"
+#include "hierarchical.h"
+#include "status.h"
+#include "writer.h"
+
+draw_list_t *draw_list_initialize(size_t capacity)
+{
+	draw_list_t *list;
+	if ((list = malloc(sizeof *list)) == NULL)
+	{
+		goto error0;
+	}
+
+	if (capacity == 0)
+	{
+		capacity = 1;
+	}
+
+	if ((list->records = malloc(capacity * sizeof *list->records)) == NULL)
+	{
+		goto error1;
+	}
+
+	list->size = 0;
+	list->capacity = capacity;
+
+	goto success;
+
+error1:
+	free(list);
+	list = NULL;
+error0:
+
+success:
+	return list;
+}
+
+void draw_list_uninitialize(draw_list_t *list)
+{
+	free(list->records);
+	free(list);
+}
+
+void draw_list_clear(draw_list_t *list)
+{
+	list->size = 0;
+}
+
+static status_t reserve_one(draw_list_t *list)
+{
+	status_t error = SUCCESS;
+
+	if (list->size < list->capacity)
+	{
+		goto exit0;
+	}
+
+	size_t capacity = 2 * list->capacity;
+	draw_record_t *records;
+	INITIALIZE_OR_OUT_OF_MEM(records, realloc(list->records, capacity * sizeof *records), error, exit0);
+	list->records = records;
+	list->capacity = capacity;
+
+exit0:
+	return error;
+}
+
+status_t draw_list_append(draw_list_t *list, model_t *model, affine_t *transform)
+{
+	status_t error = SUCCESS;
+
+	IF_ERROR_GOTO(reserve_one(list), error, exit0);
+
+	draw_record_t *record = list->records + list->size++;
+	record->model = model;
+	record->transform = *transform;
+
+exit0:
+	return error;
+}
+
+status_t draw_list_emit(draw_list_t *list, writer_t *writer)
+{
+	status_t error = SUCCESS;
+
+	size_t i;
+	for (i = 0; i < list->size; i++)
+	{
+		draw_record_t *record = list->records + i;
+		IF_ERROR_GOTO(record->model->emit(record->model, &record->transform, writer), error, exit0);
+	}
+
+	error = writer_error(writer);
+
+exit0:
+	return error;
+}
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "awh44_math.h"
+#include "robot.h"
+#include "robot_fk.h"
+#include "status.h"
+
+typedef struct
+{
+	double lengths[ROBOT_JOINTS];
+	robot_fk_samples_t samples;
+	long num_threads;
+	uint8_t with_bounds;
+	char *filename;
+} args_t;
+
+status_t parse_args(int argc, char **argv, args_t *args);
+status_t parse_range(char *arg, double *lo, double *hi);
+void usage(char *prog);
+
+int main(int argc, char **argv)
+{
+	status_t error = SUCCESS;
+
+	args_t args;
+	if ((error = parse_args(argc, argv, &args)))
+	{
+		usage(argv[0]);
+		goto exit0;
+	}
+
+	FILE *file = stdout;
+	if (args.filename != NULL && (file = fopen(args.filename, "wb")) == NULL)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args.filename);
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	if ((error = robot_fk_run(args.lengths, &args.samples, args.num_threads, args.with_bounds, file)))
+	{
+		fprintf(stderr, "ERROR: could not write the point cloud\n");
+	}
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+exit0:
+	return error;
+}
+
+status_t parse_args(int argc, char **argv, args_t *args)
+{
+	args->lengths[0] = 4.0;
+	args->lengths[1] = 3.0;
+	args->lengths[2] = 2.5;
+	args->samples.sampling = FK_GRID;
+	args->samples.steps = 64;
+	args->samples.count = 0;
+	args->samples.seed = 536;
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		args->samples.lo[i] = -180.0;
+		args->samples.hi[i] = 180.0;
+	}
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	args->num_threads = procs > 0 ? procs : 1;
+	args->with_bounds = 0;
+	args->filename = NULL;
+
+	uint8_t seen_g = 0;
+	uint8_t seen_s = 0;
+
+#define CHECK_OR_RETURN(cond) do { if (cond) { return ARGS_ERROR; } } while (0)
+
+	char opt;
+	while ((opt = getopt(argc, argv, "l:m:n:g:s:S:t:u:v:j:bo:")) > 0)
+	{
+		switch (opt)
+		{
+			case 'l':
+			case 'm':
+			case 'n':
+			{
+				char *end;
+				args->lengths[opt - 'l'] = strtod(optarg, &end);
+				CHECK_OR_RETURN(*end != '\0');
+				break;
+			}
+
+			case 'g':
+			{
+				char *end;
+				long steps = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(seen_s || steps < 1 || *end != '\0');
+				args->samples.sampling = FK_GRID;
+				args->samples.steps = steps;
+				seen_g = 1;
+				break;
+			}
+
+			case 's':
+			{
+				char *end;
+				long count = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(seen_g || count < 1 || *end != '\0');
+				args->samples.sampling = FK_RANDOM;
+				args->samples.count = count;
+				seen_s = 1;
+				break;
+			}
+
+			case 'S':
+			{
+				char *end;
+				args->samples.seed = strtoull(optarg, &end, 10);
+				CHECK_OR_RETURN(*end != '\0');
+				break;
+			}
+
+			case 't':
+			case 'u':
+			case 'v':
+			{
+				size_t joint = opt - 't';
+				CHECK_OR_RETURN(parse_range(optarg, args->samples.lo + joint, args->samples.hi + joint));
+				break;
+			}
+
+			case 'j':
+			{
+				char *end;
+				args->num_threads = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(args->num_threads < 1 || *end != '\0');
+				break;
+			}
+
+			case 'b':
+			{
+				args->with_bounds = 1;
+				break;
+			}
+
+			case 'o':
+			{
+				args->filename = optarg;
+				break;
+			}
+
+			case '?':
+			{
+				return ARGS_ERROR;
+			}
+		}
+	}
+
+#undef CHECK_OR_RETURN
+
+	//As in hw5, the angles are given in degrees but used in radians
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		args->samples.lo[i] = TO_RAD(args->samples.lo[i]);
+		args->samples.hi[i] = TO_RAD(args->samples.hi[i]);
+	}
+
+	return optind == argc ? SUCCESS : ARGS_ERROR;
+}
+
+status_t parse_range(char *arg, double *lo, double *hi)
+{
+	char *end;
+	*lo = strtod(arg, &end);
+	if (*end != ',')
+	{
+		return ARGS_ERROR;
+	}
+
+	*hi = strtod(end + 1, &end);
+	return *end == '\0' ? SUCCESS : ARGS_ERROR;
+}
+
+void usage(char *prog)
+{
+	fprintf(stderr,
+		"usage: %s\n"
+		"	[-g grid steps per joint | -s number of random samples] [-S random seed]\n"
+		"	[-t theta 1 range lo,hi] [-u theta 2 range lo,hi] [-v theta 3 range lo,hi]\n"
+		"	[-l length 1] [-m length 2] [-n length 3]\n"
+		"	[-j number of threads] [-b include per-link bounds] [-o output file]\n", prog);
+}
@@ -1,28 +1,501 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "graphics.h"
 
-status_t read_points(FILE *stream, point3d_vec_t *points)
+#include "point3d_buffer.h"
+#include "status.h"
+#include "writer.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Binary points are read and written in host order.");
+static_assert(sizeof(points_binary_header_t) == 24, "Binary points header must be packed.");
+
+//Longest number handed to strtod when the fast path cannot produce a correctly rounded result
+#define MAX_SLOW_NUMBER 128
+//Size of each read when the stream cannot be mapped (a pipe, for instance)
+#define READ_CHUNK (1 << 16)
+//Smallest run of text worth handing to a thread of its own
+#define PARSE_MIN_CHUNK (1 << 20)
+
+static const double powers_of_ten[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline uint8_t is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline uint8_t is_digit(char c)
+{
+	return (unsigned char) (c - '0') < 10;
+}
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+	while (p < end && is_blank(*p))
+	{
+		p++;
+	}
+
+	return p;
+}
+
+/*
+ * parse_slow - parses the number in [p, end) with strtod, for anything the fast path rejects
+ * @param p     - the start of the number
+ * @param end   - one past the last character of the number
+ * @param value - out param; the parsed number
+ * @return      - FILE_FORMAT_ERROR if the characters are not exactly one number; SUCCESS otherwise
+ */
+static status_t parse_slow(const char *p, const char *end, double *value)
+{
+	char number[MAX_SLOW_NUMBER];
+	size_t length = end - p;
+	if (length == 0 || length >= sizeof number)
+	{
+		return FILE_FORMAT_ERROR;
+	}
+
+	memcpy(number, p, length);
+	number[length] = '\0';
+
+	char *number_end;
+	*value = strtod(number, &number_end);
+	return number_end == number + length ? SUCCESS : FILE_FORMAT_ERROR;
+}
+
+/*
+ * parse_number - parses one decimal number starting at p. Numbers whose significand fits in 53
+ * bits with a power of ten of magnitude at most 22 are exactly representable operands, so a single
+ * multiply or divide rounds them correctly (Clinger's fast path); everything else goes to strtod.
+ * @param p     - the start of the number
+ * @param end   - the end of the input
+ * @param value - out param; the parsed number
+ * @return      - one past the last character of the number, or NULL if it was malformed
+ */
+static const char *parse_number(const char *p, const char *end, double *value)
+{
+	const char *start = p;
+	const char *token_end = p;
+	while (token_end < end && !is_blank(*token_end) && *token_end != '\r' && *token_end != '\n')
+	{
+		token_end++;
+	}
+
+	uint8_t negative = 0;
+	if (p < token_end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t significand = 0;
+	int digits = 0;
+	int exponent = 0;
+	uint8_t seen_digit = 0;
+	for (; p < token_end && is_digit(*p); p++)
+	{
+		seen_digit = 1;
+		if (significand != 0 || *p != '0')
+		{
+			significand = significand * 10 + (*p - '0');
+			digits++;
+		}
+		if (digits > 19)
+		{
+			goto slow;
+		}
+	}
+
+	if (p < token_end && *p == '.')
+	{
+		for (p++; p < token_end && is_digit(*p); p++)
+		{
+			seen_digit = 1;
+			if (significand != 0 || *p != '0')
+			{
+				significand = significand * 10 + (*p - '0');
+				digits++;
+			}
+			exponent--;
+			if (digits > 19)
+			{
+				goto slow;
+			}
+		}
+	}
+
+	if (!seen_digit)
+	{
+		goto slow;
+	}
+
+	if (p < token_end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		uint8_t negative_exponent = 0;
+		if (p < token_end && (*p == '-' || *p == '+'))
+		{
+			negative_exponent = *p == '-';
+			p++;
+		}
+
+		if (p == token_end)
+		{
+			return NULL;
+		}
+
+		int explicit = 0;
+		for (; p < token_end && is_digit(*p); p++)
+		{
+			if (explicit > 10000)
+			{
+				goto slow;
+			}
+			explicit = explicit * 10 + (*p - '0');
+		}
+		exponent += negative_exponent ? -explicit : explicit;
+	}
+
+	if (p != token_end)
+	{
+		goto slow;
+	}
+
+	if (significand > (UINT64_C(1) << 53) || exponent < -22 || exponent > 22)
+	{
+		goto slow;
+	}
+
+	double result = significand;
+	result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+	*value = negative ? -result : result;
+	return token_end;
+
+slow:
+	return parse_slow(start, token_end, value) ? NULL : token_end;
+}
+
+/*
+ * parse_line - parses the three coordinates of the point on the line starting at p
+ * @param p      - the start of the line, which must not be blank
+ * @param end    - the end of the text
+ * @param coords - out param; the three coordinates
+ * @return       - the start of the next line, or NULL if the line was malformed
+ */
+static const char *parse_line(const char *p, const char *end, double *coords)
+{
+	p = skip_blanks(p, end);
+
+	size_t i;
+	for (i = 0; i < 3; i++)
+	{
+		if (i > 0)
+		{
+			const char *number = skip_blanks(p, end);
+			if (number == p)
+			{
+				return NULL;
+			}
+			p = number;
+		}
+
+		if ((p = parse_number(p, end, coords + i)) == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	p = skip_blanks(p, end);
+	if (p < end && *p == '\r')
+	{
+		p++;
+	}
+	if (p < end && *p != '\n')
+	{
+		return NULL;
+	}
+
+	return p + (p < end);
+}
+
+/*
+ * is_blank_line - determines whether the line starting at p holds only spaces, tabs, and its ending
+ * @param p    - the start of the line
+ * @param end  - the end of the text
+ * @param next - out param; the start of the next line, when the line is blank
+ * @return     - 1 if the line is blank; 0 otherwise
+ */
+static uint8_t is_blank_line(const char *p, const char *end, const char **next)
+{
+	p = skip_blanks(p, end);
+	if (p < end && *p == '\r')
+	{
+		p++;
+	}
+	if (p == end || *p == '\n')
+	{
+		*next = p + (p < end);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void print_format_error(const char *line, const char *end, size_t line_number)
+{
+	const char *newline = memchr(line, '\n', end - line);
+	int length = (newline == NULL ? end : newline) - line;
+	if (line_number > 0)
+	{
+		fprintf(stderr, "ERROR: incorrect formatting on line %zu: %.*s\n", line_number, length, line);
+	}
+	else
+	{
+		fprintf(stderr, "ERROR: incorrect formatting in line %.*s\n", length, line);
+	}
+}
+
+static size_t count_newlines(const char *p, const char *end)
+{
+	size_t newlines = 0;
+	const char *newline;
+	for (; (newline = memchr(p, '\n', end - p)) != NULL; p = newline + 1)
+	{
+		newlines++;
+	}
+
+	return newlines;
+}
+
+//A run of whole lines parsed on its own, possibly by its own thread
+typedef struct
+{
+	const char *begin;
+	const char *end;
+	point3d_buffer_t *points;
+	size_t newlines;
+	pthread_t thread;
+	uint8_t started;
+	status_t error;
+	//on a format error, the offending line and its index within the chunk
+	const char *error_line;
+	size_t error_index;
+} parse_chunk_t;
+
+/*
+ * parse_chunk - parses every line of the chunk as a point, skipping blank lines
+ * @param chunk - the chunk to parse; its points, newlines, and error fields are filled in
+ */
+static void parse_chunk(parse_chunk_t *chunk)
 {
 	status_t error = SUCCESS;
+	const char *p = chunk->begin;
+	const char *end = chunk->end;
+	point3d_buffer_t *points = chunk->points;
 
-	char *line = NULL;
-	size_t size = 0;
-	ssize_t chars_read;
+	//Every point ends with a newline, except perhaps the last, so this bounds the number of points
+	chunk->newlines = count_newlines(p, end);
+	IF_ERROR_GOTO
+	(
+		point3d_buffer_reserve(points, point3d_buffer_size(points) + chunk->newlines + 1),
+		error,
+		exit0
+	);
 
-	while ((chars_read = getline(&line, &size, stream)) > 0)
+	size_t index;
+	for (index = 0; p < end; index++)
 	{
-		point3d_t *point = point3d_initialize();
-		error = parse_point(line, point);
-		if (error)
+		if (is_blank_line(p, end, &p))
+		{
+			continue;
+		}
+
+		double coords[3];
+		const char *next;
+		if ((next = parse_line(p, end, coords)) == NULL)
 		{
-			point3d_uninitialize(point);
+			chunk->error_line = p;
+			chunk->error_index = index;
+			error = FILE_FORMAT_ERROR;
 			goto exit0;
 		}
-		point3d_vec_push_back(points, point);
+
+		IF_ERROR_GOTO(point3d_buffer_push_back(points, coords[0], coords[1], coords[2]), error, exit0);
+		p = next;
+	}
+
+exit0:
+	chunk->error = error;
+}
+
+static void *parse_chunk_worker(void *arg)
+{
+	parse_chunk(arg);
+	return NULL;
+}
+
+/*
+ * parse_points - parses every line of [p, end) as a point, splitting the text at line boundaries
+ * across up to num_threads threads and appending the points in order
+ * @param p           - the start of the text
+ * @param end         - the end of the text
+ * @param first_line  - the line number of the first line of the text, or 0 if unknown
+ * @param points      - the buffer onto which to append the points
+ * @param num_threads - the most threads with which to parse
+ * @return            - an indication of whether an error occurred
+ */
+static status_t parse_points(const char *p, const char *end, size_t first_line, point3d_buffer_t *points, size_t num_threads)
+{
+	status_t error = SUCCESS;
+
+	size_t length = end - p;
+	size_t num_chunks = length / PARSE_MIN_CHUNK;
+	if (num_chunks > num_threads)
+	{
+		num_chunks = num_threads;
+	}
+	if (num_chunks <= 1)
+	{
+		parse_chunk_t chunk = { .begin = p, .end = end, .points = points };
+		parse_chunk(&chunk);
+		if (chunk.error == FILE_FORMAT_ERROR)
+		{
+			print_format_error(chunk.error_line, end, first_line ? first_line + chunk.error_index : 0);
+		}
+		return chunk.error;
+	}
+
+	parse_chunk_t *chunks;
+	INITIALIZE_OR_OUT_OF_MEM(chunks, calloc(num_chunks, sizeof *chunks), error, exit0);
+
+	//Split into roughly equal chunks, each extended to end just after a newline
+	size_t i;
+	const char *begin = p;
+	for (i = 0; i < num_chunks; i++)
+	{
+		const char *split = i == num_chunks - 1 ? end : p + (i + 1) * (length / num_chunks);
+		if (split < begin)
+		{
+			split = begin;
+		}
+		const char *newline = split < end ? memchr(split, '\n', end - split) : NULL;
+		chunks[i].begin = begin;
+		chunks[i].end = newline == NULL ? end : newline + 1;
+		begin = chunks[i].end;
+
+		if ((chunks[i].points = point3d_buffer_initialize()) == NULL)
+		{
+			error = OUT_OF_MEM;
+			goto exit1;
+		}
 	}
 
-	if (!feof(stream))
+	//The calling thread takes the first chunk, and any chunk whose thread could not be started
+	for (i = 1; i < num_chunks; i++)
+	{
+		chunks[i].started = pthread_create(&chunks[i].thread, NULL, parse_chunk_worker, chunks + i) == 0;
+	}
+
+	parse_chunk(chunks);
+	for (i = 1; i < num_chunks; i++)
+	{
+		if (chunks[i].started)
+		{
+			pthread_join(chunks[i].thread, NULL);
+		}
+		else
+		{
+			parse_chunk(chunks + i);
+		}
+	}
+
+	size_t total = point3d_buffer_size(points);
+	size_t line = first_line;
+	for (i = 0; i < num_chunks; i++)
+	{
+		if ((error = chunks[i].error))
+		{
+			if (error == FILE_FORMAT_ERROR)
+			{
+				print_format_error(chunks[i].error_line, end, first_line ? line + chunks[i].error_index : 0);
+			}
+			goto exit1;
+		}
+
+		line += chunks[i].newlines;
+		total += point3d_buffer_size(chunks[i].points);
+	}
+
+	IF_ERROR_GOTO(point3d_buffer_reserve(points, total), error, exit1);
+	for (i = 0; i < num_chunks; i++)
+	{
+		point3d_buffer_t *chunk_points = chunks[i].points;
+		memcpy
+		(
+			points->points + points->size,
+			chunk_points->points,
+			chunk_points->size * sizeof *chunk_points->points
+		);
+		points->size += chunk_points->size;
+	}
+
+exit1:
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (chunks[i].points != NULL)
+		{
+			point3d_buffer_uninitialize(chunks[i].points);
+		}
+	}
+	free(chunks);
+exit0:
+	return error;
+}
+
+/*
+ * read_unmappable - reads the rest of a stream that cannot be mapped into memory
+ * @param stream - the stream from which to read
+ * @param text   - out param; the text read, to be freed by the caller
+ * @param size   - out param; the number of characters read
+ * @return       - an indication of whether an error occurred
+ */
+static status_t read_unmappable(FILE *stream, char **text, size_t *size)
+{
+	status_t error = SUCCESS;
+
+	size_t capacity = 0;
+	size_t chars_read;
+	*text = NULL;
+	*size = 0;
+	do
+	{
+		if (capacity - *size < READ_CHUNK)
+		{
+			char *grown;
+			capacity = capacity == 0 ? READ_CHUNK : 2 * capacity;
+			if ((grown = realloc(*text, capacity)) == NULL)
+			{
+				error = OUT_OF_MEM;
+				goto exit0;
+			}
+			*text = grown;
+		}
+
+		chars_read = fread(*text + *size, 1, capacity - *size, stream);
+		*size += chars_read;
+	} while (chars_read > 0);
+
+	if (ferror(stream))
 	{
 		fprintf(stderr, "ERROR: could not read from file\n");
 		error = FILE_READ_ERROR;
@@ -30,37 +503,224 @@ status_t read_points(FILE *stream, point3d_vec_t *points)
 	}
 
 exit0:
-	free(line);
 	return error;
 }
 
-status_t parse_point(char *line, point3d_t *point)
+/*
+ * check_binary - validates the header of binary points and that the data matches it in size
+ * @param data        - the start of the header
+ * @param size        - the number of bytes from the header to the end of the input
+ * @param count       - out param; the number of points
+ * @param scalar_size - out param; the size of each coordinate, 4 or 8
+ * @return            - FILE_FORMAT_ERROR if the header or size is wrong; SUCCESS otherwise
+ */
+static status_t check_binary(const char *data, size_t size, size_t *count, size_t *scalar_size)
+{
+	points_binary_header_t header;
+	if (size < sizeof header)
+	{
+		goto format_error;
+	}
+
+	memcpy(&header, data, sizeof header);
+	if (memcmp(header.magic, POINTS_BINARY_MAGIC, sizeof header.magic) != 0 ||
+		header.version != POINTS_BINARY_VERSION ||
+		(header.scalar_size != sizeof(float) && header.scalar_size != sizeof(double)))
+	{
+		goto format_error;
+	}
+
+	size_t available = (size - sizeof header) / (3 * header.scalar_size);
+	if (header.count != available || (size - sizeof header) % (3 * header.scalar_size) != 0)
+	{
+		goto format_error;
+	}
+
+	*count = header.count;
+	*scalar_size = header.scalar_size;
+	return SUCCESS;
+
+format_error:
+	fprintf(stderr, "ERROR: malformed binary points header or size\n");
+	return FILE_FORMAT_ERROR;
+}
+
+/*
+ * append_binary - copies binary coordinates onto the end of the buffer, widening floats to doubles
+ * @param data        - the first coordinate
+ * @param count       - the number of points
+ * @param scalar_size - the size of each coordinate, 4 or 8
+ * @param points      - the buffer onto which to append the points
+ * @return            - an indication of whether an error occurred
+ */
+static status_t append_binary(const char *data, size_t count, size_t scalar_size, point3d_buffer_t *points)
 {
 	status_t error = SUCCESS;
 
-	double coords[3];
-	size_t elems = sizeof(coords) / sizeof(*coords);
-	char *start = line;
-	char *end;
-	size_t i;
-	for (i = 0; i < elems; i++)
+	size_t start = point3d_buffer_size(points);
+	IF_ERROR_GOTO(point3d_buffer_reserve(points, start + count), error, exit0);
+
+	point3d_t *out = points->points + start;
+	if (scalar_size == sizeof(double))
+	{
+		memcpy(out, data, count * sizeof *out);
+	}
+	else
 	{
-		coords[i] = strtod(start, &end);
-		if (((i < elems - 1) && (*end != ' ')) ||
-			((i == elems - 1) && (*end != '\n')))
+		size_t i;
+		for (i = 0; i < count; i++)
 		{
-			fprintf(stderr, "ERROR: incorrect formatting in line %s", line);
-			error = FILE_FORMAT_ERROR;
+			float coords[3];
+			memcpy(coords, data + i * sizeof coords, sizeof coords);
+			out[i].x = coords[0];
+			out[i].y = coords[1];
+			out[i].z = coords[2];
+		}
+	}
+	points->size += count;
+
+exit0:
+	return error;
+}
+
+static uint8_t is_binary(const char *data, size_t size)
+{
+	return size >= sizeof POINTS_BINARY_MAGIC - 1 &&
+		memcmp(data, POINTS_BINARY_MAGIC, sizeof POINTS_BINARY_MAGIC - 1) == 0;
+}
+
+uint8_t points_stream_is_binary(FILE *stream)
+{
+	//No text point can start with the magic's first character, so one character of lookahead,
+	//which every stream supports, is enough
+	int c = getc(stream);
+	if (c == EOF)
+	{
+		return 0;
+	}
+
+	ungetc(c, stream);
+	return c == POINTS_BINARY_MAGIC[0];
+}
+
+status_t write_points_binary(point3d_buffer_t *points, size_t scalar_size, writer_t *writer)
+{
+	size_t count = point3d_buffer_size(points);
+	points_binary_header_t header = { .version = POINTS_BINARY_VERSION, .scalar_size = scalar_size, .count = count };
+	memcpy(header.magic, POINTS_BINARY_MAGIC, sizeof header.magic);
+	writer_bytes(writer, (char *) &header, sizeof header);
+
+	if (scalar_size == sizeof(double))
+	{
+		writer_bytes(writer, (char *) points->points, count * sizeof *points->points);
+	}
+	else
+	{
+		size_t i;
+		for (i = 0; i < count; i++)
+		{
+			point3d_t *point = points->points + i;
+			float coords[3] = { point->x, point->y, point->z };
+			writer_bytes(writer, (char *) coords, sizeof coords);
+		}
+	}
+
+	return writer_error(writer);
+}
+
+status_t read_points(FILE *stream, point3d_buffer_t *points)
+{
+	return read_points_parallel(stream, points, 1);
+}
+
+status_t read_points_parallel(FILE *stream, point3d_buffer_t *points, size_t num_threads)
+{
+	status_t error = SUCCESS;
+
+	if (num_threads == 0)
+	{
+		num_threads = 1;
+	}
+
+	int fd = fileno(stream);
+	long offset = ftell(stream);
+	struct stat info;
+	char *text;
+	if (offset < 0 || fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+	{
+		goto unmappable;
+	}
+
+	size_t size = info.st_size;
+	if (size <= (size_t) offset)
+	{
+		goto exit0;
+	}
+
+	//Writable so that adopted points behave like any others; writes stay private to the process
+	if ((text = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		goto unmappable;
+	}
+
+	if (is_binary(text + offset, size - offset))
+	{
+		size_t count, scalar_size;
+		IF_ERROR_GOTO(check_binary(text + offset, size - offset, &count, &scalar_size), error, exit2);
+
+		//Doubles are already laid out as point3d_t, so they are used in place without a copy
+		char *data = text + offset + sizeof(points_binary_header_t);
+		if (scalar_size == sizeof(double) && point3d_buffer_size(points) == 0 &&
+			(uintptr_t) data % _Alignof(point3d_t) == 0)
+		{
+			point3d_buffer_adopt_mapping(points, text, size, (point3d_t *) data, count);
 			goto exit0;
 		}
 
-		start = end + 1;
+		error = append_binary(data, count, scalar_size, points);
+		goto exit2;
 	}
+	madvise(text, size, MADV_SEQUENTIAL);
 
-	point->x = coords[0];
-	point->y = coords[1];
-	point->z = coords[2];
+	//Lines already consumed through the stream still count toward the line numbers
+	size_t first_line = 1 + count_newlines(text, text + offset);
+	error = parse_points(text + offset, text + size, first_line, points, num_threads);
+
+exit2:
+	munmap(text, size);
+	goto exit0;
+
+unmappable:
+	IF_ERROR_GOTO(read_unmappable(stream, &text, &size), error, exit1);
+	if (is_binary(text, size))
+	{
+		size_t count, scalar_size;
+		IF_ERROR_GOTO(check_binary(text, size, &count, &scalar_size), error, exit1);
+		error = append_binary(text + sizeof(points_binary_header_t), count, scalar_size, points);
+		goto exit1;
+	}
 
+	//Only the stream's start is known to be line 1
+	error = parse_points(text, text + size, offset == 0 ? 1 : 0, points, num_threads);
+exit1:
+	free(text);
 exit0:
 	return error;
 }
+
+status_t parse_point(char *line, point3d_t *point)
+{
+	const char *end = line + strlen(line);
+	double coords[3];
+	const char *next = parse_line(line, end, coords);
+	if (next == NULL || next != end)
+	{
+		print_format_error(line, end, 0);
+		return FILE_FORMAT_ERROR;
+	}
+
+	point->x = coords[0];
+	point->y = coords[1];
+	point->z = coords[2];
+	return SUCCESS;
+}
@@ -1,9 +1,13 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "hierarchical.h"
 
-#include "matrix.h"
+#include "affine.h"
+#include "draw_list.h"
 #include "status.h"
 
-status_t hierarchical_draw(hierarchical_t *model, matrix_t *transform)
+status_t hierarchical_draw(hierarchical_t *model, affine_t *transform, draw_list_t *list)
 {
 	status_t error = SUCCESS;
 	if (model == NULL)
@@ -11,25 +15,195 @@ status_t hierarchical_draw(hierarchical_t *model, matrix_t *transform)
 		goto exit0;
 	}
 
-	matrix_t *new_transform;
-	INITIALIZE_OR_OUT_OF_MEM(new_transform, matrix_initialize(4, 4), error, exit0);
-
-	matrix_multiply(new_transform, transform, model->from_parent);
+	if (model->dirty)
+	{
+		affine_compose(&model->world, transform, &model->from_parent);
+		model->dirty = 0;
+	}
 
-	model->draw(&model->model, new_transform);
+	IF_ERROR_GOTO(draw_list_append(list, &model->model, &model->world), error, exit0);
 
 	if (model->child != NULL)
 	{
-		IF_ERROR_GOTO(hierarchical_draw(model->child, new_transform), error, exit1);
+		IF_ERROR_GOTO(hierarchical_draw(model->child, &model->world, list), error, exit0);
 	}
 
 	if (model->sibling != NULL)
 	{
-		IF_ERROR_GOTO(hierarchical_draw(model->sibling, transform), error, exit1);
+		IF_ERROR_GOTO(hierarchical_draw(model->sibling, transform, list), error, exit0);
+	}
+
+exit0:
+	return error;
+}
+
+static void mark_children_dirty(hierarchical_t *child)
+{
+	for (; child != NULL; child = child->sibling)
+	{
+		//Any node that is already dirty must already have an entirely dirty subtree
+		if (!child->dirty)
+		{
+			child->dirty = 1;
+			mark_children_dirty(child->child);
+		}
+	}
+}
+
+void hierarchical_mark_dirty(hierarchical_t *model)
+{
+	if (!model->dirty)
+	{
+		model->dirty = 1;
+		mark_children_dirty(model->child);
+	}
+}
+
+void hierarchical_set_from_parent(hierarchical_t *model, affine_t *from_parent)
+{
+	model->from_parent = *from_parent;
+	hierarchical_mark_dirty(model);
+}
+
+static size_t count_nodes(hierarchical_t *model)
+{
+	size_t count = 0;
+	for (; model != NULL; model = model->sibling)
+	{
+		count += 1 + count_nodes(model->child);
+	}
+
+	return count;
+}
+
+static void flatten_nodes(hierarchical_flat_t *flat, hierarchical_t *model, size_t parent, size_t *next)
+{
+	for (; model != NULL; model = model->sibling)
+	{
+		size_t index = (*next)++;
+		flat->locals[index] = model->from_parent;
+		flat->parents[index] = parent;
+		flat->nodes[index] = model;
+		flat->dirty[index] = 1;
+		flatten_nodes(flat, model->child, index, next);
+	}
+}
+
+hierarchical_flat_t *hierarchical_compile(hierarchical_t *model)
+{
+	hierarchical_flat_t *flat;
+	if ((flat = malloc(sizeof *flat)) == NULL)
+	{
+		goto error0;
+	}
+
+	size_t size = count_nodes(model);
+	flat->size = size;
+	if ((flat->locals = malloc(size * sizeof *flat->locals)) == NULL)
+	{
+		goto error1;
+	}
+
+	if ((flat->worlds = malloc(size * sizeof *flat->worlds)) == NULL)
+	{
+		goto error2;
+	}
+
+	if ((flat->parents = malloc(size * sizeof *flat->parents)) == NULL)
+	{
+		goto error3;
+	}
+
+	if ((flat->nodes = malloc(size * sizeof *flat->nodes)) == NULL)
+	{
+		goto error4;
+	}
+
+	if ((flat->dirty = malloc(size * sizeof *flat->dirty)) == NULL)
+	{
+		goto error5;
+	}
+
+	size_t next = 0;
+	flatten_nodes(flat, model, HIERARCHICAL_NO_PARENT, &next);
+
+	goto success;
+
+error5:
+	free(flat->nodes);
+error4:
+	free(flat->parents);
+error3:
+	free(flat->worlds);
+error2:
+	free(flat->locals);
+error1:
+	free(flat);
+	flat = NULL;
+error0:
+
+success:
+	return flat;
+}
+
+void hierarchical_flat_uninitialize(hierarchical_flat_t *flat)
+{
+	free(flat->dirty);
+	free(flat->nodes);
+	free(flat->parents);
+	free(flat->worlds);
+	free(flat->locals);
+	free(flat);
+}
+
+void hierarchical_flat_set_local(hierarchical_flat_t *flat, size_t index, affine_t *local)
+{
+	flat->locals[index] = *local;
+	flat->dirty[index] = 1;
+}
+
+void hierarchical_flat_update(hierarchical_flat_t *flat, affine_t *transform)
+{
+	size_t size = flat->size;
+	affine_t *locals = flat->locals;
+	affine_t *worlds = flat->worlds;
+	size_t *parents = flat->parents;
+	uint8_t *dirty = flat->dirty;
+
+	//Parents always precede their children, so by the time a node is reached, its parent's world
+	//transform (and whether or not it changed in this pass) is already known
+	size_t i;
+	for (i = 0; i < size; i++)
+	{
+		size_t parent = parents[i];
+		affine_t *parent_world = transform;
+		if (parent != HIERARCHICAL_NO_PARENT)
+		{
+			parent_world = worlds + parent;
+			dirty[i] |= dirty[parent];
+		}
+
+		if (dirty[i])
+		{
+			affine_compose(worlds + i, parent_world, locals + i);
+		}
+	}
+
+	memset(dirty, 0, size * sizeof *dirty);
+}
+
+status_t hierarchical_flat_draw(hierarchical_flat_t *flat, affine_t *transform, draw_list_t *list)
+{
+	status_t error = SUCCESS;
+
+	hierarchical_flat_update(flat, transform);
+
+	size_t i;
+	for (i = 0; i < flat->size; i++)
+	{
+		IF_ERROR_GOTO(draw_list_append(list, &flat->nodes[i]->model, flat->worlds + i), error, exit0);
 	}
 
-exit1:
-	matrix_uninitialize(new_transform);
 exit0:
 	return error;
 }
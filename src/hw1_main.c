@@ -6,15 +6,16 @@
 #include "awh44_math.h"
 #include "bezier.h"
 #include "point3d.h"
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
 #include "polyline.h"
 #include "status.h"
+#include "writer.h"
 
 #include "graphics.h"
 
-status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius);
+status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius, int *precision, long *num_threads, point3d_style_t *style, double *weld);
 void usage(char *prog);
-void print_to_iv(bezier_t *bezier, double radius, polyline_t *poly);
+status_t print_to_iv(bezier_t *bezier, double radius, point3d_style_t style, polyline_t *poly, int precision);
 
 int main(int argc, char **argv)
 {
@@ -22,7 +23,11 @@ int main(int argc, char **argv)
 	char *filename;
 	double u_inc;
 	double radius;
-	if ((error = parse_args(argc, argv, &filename, &u_inc, &radius)))
+	int precision;
+	long num_threads;
+	point3d_style_t style;
+	double weld;
+	if ((error = parse_args(argc, argv, &filename, &u_inc, &radius, &precision, &num_threads, &style, &weld)))
 	{
 		usage(argv[0]);
 		goto exit0;
@@ -43,7 +48,7 @@ int main(int argc, char **argv)
 		goto exit1;
 	}
 
-	if ((error = read_points(file, bezier->ctrl)))
+	if ((error = read_points_parallel(file, bezier->ctrl, num_threads)))
 	{
 		goto exit2;
 	}
@@ -61,7 +66,12 @@ int main(int argc, char **argv)
 		goto exit3;
 	}
 
-	print_to_iv(bezier, radius, poly);
+	if (weld >= 0.0 && (error = polyline_weld(poly, weld)))
+	{
+		goto exit3;
+	}
+
+	error = print_to_iv(bezier, radius, style, poly, precision);
 
 exit3:
 	polyline_uninitialize(poly);
@@ -73,14 +83,20 @@ exit0:
 	return error;
 }
 
-status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius)
+status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius, int *precision, long *num_threads, point3d_style_t *style, double *weld)
 {
 	*filename = "cpts_in.txt";
 	*u_inc = .09;
 	*radius = 0.1;
+	*precision = WRITER_DEFAULT_PRECISION;
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	*num_threads = procs > 0 ? procs : 1;
+	*style = POINT3D_STYLE_SPHERES;
+	//Negative to leave the points as they are
+	*weld = -1.0;
 
 	char opt;
-	while ((opt = getopt(argc, argv, "f:u:r:")) > 0)
+	while ((opt = getopt(argc, argv, "f:u:r:p:j:c:W:")) > 0)
 	{
 		switch (opt)
 		{
@@ -108,6 +124,46 @@ status_t parse_args(int argc, char **argv, char **filename, double *u_inc, doubl
 				break;
 			}
 
+			case 'j':
+			{
+				char *end;
+				*num_threads = strtol(optarg, &end, 10);
+				if (*num_threads < 1 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'c':
+			{
+				if (point3d_parse_style(optarg, style))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'W':
+			{
+				char *end;
+				*weld = strtod(optarg, &end);
+				if (*end != '\0' || !(*weld >= 0.0))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'p':
+			{
+				if (writer_parse_precision(optarg, precision))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
 			case '?':
 			{
 				return ARGS_ERROR;
@@ -121,12 +177,24 @@ status_t parse_args(int argc, char **argv, char **filename, double *u_inc, doubl
 void usage(char *prog)
 {
 	fprintf(stderr,
-		"usage: %s [-f filename] [-u 0.0 < increment < 1.0 ] [-r sphere radius]\n", prog);
+		"usage: %s [-f filename] [-u 0.0 < increment < 1.0 ] [-r sphere radius] [-p output precision]\n"
+		"	[-j number of parsing threads] [-c spheres, instanced, or points control point style]\n"
+		"	[-W 0.0 <= weld tolerance]\n", prog);
 }
 
-void print_to_iv(bezier_t *bezier, double radius, polyline_t *poly)
+status_t print_to_iv(bezier_t *bezier, double radius, point3d_style_t style, polyline_t *poly, int precision)
 {
-	printf("#Inventor V2.0 ascii\n");
-	bezier_print_to_iv(bezier, radius, stdout);
-	polyline_print_to_iv(poly, stdout);
+	status_t error = SUCCESS;
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(STDOUT_FILENO, precision), error, exit0);
+
+	writer_string(writer, "#Inventor V2.0 ascii\n");
+	bezier_print_to_iv(bezier, radius, style, writer);
+	polyline_print_to_iv(poly, writer);
+	error = writer_flush(writer);
+
+	writer_uninitialize(writer);
+exit0:
+	return error;
 }
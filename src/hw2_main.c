@@ -4,11 +4,12 @@
 #include "catmullrom.h"
 #include "graphics.h"
 #include "polyline.h"
+#include "writer.h"
 
-status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius);
+status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius, int *precision, long *num_threads, point3d_style_t *style, double *weld);
 void usage(char *prog);
 status_t read_tangents(FILE *stream, point3d_t *t0, point3d_t *t1);
-void print_to_iv(catmullrom_t *catmullrom, double radius, polyline_t *poly);
+status_t print_to_iv(catmullrom_t *catmullrom, double radius, point3d_style_t style, polyline_t *poly, int precision);
 
 int main(int argc, char **argv)
 {
@@ -16,7 +17,11 @@ int main(int argc, char **argv)
 	char *filename;
 	double u_inc;
 	double radius;
-	if ((error = parse_args(argc, argv, &filename, &u_inc, &radius)))
+	int precision;
+	long num_threads;
+	point3d_style_t style;
+	double weld;
+	if ((error = parse_args(argc, argv, &filename, &u_inc, &radius, &precision, &num_threads, &style, &weld)))
 	{
 		usage(argv[0]);
 		goto exit0;
@@ -37,17 +42,40 @@ int main(int argc, char **argv)
 		goto exit1;
 	}
 
-	if ((error = read_tangents(file, catmullrom->t0, catmullrom->tN)))
+	if (points_stream_is_binary(file))
 	{
-		goto exit2;
-	}
+		//Binary files hold the two tangents as their first two points
+		point3d_buffer_t *ctrl = catmullrom->ctrl;
+		if ((error = read_points_parallel(file, ctrl, num_threads)))
+		{
+			goto exit2;
+		}
+
+		if (point3d_buffer_size(ctrl) < 2)
+		{
+			fprintf(stderr, "ERROR: Catmull-Rom spline requires two tangents\n");
+			error = FILE_FORMAT_ERROR;
+			goto exit2;
+		}
 
-	if ((error = read_points(file, catmullrom->ctrl)))
+		point3d_assign(catmullrom->t0, point3d_buffer_get(ctrl, 0));
+		point3d_assign(catmullrom->tN, point3d_buffer_get(ctrl, 1));
+		point3d_buffer_drop_front(ctrl, 2);
+	}
+	else
 	{
-		goto exit2;
+		if ((error = read_tangents(file, catmullrom->t0, catmullrom->tN)))
+		{
+			goto exit2;
+		}
+
+		if ((error = read_points_parallel(file, catmullrom->ctrl, num_threads)))
+		{
+			goto exit2;
+		}
 	}
 
-	if (point3d_vec_size(catmullrom->ctrl) < 2)
+	if (point3d_buffer_size(catmullrom->ctrl) < 2)
 	{
 		fprintf(stderr, "ERROR: Catmull-Rom spline requires at least two points\n");
 		error = FILE_FORMAT_ERROR;
@@ -67,7 +95,12 @@ int main(int argc, char **argv)
 		goto exit3;
 	}
 
-	print_to_iv(catmullrom, radius, poly);
+	if (weld >= 0.0 && (error = polyline_weld(poly, weld)))
+	{
+		goto exit3;
+	}
+
+	error = print_to_iv(catmullrom, radius, style, poly, precision);
 
 exit3:
 	polyline_uninitialize(poly);
@@ -79,14 +112,20 @@ exit0:
 	return error;
 }
 
-status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius)
+status_t parse_args(int argc, char **argv, char **filename, double *u_inc, double *radius, int *precision, long *num_threads, point3d_style_t *style, double *weld)
 {
 	*filename = "cpts_in.txt";
 	*u_inc = .09;
 	*radius = 0.1;
+	*precision = WRITER_DEFAULT_PRECISION;
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	*num_threads = procs > 0 ? procs : 1;
+	*style = POINT3D_STYLE_SPHERES;
+	//Negative to leave the points as they are
+	*weld = -1.0;
 
 	char opt;
-	while ((opt = getopt(argc, argv, "f:u:r:")) > 0)
+	while ((opt = getopt(argc, argv, "f:u:r:p:j:c:W:")) > 0)
 	{
 		switch (opt)
 		{
@@ -114,6 +153,46 @@ status_t parse_args(int argc, char **argv, char **filename, double *u_inc, doubl
 				break;
 			}
 
+			case 'j':
+			{
+				char *end;
+				*num_threads = strtol(optarg, &end, 10);
+				if (*num_threads < 1 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'c':
+			{
+				if (point3d_parse_style(optarg, style))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'W':
+			{
+				char *end;
+				*weld = strtod(optarg, &end);
+				if (*end != '\0' || !(*weld >= 0.0))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'p':
+			{
+				if (writer_parse_precision(optarg, precision))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
 			case '?':
 			{
 				return ARGS_ERROR;
@@ -127,7 +206,9 @@ status_t parse_args(int argc, char **argv, char **filename, double *u_inc, doubl
 void usage(char *prog)
 {
 	fprintf(stderr,
-		"usage: %s [-f filename] [-u 0.0 < increment < 1.0 ] [-r sphere radius]\n", prog);
+		"usage: %s [-f filename] [-u 0.0 < increment < 1.0 ] [-r sphere radius] [-p output precision]\n"
+		"	[-j number of parsing threads] [-c spheres, instanced, or points control point style]\n"
+		"	[-W 0.0 <= weld tolerance]\n", prog);
 }
 
 status_t read_tangents(FILE *stream, point3d_t *t0, point3d_t *t1)
@@ -165,9 +246,19 @@ exit0:
 	return error;
 }
 
-void print_to_iv(catmullrom_t *catmullrom, double radius, polyline_t *poly)
+status_t print_to_iv(catmullrom_t *catmullrom, double radius, point3d_style_t style, polyline_t *poly, int precision)
 {
-	printf("#Inventor V2.0 ascii\n");
-	catmullrom_print_to_iv(catmullrom, radius, stdout);
-	polyline_print_to_iv(poly, stdout);
+	status_t error = SUCCESS;
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(STDOUT_FILENO, precision), error, exit0);
+
+	writer_string(writer, "#Inventor V2.0 ascii\n");
+	catmullrom_print_to_iv(catmullrom, radius, style, writer);
+	polyline_print_to_iv(poly, writer);
+	error = writer_flush(writer);
+
+	writer_uninitialize(writer);
+exit0:
+	return error;
 }
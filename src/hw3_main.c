@@ -1,15 +1,20 @@
+#include <fcntl.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "awh44_math.h"
 #include "bezier_surface.h"
 #include "graphics.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "point3d.h"
-#include "point3d_vec.h"
+#include "point3d_buffer.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
@@ -18,11 +23,36 @@ typedef struct
 	long num_v;
 	double radius;
 	uint8_t use_flat;
+	uint8_t stream;
+	uint8_t fixed_width;
+	char *output;
+	int precision;
+	long num_threads;
+	point3d_style_t style;
+	mesh_cache_t cache;
+	double weld;
+	uint8_t decimate;
+	long target_faces;
+	double max_error;
+	uint8_t compute_normals;
+	mesh_normal_weighting_t weighting;
+	long cache_size;
+	uint8_t reorder_vertices;
+	uint8_t strips;
+	mesh_format_t format;
 } args_t;
 
+//What is drawn along with the mesh in an iv scene
+typedef struct
+{
+	bezier_surface_t *bezier;
+	double radius;
+	point3d_style_t style;
+} control_points_t;
+
 status_t parse_args(int argc, char **argv, args_t *args);
 void usage(char *prog);
-void print_to_iv(bezier_surface_t *surface, double radisu, mesh_t *mesh);
+void print_control_points(void *scene, writer_t *writer);
 
 int main(int argc, char **argv)
 {
@@ -35,12 +65,29 @@ int main(int argc, char **argv)
 		goto exit0;
 	}
 
+	int out = STDOUT_FILENO;
+	if (args.output != NULL && (out = open(args.output, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args.output);
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	//-w sizes and maps the output, which only a regular file allows
+	struct stat out_status;
+	if (args.fixed_width && (fstat(out, &out_status) < 0 || !S_ISREG(out_status.st_mode)))
+	{
+		fprintf(stderr, "ERROR: -w needs %s to be a regular file\n", args.output);
+		error = ARGS_ERROR;
+		goto exit1;
+	}
+
 	FILE *file;
 	if ((file = fopen(args.filename, "r"))  == NULL)
 	{
 		fprintf(stderr, "ERROR: could not open file %s\n", args.filename);
 		error = FILE_OPEN_ERROR;
-		goto exit0;
+		goto exit1;
 	}
 
 	bezier_surface_t *bezier;
@@ -48,19 +95,64 @@ int main(int argc, char **argv)
 	{
 		fprintf(stderr, "ERROR: out of memory\n");
 		error = OUT_OF_MEM;
-		goto exit1;
+		goto exit2;
 	}
 
-	if ((error = read_points(file, bezier->ctrls)))
+	if ((error = read_points_parallel(file, bezier->ctrls, args.num_threads)))
 	{
-		goto exit2;
+		goto exit3;
 	}
 
-	if (point3d_vec_size(bezier->ctrls) != 16)
+	if (point3d_buffer_size(bezier->ctrls) != 16)
 	{
 		fprintf(stderr, "ERROR: bicubic Bezier patches must have 16 control points.\n");
 		error = FILE_FORMAT_ERROR;
-		goto exit2;
+		goto exit3;
+	}
+
+	mesh_cache_key_t key =
+	{
+		.topology = MESH_TOPOLOGY_GRID,
+		.num_u = args.num_u,
+		.num_v = args.num_v,
+		.has_normals = !args.use_flat,
+		.surface = bezier->ctrls->points,
+		.surface_size = point3d_buffer_size(bezier->ctrls) * sizeof *bezier->ctrls->points,
+	};
+	control_points_t control_points = { .bezier = bezier, .radius = args.radius, .style = args.style };
+	mesh_output_t output =
+	{
+		.format = args.format,
+		.precision = args.precision,
+		.fixed_width = args.fixed_width,
+		.num_threads = args.num_threads,
+		.strips = args.strips,
+		.print_iv_scene = print_control_points,
+		.scene = &control_points,
+	};
+	if (args.cache.directory != NULL)
+	{
+		mesh_source_t generator;
+		bezier_surface_source_initialize(&generator, bezier, args.num_u, args.num_v, !args.use_flat);
+		uint8_t hit;
+		error = mesh_cache_output(&args.cache, &key, args.stream ? &generator : NULL, &output, out, &hit);
+		if (error && !hit)
+		{
+			fprintf(stderr, "WARNING: could not add the mesh to the cache in %s\n", args.cache.directory);
+			error = SUCCESS;
+		}
+		if (error || hit)
+		{
+			goto exit3;
+		}
+	}
+
+	if (args.stream)
+	{
+		mesh_source_t source;
+		bezier_surface_source_initialize(&source, bezier, args.num_u, args.num_v, !args.use_flat);
+		error = mesh_stream_output(&source, &output, out);
+		goto exit3;
 	}
 
 	mesh_t *mesh;
@@ -68,38 +160,84 @@ int main(int argc, char **argv)
 	{
 		fprintf(stderr, "ERROR: out of memory\n");
 		error = OUT_OF_MEM;
-		goto exit2;
+		goto exit3;
 	}
 
 	if ((error = bezier_surface_calculate_mesh_points(bezier, mesh, args.num_u, args.num_v)))
 	{
 		fprintf(stderr, "ERROR: could not calculate mesh for Bezier surface\n");
-		goto exit3;
+		goto exit4;
 	}
 
 	if ((error = mesh_calculate_faces(mesh)))
 	{
 		fprintf(stderr, "ERROR: could not calculate faces for mesh\n");
-		goto exit3;
+		goto exit4;
 	}
 
-	if (!args.use_flat)
+	if (!args.use_flat && !args.compute_normals)
 	{
 		if ((error = bezier_surface_calculate_mesh_normals(bezier, mesh)))
 		{
 			fprintf(stderr, "ERROR: could not calculate normals for mesh\n");
-			goto exit3;
+			goto exit4;
 		}
 	}
 
-	print_to_iv(bezier, args.radius, mesh);
+	if (args.weld >= 0.0 && (error = mesh_weld(mesh, args.weld)))
+	{
+		fprintf(stderr, "ERROR: could not weld mesh\n");
+		goto exit4;
+	}
 
-exit3:
+	if (args.decimate && (error = mesh_decimate(mesh, args.target_faces, args.max_error, args.num_threads)))
+	{
+		fprintf(stderr, "ERROR: could not decimate mesh\n");
+		goto exit4;
+	}
+
+	if (args.compute_normals && (error = mesh_compute_vertex_normals(mesh, args.weighting, args.num_threads)))
+	{
+		fprintf(stderr, "ERROR: could not calculate normals for mesh\n");
+		goto exit4;
+	}
+
+	if (args.cache_size > 0)
+	{
+		double before, after;
+		if ((error = mesh_reorder(mesh, args.cache_size, args.reorder_vertices, &before, &after)))
+		{
+			fprintf(stderr, "ERROR: could not reorder mesh\n");
+			goto exit4;
+		}
+		fprintf(stderr, "ACMR with a %ld-vertex cache: %.3f before reordering, %.3f after\n", args.cache_size, before, after);
+	}
+
+	if ((error = mesh_print_output(mesh, &output, out)))
+	{
+		if (args.fixed_width)
+		{
+			fprintf(stderr, "ERROR: could not write mapped output to %s\n", args.output);
+		}
+		goto exit4;
+	}
+
+	if (args.cache.directory != NULL && mesh_cache_store(&args.cache, &key, mesh))
+	{
+		fprintf(stderr, "WARNING: could not add the mesh to the cache in %s\n", args.cache.directory);
+	}
+
+exit4:
 	mesh_uninitialize(mesh);
-exit2:
+exit3:
 	bezier_surface_uninitialize(bezier);
-exit1:
+exit2:
 	fclose(file);
+exit1:
+	if (out != STDOUT_FILENO)
+	{
+		close(out);
+	}
 exit0:
 	return error;
 }
@@ -111,12 +249,33 @@ status_t parse_args(int argc, char **argv, args_t *args)
 	args->num_v = 11;
 	args->radius = 0.1;
 	args->use_flat = 1;
+	args->stream = 0;
+	args->fixed_width = 0;
+	args->output = NULL;
+	args->precision = WRITER_DEFAULT_PRECISION;
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	args->num_threads = procs > 0 ? procs : 1;
+	args->style = POINT3D_STYLE_SPHERES;
+	args->cache.directory = NULL;
+	args->cache.max_size = MESH_CACHE_DEFAULT_MAX_SIZE;
+	//Negative to leave the mesh as it is
+	args->weld = -1.0;
+	args->decimate = 0;
+	args->target_faces = 0;
+	args->max_error = HUGE_VAL;
+	args->compute_normals = 0;
+	args->weighting = MESH_NORMALS_AREA;
+	//0 to leave the faces in the order they are made
+	args->cache_size = 0;
+	args->reorder_vertices = 0;
+	args->strips = 0;
+	args->format = MESH_FORMAT_IV;
 
 	uint8_t seen_S = 0;
 	uint8_t seen_F = 0;
 
 	char opt;
-	while ((opt = getopt(argc, argv, "FSf:u:v:r:")) > 0)
+	while ((opt = getopt(argc, argv, "FSswf:o:u:v:r:p:O:j:c:k:m:W:N:R:VTD:E:")) > 0)
 	{
 		switch (opt)
 		{
@@ -126,6 +285,12 @@ status_t parse_args(int argc, char **argv, args_t *args)
 				break;
 			}
 
+			case 'o':
+			{
+				args->output = optarg;
+				break;
+			}
+
 			case 'u':
 			{
 				char *end;
@@ -181,6 +346,141 @@ status_t parse_args(int argc, char **argv, args_t *args)
 				break;
 			}
 
+			case 'N':
+			{
+				if (seen_F || mesh_parse_normal_weighting(optarg, &args->weighting))
+				{
+					return ARGS_ERROR;
+				}
+				args->use_flat = 0;
+				args->compute_normals = 1;
+				seen_S = 1;
+				break;
+			}
+
+			case 's':
+			{
+				args->stream = 1;
+				break;
+			}
+
+			case 'w':
+			{
+				args->fixed_width = 1;
+				break;
+			}
+
+			case 'j':
+			{
+				char *end;
+				args->num_threads = strtol(optarg, &end, 10);
+				if (args->num_threads < 1 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'c':
+			{
+				if (point3d_parse_style(optarg, &args->style))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'k':
+			{
+				args->cache.directory = optarg;
+				break;
+			}
+
+			case 'm':
+			{
+				if (mesh_cache_parse_max_size(optarg, &args->cache.max_size))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'W':
+			{
+				char *end;
+				args->weld = strtod(optarg, &end);
+				if (*end != '\0' || !(args->weld >= 0.0))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'R':
+			{
+				char *end;
+				args->cache_size = strtol(optarg, &end, 10);
+				if (args->cache_size < 3 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'V':
+			{
+				args->reorder_vertices = 1;
+				break;
+			}
+
+			case 'T':
+			{
+				args->strips = 1;
+				break;
+			}
+
+			case 'D':
+			{
+				char *end;
+				args->target_faces = strtol(optarg, &end, 10);
+				if (args->target_faces < 0 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				args->decimate = 1;
+				break;
+			}
+
+			case 'E':
+			{
+				char *end;
+				args->max_error = strtod(optarg, &end);
+				if (*end != '\0' || !(args->max_error >= 0.0))
+				{
+					return ARGS_ERROR;
+				}
+				args->decimate = 1;
+				break;
+			}
+
+			case 'p':
+			{
+				if (writer_parse_precision(optarg, &args->precision))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
+			case 'O':
+			{
+				if (mesh_parse_format(optarg, &args->format))
+				{
+					return ARGS_ERROR;
+				}
+				break;
+			}
+
 			case '?':
 			{
 				return ARGS_ERROR;
@@ -188,6 +488,40 @@ status_t parse_args(int argc, char **argv, args_t *args)
 		}
 	}
 
+	//Fixed-width output is formatted in place in a mapping of the whole mesh, so it needs a real
+	//file and a stored mesh
+	if (args->fixed_width && (args->output == NULL || args->format != MESH_FORMAT_IV || args->stream))
+	{
+		return ARGS_ERROR;
+	}
+
+	//Cached meshes are played back as a stream, which cannot be formatted in place
+	if (args->fixed_width && args->cache.directory != NULL)
+	{
+		return ARGS_ERROR;
+	}
+
+	//Welding, decimating, and computing normals need the whole mesh at once, and the cache holds
+	//only untouched grids with analytic normals
+	if ((args->weld >= 0.0 || args->decimate || args->compute_normals) && (args->stream || args->cache.directory != NULL))
+	{
+		return ARGS_ERROR;
+	}
+
+	//Vertices are renumbered only along with the faces, and the cache and streams keep the faces
+	//in the order they are made
+	if ((args->reorder_vertices && args->cache_size == 0) ||
+		(args->cache_size > 0 && (args->stream || args->cache.directory != NULL)))
+	{
+		return ARGS_ERROR;
+	}
+
+	//Strips are made from the whole mesh, and STL has no indices to put them in
+	if (args->strips && (args->stream || args->cache.directory != NULL || args->fixed_width || args->format == MESH_FORMAT_STL))
+	{
+		return ARGS_ERROR;
+	}
+
 	return optind == argc ? SUCCESS : ARGS_ERROR;
 }
 
@@ -196,12 +530,19 @@ void usage(char *prog)
 	fprintf(stderr,
 		"usage: %s [-f filename] "
 		"[-u 1 < number of u samples] [-v 1 < number of v samples] "
-		"[-r control sphere radius]\n", prog);
+		"[-r control sphere radius] [-p output precision] [-O iv, ply, or stl output format] "
+		"[-s stream the mesh without storing it] [-j number of parsing and writing threads]\n"
+		"	[-c spheres, instanced, or points control point style] [-o output filename]\n"
+		"	[-w fixed-width iv output written in parallel, with -o] [-k mesh cache directory]\n"
+		"	[-m maximum mesh cache size in megabytes] [-W 0.0 <= weld tolerance]\n"
+		"	[-N area or angle weighted normals computed from the faces]\n"
+		"	[-R 2 < vertex cache size to reorder the faces for] [-V also reorder the vertices]\n"
+		"	[-T triangle strips in iv or ply output] [-D target number of faces after decimation]\n"
+		"	[-E 0.0 <= largest error of a decimation step]\n", prog);
 }
 
-void print_to_iv(bezier_surface_t *bezier, double radius, mesh_t *mesh)
+void print_control_points(void *scene, writer_t *writer)
 {
-	printf("#Inventor V2.0 ascii\n");
-	bezier_surface_print_to_iv(bezier, radius, stdout);
-	mesh_print_to_iv(mesh, stdout);
+	control_points_t *control_points = scene;
+	bezier_surface_print_to_iv(control_points->bezier, control_points->radius, control_points->style, writer);
 }
@@ -1,22 +1,42 @@
+#include <fcntl.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "mesh_cache.h"
 #include "sellipsoid.h"
 #include "status.h"
+#include "writer.h"
 
 typedef struct
 {
 	long num_u;
 	long num_v;
 	uint8_t use_flat;
+	uint8_t stream;
+	uint8_t fixed_width;
+	char *output;
+	int precision;
+	long num_threads;
+	mesh_cache_t cache;
+	double weld;
+	uint8_t decimate;
+	long target_faces;
+	double max_error;
+	uint8_t compute_normals;
+	mesh_normal_weighting_t weighting;
+	long cache_size;
+	uint8_t reorder_vertices;
+	uint8_t strips;
+	mesh_format_t format;
 	sellipsoid_t sellipsoid;
 } args_t;
 
 status_t parse_args(int argc, char **argv, args_t *args);
 void usage(char *prog);
-void print_to_iv(mesh_t *mesh);
 
 int main(int argc, char **argv)
 {
@@ -29,37 +49,145 @@ int main(int argc, char **argv)
 		goto exit0;
 	}
 
+	int out = STDOUT_FILENO;
+	if (args.output != NULL && (out = open(args.output, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args.output);
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	//-w sizes and maps the output, which only a regular file allows
+	struct stat out_status;
+	if (args.fixed_width && (fstat(out, &out_status) < 0 || !S_ISREG(out_status.st_mode)))
+	{
+		fprintf(stderr, "ERROR: -w needs %s to be a regular file\n", args.output);
+		error = ARGS_ERROR;
+		goto exit1;
+	}
+
+	//The parameters of the superellipsoid are all doubles, so they hash without any padding
+	mesh_cache_key_t key =
+	{
+		.topology = MESH_TOPOLOGY_POLES,
+		.num_u = args.num_u,
+		.num_v = args.num_v,
+		.has_normals = !args.use_flat,
+		.surface = &args.sellipsoid,
+		.surface_size = sizeof args.sellipsoid,
+	};
+	mesh_output_t output =
+	{
+		.format = args.format,
+		.precision = args.precision,
+		.fixed_width = args.fixed_width,
+		.num_threads = args.num_threads,
+		.strips = args.strips,
+		.print_iv_scene = NULL,
+		.scene = NULL,
+	};
+	if (args.cache.directory != NULL)
+	{
+		mesh_source_t generator;
+		sellipsoid_source_initialize(&generator, &args.sellipsoid, args.num_u, args.num_v, !args.use_flat);
+		uint8_t hit;
+		error = mesh_cache_output(&args.cache, &key, args.stream ? &generator : NULL, &output, out, &hit);
+		if (error && !hit)
+		{
+			fprintf(stderr, "WARNING: could not add the mesh to the cache in %s\n", args.cache.directory);
+			error = SUCCESS;
+		}
+		if (error || hit)
+		{
+			goto exit1;
+		}
+	}
+
+	if (args.stream)
+	{
+		mesh_source_t source;
+		sellipsoid_source_initialize(&source, &args.sellipsoid, args.num_u, args.num_v, !args.use_flat);
+		error = mesh_stream_output(&source, &output, out);
+		goto exit1;
+	}
+
 	mesh_t *mesh;
 	if ((mesh = mesh_initialize()) == NULL)
 	{
 		error = OUT_OF_MEM;
-		goto exit0;
+		goto exit1;
 	}
 
 	if ((error = sellipsoid_calculate_mesh_points(&args.sellipsoid, mesh, args.num_u, args.num_v)))
 	{
-		goto exit1;
+		goto exit2;
 	}
 
 	if ((error = mesh_calculate_sellipsoid_faces(mesh)))
 	{
 		fprintf(stderr, "ERROR: could not calculate faces for mesh\n");
-		goto exit1;
+		goto exit2;
 	}
 
-	if (!args.use_flat)
+	if (!args.use_flat && !args.compute_normals)
 	{
 		if ((error = sellipsoid_calculate_mesh_normals(&args.sellipsoid, mesh)))
 		{
 			fprintf(stderr, "ERROR: could not calculate normals for mesh\n");
-			goto exit1;
+			goto exit2;
 		}
 	}
 
-	print_to_iv(mesh);
+	if (args.weld >= 0.0 && (error = mesh_weld(mesh, args.weld)))
+	{
+		fprintf(stderr, "ERROR: could not weld mesh\n");
+		goto exit2;
+	}
 
-exit1:
+	if (args.decimate && (error = mesh_decimate(mesh, args.target_faces, args.max_error, args.num_threads)))
+	{
+		fprintf(stderr, "ERROR: could not decimate mesh\n");
+		goto exit2;
+	}
+
+	if (args.compute_normals && (error = mesh_compute_vertex_normals(mesh, args.weighting, args.num_threads)))
+	{
+		fprintf(stderr, "ERROR: could not calculate normals for mesh\n");
+		goto exit2;
+	}
+
+	if (args.cache_size > 0)
+	{
+		double before, after;
+		if ((error = mesh_reorder(mesh, args.cache_size, args.reorder_vertices, &before, &after)))
+		{
+			fprintf(stderr, "ERROR: could not reorder mesh\n");
+			goto exit2;
+		}
+		fprintf(stderr, "ACMR with a %ld-vertex cache: %.3f before reordering, %.3f after\n", args.cache_size, before, after);
+	}
+
+	if ((error = mesh_print_output(mesh, &output, out)))
+	{
+		if (args.fixed_width)
+		{
+			fprintf(stderr, "ERROR: could not write mapped output to %s\n", args.output);
+		}
+		goto exit2;
+	}
+
+	if (args.cache.directory != NULL && mesh_cache_store(&args.cache, &key, mesh))
+	{
+		fprintf(stderr, "WARNING: could not add the mesh to the cache in %s\n", args.cache.directory);
+	}
+
+exit2:
 	mesh_uninitialize(mesh);
+exit1:
+	if (out != STDOUT_FILENO)
+	{
+		close(out);
+	}
 exit0:
 	return error;
 }
@@ -69,6 +197,26 @@ status_t parse_args(int argc, char **argv, args_t *args)
 	args->num_u = 19;
 	args->num_v = 9;
 	args->use_flat = 1;
+	args->stream = 0;
+	args->fixed_width = 0;
+	args->output = NULL;
+	args->precision = WRITER_DEFAULT_PRECISION;
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	args->num_threads = procs > 0 ? procs : 1;
+	args->cache.directory = NULL;
+	args->cache.max_size = MESH_CACHE_DEFAULT_MAX_SIZE;
+	//Negative to leave the mesh as it is
+	args->weld = -1.0;
+	args->decimate = 0;
+	args->target_faces = 0;
+	args->max_error = HUGE_VAL;
+	args->compute_normals = 0;
+	args->weighting = MESH_NORMALS_AREA;
+	//0 to leave the faces in the order they are made
+	args->cache_size = 0;
+	args->reorder_vertices = 0;
+	args->strips = 0;
+	args->format = MESH_FORMAT_IV;
 	args->sellipsoid.s1 = 1;
 	args->sellipsoid.s2 = 1;
 	args->sellipsoid.A = 1;
@@ -81,7 +229,7 @@ status_t parse_args(int argc, char **argv, args_t *args)
 #define CHECK_OR_RETURN(cond) do { if (cond) { return ARGS_ERROR; } } while (0)
 
 	char opt;
-	while ((opt = getopt(argc, argv, "u:v:FSr:t:A:B:C:")) > 0)
+	while ((opt = getopt(argc, argv, "u:v:FSr:t:A:B:C:p:O:so:wj:k:m:W:N:R:VTD:E:")) > 0)
 	{
 		switch (opt)
 		{	
@@ -157,6 +305,111 @@ status_t parse_args(int argc, char **argv, args_t *args)
 				break;
 			}
 
+			case 'N':
+			{
+				CHECK_OR_RETURN(seen_F || mesh_parse_normal_weighting(optarg, &args->weighting));
+				args->use_flat = 0;
+				args->compute_normals = 1;
+				seen_S = 1;
+				break;
+			}
+
+			case 's':
+			{
+				args->stream = 1;
+				break;
+			}
+
+			case 'o':
+			{
+				args->output = optarg;
+				break;
+			}
+
+			case 'w':
+			{
+				args->fixed_width = 1;
+				break;
+			}
+
+			case 'j':
+			{
+				char *end;
+				args->num_threads = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(args->num_threads < 1 || *end != '\0');
+				break;
+			}
+
+			case 'k':
+			{
+				args->cache.directory = optarg;
+				break;
+			}
+
+			case 'm':
+			{
+				CHECK_OR_RETURN(mesh_cache_parse_max_size(optarg, &args->cache.max_size));
+				break;
+			}
+
+			case 'W':
+			{
+				char *end;
+				args->weld = strtod(optarg, &end);
+				CHECK_OR_RETURN(*end != '\0' || !(args->weld >= 0.0));
+				break;
+			}
+
+			case 'R':
+			{
+				char *end;
+				args->cache_size = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(args->cache_size < 3 || *end != '\0');
+				break;
+			}
+
+			case 'V':
+			{
+				args->reorder_vertices = 1;
+				break;
+			}
+
+			case 'T':
+			{
+				args->strips = 1;
+				break;
+			}
+
+			case 'D':
+			{
+				char *end;
+				args->target_faces = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(args->target_faces < 0 || *end != '\0');
+				args->decimate = 1;
+				break;
+			}
+
+			case 'E':
+			{
+				char *end;
+				args->max_error = strtod(optarg, &end);
+				CHECK_OR_RETURN(*end != '\0' || !(args->max_error >= 0.0));
+				args->decimate = 1;
+				break;
+			}
+
+			case 'p':
+			{
+				CHECK_OR_RETURN(writer_parse_precision(optarg, &args->precision));
+				break;
+			}
+
+			case 'O':
+			{
+				CHECK_OR_RETURN(mesh_parse_format(optarg, &args->format));
+				break;
+			}
+
 			case '?':
 			{
 				return ARGS_ERROR;
@@ -164,6 +417,22 @@ status_t parse_args(int argc, char **argv, args_t *args)
 		}
 	}
 
+	//Fixed-width output is formatted in place in a mapping of the whole mesh, so it needs a real
+	//file and a stored mesh
+	CHECK_OR_RETURN(args->fixed_width && (args->output == NULL || args->format != MESH_FORMAT_IV || args->stream));
+	//Cached meshes are played back as a stream, which cannot be formatted in place
+	CHECK_OR_RETURN(args->fixed_width && args->cache.directory != NULL);
+	//Welding, decimating, and computing normals need the whole mesh at once, and the cache holds
+	//only untouched grids with analytic normals
+	CHECK_OR_RETURN((args->weld >= 0.0 || args->decimate || args->compute_normals) && (args->stream || args->cache.directory != NULL));
+	//Vertices are renumbered only along with the faces, and the cache and streams keep the faces
+	//in the order they are made
+	CHECK_OR_RETURN(args->reorder_vertices && args->cache_size == 0);
+	CHECK_OR_RETURN(args->cache_size > 0 && (args->stream || args->cache.directory != NULL));
+	//Strips are made from the whole mesh, and STL has no indices to put them in
+	CHECK_OR_RETURN(args->strips && (args->stream || args->cache.directory != NULL || args->fixed_width));
+	CHECK_OR_RETURN(args->strips && args->format == MESH_FORMAT_STL);
+
 #undef CHECK_OR_RETURN
 
 	return optind == argc ? SUCCESS : ARGS_ERROR;
@@ -175,11 +444,12 @@ void usage(char *prog)
 		"usage: %s\n"
 		"	[-u 2 < number of u samples] [-v 2 < number of v samples]\n"
 		"	[-r s1 value] [-t s2 value] [-A A value != 0] [-B B value != 0] [-C C value != 0]\n"
-		"	[-S smooth-shaded or -F flat-shaded]\n", prog);
-}
-
-void print_to_iv(mesh_t *mesh)
-{
-	printf("#Inventor V2.0 ascii\n");
-	mesh_print_to_iv(mesh, stdout);
+		"	[-S smooth-shaded or -F flat-shaded] [-p output precision] [-O iv, ply, or stl output format]\n"
+		"	[-s stream the mesh without storing it] [-o output filename]\n"
+		"	[-w fixed-width iv output written in parallel, with -o] [-j number of writing threads]\n"
+		"	[-k mesh cache directory] [-m maximum mesh cache size in megabytes] [-W 0.0 <= weld tolerance]\n"
+		"	[-N area or angle weighted normals computed from the faces]\n"
+		"	[-R 2 < vertex cache size to reorder the faces for] [-V also reorder the vertices]\n"
+		"	[-T triangle strips in iv or ply output] [-D target number of faces after decimation]\n"
+		"	[-E 0.0 <= largest error of a decimation step]\n", prog);
 }
@@ -2,141 +2,28 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "animation.h"
 #include "awh44_math.h"
-#include "cuboid.h"
-#include "hierarchical.h"
-#include "matrix.h"
-#include "point3d.h"
+#include "draw_list.h"
+#include "robot.h"
 #include "status.h"
-#include "transforms.h"
+#include "writer.h"
 
 typedef struct
 {
 	double theta1, theta2, theta3;
 	double l1, l2, l3;
+	char *keyframes;
+	char *prefix;
+	long num_frames;
+	long num_threads;
+	int precision;
 } args_t;
 
 status_t parse_args(int argc, char **argv, args_t *args);
+status_t animate(args_t *args);
 void usage(char *prog);
 
-void point_draw(model_t *model, matrix_t *transform)
-{
-	//Currently can't return error from here anyway, so I'll just let the
-	//program segfault if it comes to that...
-	matrix_t *real_coords = matrix_initialize(4, 1);
-	matrix_multiply(real_coords, transform, model->matrices[0]);
-	point3d_print_matrix_to_iv(real_coords, stdout, 0.2);
-	matrix_uninitialize(real_coords);
-}
-
-status_t point_model_initialize(hierarchical_t *model, double *loc, double *pt)
-{
-	status_t error = SUCCESS;
-
-	INITIALIZE_OR_OUT_OF_MEM(model->model.matrices, malloc(sizeof *model->model.matrices), error, error0);
-
-	IF_ERROR_GOTO
-	(
-		point3d_initialize_matrix(model->model.matrices, (double[]) { 0.0, 0.0, 0.0 }),
-		error, error1;
-	);
-
-	INITIALIZE_OR_OUT_OF_MEM
-	(
-		model->from_parent,
-		translation_matrix(pt[0], pt[1], pt[2]),
-		error, error2
-	);
-
-	model->draw = point_draw;
-	model->sibling = NULL;
-	model->child = NULL;
-
-	goto success;
-
-error2:
-	matrix_uninitialize(model->model.matrices[0]);
-error1:
-	free(model->model.matrices);
-error0:
-
-success:
-	return error;
-}
-
-void point_model_uninitialize(hierarchical_t *model)
-{
-	matrix_uninitialize(model->model.matrices[0]);
-	free(model->model.matrices);
-	matrix_uninitialize(model->from_parent);
-}
-
-void cuboid_draw(model_t *model, matrix_t *transform)
-{
-	matrix_t *real_coords[CUBOID_POINTS];
-
-	for (size_t i = 0; i < CUBOID_POINTS; i++)
-	{
-		//Currently can't return error from here anyway, so I'll just let the
-		//program segfault if it comes to that...
-		real_coords[i] = matrix_initialize(4, 1);
-		matrix_multiply(real_coords[i], transform, model->matrices[i]);
-	}
-	cuboid_print_matrices_to_iv(real_coords, stdout);
-
-	for (size_t i = 0; i < CUBOID_POINTS; i++)
-	{
-		matrix_uninitialize(real_coords[i]);
-	}
-}
-
-status_t cuboid_model_initialize(hierarchical_t *model, double *ll, double *ur, double *pt, double pr, rotatedir_t dir)
-{
-	status_t error = SUCCESS;
-
-	INITIALIZE_OR_OUT_OF_MEM(model->model.matrices, malloc(CUBOID_POINTS * sizeof *model->model.matrices), error, error0);
-
-	IF_ERROR_GOTO(cuboid_initialize_matrices(model->model.matrices, ll, ur), error, error1);
-	INITIALIZE_OR_OUT_OF_MEM(model->from_parent, matrix_initialize(4, 4), error, error2);
-
-	matrix_t *translate;
-	INITIALIZE_OR_OUT_OF_MEM(translate, translation_matrix(pt[0], pt[1], pt[2]), error, error2);
-
-	matrix_t *rotate;
-	if ((rotate = rotation_matrix(pr, dir)) == NULL)
-	{
-		matrix_uninitialize(translate);
-		error = OUT_OF_MEM;
-		goto error2;
-	}
-
-	matrix_multiply(model->from_parent, translate, rotate);
-	matrix_uninitialize(translate);
-	matrix_uninitialize(rotate);
-
-	model->draw = cuboid_draw;
-	model->sibling = NULL;
-	model->child = NULL;
-
-	goto success;
-
-error2:
-	cuboid_uninitialize_matrices(model->model.matrices);
-error1:
-	free(model->model.matrices);
-error0:
-
-success:
-	return error;
-}
-
-void cuboid_model_uninitialize(hierarchical_t *model)
-{
-	cuboid_uninitialize_matrices(model->model.matrices);
-	free(model->model.matrices);
-	matrix_uninitialize(model->from_parent);
-}
-
 int main(int argc, char **argv)
 {
 	status_t error = SUCCESS;
@@ -148,86 +35,41 @@ int main(int argc, char **argv)
 		goto exit0;
 	}
 
-	double ll[4][3] =
-	{
-		{ -2, -2, 0 },
-		{ -.5, -.5, 0 },
-		{ -.5, -.5, 0 },
-		{ -.5, -.5, 0 },
-
-	};
-
-	double ur[4][3] =
+	if (args.keyframes != NULL)
 	{
-		{ 2, 2, 1 },
-		{ .5, .5, args.l1 },
-		{ .5, .5, args.l2 },
-		{ .5, .5, args.l3 },
-	};
-
-	double trans[4][3] =
-	{
-		{ 0, 0, 0 },
-		{ 0, 0, ur[0][2] },
-		{ 0, 0, ur[1][2] },
-		{ 0, 0, ur[2][2] },
-	};
-
-	hierarchical_t models[6];
-
-	IF_ERROR_GOTO
-	(
-		point_model_initialize(models + 0, (double[]) { 0.0, 0.0, 0.0 }, (double[]) { 0.0, 0.0, 0.0 }), error, exit0
-	);
-	models[0].child = models + 1;
-
-	IF_ERROR_GOTO
-	(
-		cuboid_model_initialize(models + 1, ll[0], ur[0], trans[0], 0, ROTATE_X), error, exit1
-	);
-	models[1].child = models + 2;
-
-	IF_ERROR_GOTO
-	(
-		cuboid_model_initialize(models + 2, ll[1], ur[1], trans[1], args.theta1, ROTATE_Z), error, exit2
-	);
-	models[2].child = models + 3;
+		error = animate(&args);
+		goto exit0;
+	}
 
+	robot_t robot;
 	IF_ERROR_GOTO
 	(
-		cuboid_model_initialize(models + 3, ll[2], ur[2], trans[2], args.theta2, ROTATE_Y), error, exit3
+		robot_initialize
+		(
+			&robot,
+			(double[]) { args.l1, args.l2, args.l3 },
+			(double[]) { args.theta1, args.theta2, args.theta3 }
+		),
+		error, exit0
 	);
-	models[3].child = models + 4;
 
-	IF_ERROR_GOTO
-	(
-		cuboid_model_initialize(models + 4, ll[3], ur[3], trans[3], args.theta3, ROTATE_Y), error, exit4
-	);
-	models[4].child = models + 5;
+	draw_list_t *list;
+	INITIALIZE_OR_OUT_OF_MEM(list, draw_list_initialize(ROBOT_NODES), error, exit1);
 
-	IF_ERROR_GOTO
-	(
-		point_model_initialize(models + 5, (double[]) { 0.0, 0.0, 0.0 }, (double[]) { 0.0, 0.0, ur[3][2] }), error, exit5
-	);
+	IF_ERROR_GOTO(robot_draw(&robot, list), error, exit2);
 
-	matrix_t *initial_transform;
-	INITIALIZE_OR_OUT_OF_MEM(initial_transform, translation_matrix(0, 0, 0), error, exit6);
-	IF_ERROR_GOTO(hierarchical_draw(models + 0, initial_transform), error, exit7);
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(STDOUT_FILENO, args.precision), error, exit2);
+	if (!(error = draw_list_emit(list, writer)))
+	{
+		error = writer_flush(writer);
+	}
 
-exit7:
-	matrix_uninitialize(initial_transform);
-exit6:
-	point_model_uninitialize(models + 5);
-exit5:
-	cuboid_model_uninitialize(models + 4);
-exit4:
-	cuboid_model_uninitialize(models + 3);
-exit3:
-	cuboid_model_uninitialize(models + 2);
+	writer_uninitialize(writer);
 exit2:
-	cuboid_model_uninitialize(models + 1);
+	draw_list_uninitialize(list);
 exit1:
-	point_model_uninitialize(models + 0);
+	robot_uninitialize(&robot);
 exit0:
 	return error;
 }
@@ -240,13 +82,44 @@ status_t parse_args(int argc, char **argv, args_t *args)
 	args->l1 = 4.0;
 	args->l2 = 3.0;
 	args->l3 = 2.5;
+	args->keyframes = NULL;
+	args->prefix = NULL;
+	args->num_frames = 100;
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	args->num_threads = procs > 0 ? procs : 1;
+	args->precision = WRITER_DEFAULT_PRECISION;
 
 	char opt;
-	while ((opt = getopt(argc, argv, "t:u:v:l:m:n:")) > 0)
+	while ((opt = getopt(argc, argv, "t:u:v:l:m:n:k:f:j:o:p:")) > 0)
 	{
 		double *arg;
 		switch (opt)
 		{
+			case 'k':
+				args->keyframes = optarg;
+				continue;
+			case 'o':
+				args->prefix = optarg;
+				continue;
+			case 'f':
+			case 'j':
+			{
+				char *end;
+				long *count = opt == 'f' ? &args->num_frames : &args->num_threads;
+				*count = strtol(optarg, &end, 10);
+				if (*count < 1 || *end != '\0')
+				{
+					return ARGS_ERROR;
+				}
+				continue;
+			}
+			case 'p':
+				if (writer_parse_precision(optarg, &args->precision))
+				{
+					return ARGS_ERROR;
+				}
+				continue;
+
 			case 't':
 				arg = &args->theta1;
 				break;
@@ -292,5 +165,34 @@ void usage(char *prog)
 	fprintf(stderr,
 		"usage: %s\n"
 		"	[-t theta 1] [-u theta 2] [-v theta 3]\n"
-		"	[-l length 1] [-m length 2] [-n length 3]\n", prog);
+		"	[-l length 1] [-m length 2] [-n length 3] [-p output precision]\n"
+		"	[-k keyframe file [-f number of frames] [-j number of threads] [-o output prefix]]\n", prog);
+}
+
+status_t animate(args_t *args)
+{
+	status_t error = SUCCESS;
+
+	FILE *file;
+	if ((file = fopen(args->keyframes, "r")) == NULL)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args->keyframes);
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	keyframes_t keys;
+	IF_ERROR_GOTO(keyframes_read(file, &keys), error, exit1);
+
+	double lengths[ROBOT_JOINTS] = { args->l1, args->l2, args->l3 };
+	if ((error = animation_render(lengths, &keys, args->num_frames, args->num_threads, args->prefix, args->precision)))
+	{
+		fprintf(stderr, "ERROR: could not render the animation\n");
+	}
+
+	keyframes_uninitialize(&keys);
+exit1:
+	fclose(file);
+exit0:
+	return error;
 }
@@ -103,6 +103,11 @@ void matrix_assign_from_array(matrix_t *m, double *array)
 	memcpy(m->elems, array, m->rows * m->cols * sizeof *m->elems);
 }
 
+void matrix_copy_to_array(matrix_t *m, double *array)
+{
+	memcpy(array, m->elems, m->rows * m->cols * sizeof *m->elems);
+}
+
 void matrix_assign(matrix_t *dst, matrix_t *src)
 {
 	memcpy(dst->elems, src->elems, dst->rows * dst->cols * sizeof *dst->elems);
@@ -157,6 +162,11 @@ static void matrix_multiply_internal(double *c, double *a, double *b, size_t aro
 	}
 }
 
+void matrix_multiply_array(double *c, double *a, double *b, size_t arows, size_t acols, size_t bcols)
+{
+	matrix_multiply_internal(c, a, b, arows, acols, bcols);
+}
+
 void matrix_multiply(matrix_t *cm, matrix_t *am, matrix_t *bm)
 {
 	matrix_multiply_internal(cm->elems, am->elems, bm->elems, am->rows, am->cols, bm->cols);
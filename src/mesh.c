@@ -1,8 +1,20 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "mesh.h"
 
 #include "mesh_face_vec.h"
+#include "mesh_slices.h"
 #include "point3d_vec.h"
 #include "status.h"
+#include "writer.h"
 
 #define MALLOC_OR_GOTO(obj, errvar, label)\
 	do\
@@ -14,6 +26,16 @@
 		}\
 	} while (0)
 
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Binary meshes are written in host order.");
+
+//Number of vertices or faces encoded into a local block before each is handed to the writer
+#define EXPORT_BLOCK 1024
+#define PLY_FACE_SIZE (1 + 3 * sizeof(int32_t))
+#define STL_HEADER_SIZE 80
+#define STL_FACE_SIZE (12 * sizeof(float) + sizeof(uint16_t))
+//Fewest vertices, normals, or faces worth handing to another thread
+#define MESH_MIN_SLICE (1 << 16)
+
 mesh_t *mesh_initialize(void)
 {
 	mesh_t *mesh;
@@ -302,16 +324,97 @@ exit0:
 	return error;
 }
 
-void mesh_print_to_iv(mesh_t *mesh, FILE *stream)
-{
-	fprintf(stream,
+static const char iv_begin_points_text[] =
 "Separator {\n\
 	ShapeHints {\n\
 		vertexOrdering	COUNTERCLOCKWISE\n\
 	}\n\
 \n\
 	Coordinate3 {\n\
-		point [\n");
+		point [\n";
+
+static const char iv_end_points_text[] =
+"		]\n\
+	}\n\
+\n";
+
+static const char iv_begin_normals_text[] =
+"	NormalBinding {\n\
+		value        PER_VERTEX_INDEXED\n\
+	}\n\
+\n\
+	Normal {\n\
+		vector [\n";
+
+static const char iv_end_normals_text[] =
+"		]\n\
+	}\n";
+
+static const char iv_begin_faces_text[] =
+"	IndexedFaceSet {\n\
+		coordIndex [\n";
+
+static const char iv_begin_strips_text[] =
+"	IndexedTriangleStripSet {\n\
+		coordIndex [\n";
+
+static const char iv_end_faces_text[] =
+"		]\n\
+	}\n\
+}\n";
+
+static void iv_begin_points(writer_t *writer)
+{
+	writer_string(writer, iv_begin_points_text);
+}
+
+static void iv_end_points(writer_t *writer)
+{
+	writer_string(writer, iv_end_points_text);
+}
+
+static void iv_begin_normals(writer_t *writer)
+{
+	writer_string(writer, iv_begin_normals_text);
+}
+
+static void iv_end_normals(writer_t *writer)
+{
+	writer_string(writer, iv_end_normals_text);
+}
+
+static void iv_vector(writer_t *writer, point3d_t *vector)
+{
+	writer_string(writer, "			");
+	writer_point(writer, vector->x, vector->y, vector->z);
+	writer_string(writer, ",\n");
+}
+
+static void iv_begin_faces(writer_t *writer)
+{
+	writer_string(writer, iv_begin_faces_text);
+}
+
+static void iv_face(writer_t *writer, mesh_face_t *face)
+{
+	writer_string(writer, "			");
+	writer_size(writer, face->vertices[0]);
+	writer_string(writer, ", ");
+	writer_size(writer, face->vertices[1]);
+	writer_string(writer, ", ");
+	writer_size(writer, face->vertices[2]);
+	writer_string(writer, ", -1,\n");
+}
+
+static void iv_end_faces(writer_t *writer)
+{
+	writer_string(writer, iv_end_faces_text);
+}
+
+//Writes the points of the mesh, and its normals if it has any
+static void iv_vertices(mesh_t *mesh, writer_t *writer)
+{
+	iv_begin_points(writer);
 
 	size_t i;
 
@@ -319,55 +422,3154 @@ void mesh_print_to_iv(mesh_t *mesh, FILE *stream)
 	size_t num_points = point3d_vec_size(mesh->points);
 	for (i = 0; i < num_points; i++)
 	{
-		point3d_t *point = point3d_vec_get(points, i);
-		fprintf(stream,
-"			%lf %lf %lf,\n", point->x, point->y, point->z);
+		iv_vector(writer, point3d_vec_get(points, i));
 	}
 
-	fprintf(stream,
-"		]\n\
-	}\n\
-\n");
+	iv_end_points(writer);
 
 	size_t num_normals = point3d_vec_size(mesh->normals);
 	if (num_normals > 0)
 	{
-		fprintf(stream,
-"	NormalBinding {\n\
-		value        PER_VERTEX_INDEXED\n\
-	}\n\
-\n\
-	Normal {\n\
-		vector [\n");
+		iv_begin_normals(writer);
 
 		for (i = 0; i < num_normals; i++)
 		{
-			point3d_t *normal = point3d_vec_get(mesh->normals, i);
-			fprintf(stream,
-"			%lf %lf %lf,\n", normal->x, normal->y, normal->z);
+			iv_vector(writer, point3d_vec_get(mesh->normals, i));
 		}
 
-		fprintf(stream,
-"		]\n\
-	}\n");
-
+		iv_end_normals(writer);
 	}
+}
 
-	fprintf(stream,
-"	IndexedFaceSet {\n\
-		coordIndex [\n");
+void mesh_print_to_iv(mesh_t *mesh, writer_t *writer)
+{
+	iv_vertices(mesh, writer);
 
+	iv_begin_faces(writer);
+
+	size_t i;
 	mesh_face_vec_t *faces = mesh->faces;
 	size_t num_faces = mesh_face_vec_size(faces);
 	for (i = 0; i < num_faces; i++)
+	{
+		iv_face(writer, mesh_face_vec_get(faces, i));
+	}
+
+	iv_end_faces(writer);
+}
+
+void mesh_print_strips_to_iv(mesh_t *mesh, mesh_strips_t *strips, writer_t *writer)
+{
+	iv_vertices(mesh, writer);
+
+	writer_string(writer, iv_begin_strips_text);
+
+	//Each strip goes on a line of its own
+	uint8_t line_started = 0;
+	size_t i;
+	for (i = 0; i < strips->num_indices; i++)
+	{
+		writer_string(writer, line_started ? ", " : "			");
+		if (strips->indices[i] == MESH_STRIP_END)
+		{
+			writer_string(writer, "-1,\n");
+			line_started = 0;
+			continue;
+		}
+
+		writer_size(writer, strips->indices[i]);
+		line_started = 1;
+	}
+
+	iv_end_faces(writer);
+}
+
+void mesh_run_slices(void *slices, size_t slice_size, size_t num_slices, void *(*work)(void *))
+{
+	char *base = slices;
+	pthread_t *threads = NULL;
+	uint8_t *started = NULL;
+	if (num_slices > 1 &&
+		((threads = malloc(num_slices * sizeof *threads)) == NULL ||
+		(started = calloc(num_slices, sizeof *started)) == NULL))
+	{
+		//Without room to track the threads, everything runs right here
+		free(threads);
+		threads = NULL;
+	}
+
+	size_t i;
+	for (i = 1; i < num_slices && started != NULL; i++)
+	{
+		started[i] = pthread_create(threads + i, NULL, work, base + i * slice_size) == 0;
+	}
+
+	work(base);
+	for (i = 1; i < num_slices; i++)
+	{
+		if (started != NULL && started[i])
+		{
+			pthread_join(threads[i], NULL);
+		}
+		else
+		{
+			work(base + i * slice_size);
+		}
+	}
+
+	free(started);
+	free(threads);
+}
+
+/*
+ * count_slices - decides how many slices to split some work into
+ * @param num_items   - the number of items of work
+ * @param num_threads - the most threads to use
+ * @return - enough slices that each has at least MESH_MIN_SLICE items, but at most num_threads
+ */
+static size_t count_slices(size_t num_items, size_t num_threads)
+{
+	size_t num_slices = num_items / MESH_MIN_SLICE + 1;
+	if (num_slices > num_threads)
+	{
+		num_slices = num_threads > 0 ? num_threads : 1;
+	}
+
+	return num_slices;
+}
+
+//The widest a coordinate gets among some vectors, gathered before the layout is fixed
+typedef struct
+{
+	double magnitude;
+	uint8_t negative;
+	size_t special_length;
+} vector_extent_t;
+
+//Where each section of the output goes in the mapping and how wide its fields are
+typedef struct
+{
+	mesh_t *mesh;
+	int precision;
+	size_t point_width;
+	size_t normal_width;
+	size_t index_width;
+	char *points;
+	char *normals;
+	char *faces;
+} iv_layout_t;
+
+//The vertices, normals, and faces handled by one thread
+typedef struct
+{
+	iv_layout_t *layout;
+	size_t points_begin;
+	size_t points_end;
+	size_t normals_begin;
+	size_t normals_end;
+	size_t faces_begin;
+	size_t faces_end;
+	vector_extent_t point_extent;
+	vector_extent_t normal_extent;
+} iv_slice_t;
+
+static void extend_extent(vector_extent_t *extent, double value, int precision)
+{
+	if (isfinite(value))
+	{
+		double magnitude = fabs(value);
+		if (magnitude > extent->magnitude)
+		{
+			extent->magnitude = magnitude;
+		}
+		extent->negative |= signbit(value) != 0;
+	}
+	else
+	{
+		size_t length = writer_double_length(value, precision);
+		if (length > extent->special_length)
+		{
+			extent->special_length = length;
+		}
+	}
+}
+
+static void measure_vectors(point3d_vec_t *vectors, size_t begin, size_t end, int precision, vector_extent_t *extent)
+{
+	size_t i;
+	for (i = begin; i < end; i++)
+	{
+		point3d_t *vector = point3d_vec_get(vectors, i);
+		extend_extent(extent, vector->x, precision);
+		extend_extent(extent, vector->y, precision);
+		extend_extent(extent, vector->z, precision);
+	}
+}
+
+static void *measure_slice(void *arg)
+{
+	iv_slice_t *slice = arg;
+	mesh_t *mesh = slice->layout->mesh;
+	int precision = slice->layout->precision;
+	measure_vectors(mesh->points, slice->points_begin, slice->points_end, precision, &slice->point_extent);
+	measure_vectors(mesh->normals, slice->normals_begin, slice->normals_end, precision, &slice->normal_extent);
+	return NULL;
+}
+
+static void merge_extent(vector_extent_t *total, vector_extent_t *extent)
+{
+	if (extent->magnitude > total->magnitude)
+	{
+		total->magnitude = extent->magnitude;
+	}
+	total->negative |= extent->negative;
+	if (extent->special_length > total->special_length)
+	{
+		total->special_length = extent->special_length;
+	}
+}
+
+//Since the length of a formatted number only grows with its magnitude, the largest one plus a sign
+//bounds every field
+static size_t extent_width(vector_extent_t *extent, int precision)
+{
+	size_t width = writer_double_length(extent->magnitude, precision) + extent->negative;
+	return width > extent->special_length ? width : extent->special_length;
+}
+
+static size_t vector_line_length(size_t width)
+{
+	return 3 + 3 * width + 2 + 2;
+}
+
+static size_t face_line_length(size_t width)
+{
+	return 3 + 3 * width + 2 + 2 + 6;
+}
+
+static void format_vectors(point3d_vec_t *vectors, size_t begin, size_t end, int precision, size_t width, char *out)
+{
+	char *p = out + begin * vector_line_length(width);
+	size_t i;
+	for (i = begin; i < end; i++)
+	{
+		point3d_t *vector = point3d_vec_get(vectors, i);
+		memcpy(p, "			", 3);
+		p += 3;
+		writer_format_double(p, vector->x, precision, width);
+		p += width;
+		*p++ = ' ';
+		writer_format_double(p, vector->y, precision, width);
+		p += width;
+		*p++ = ' ';
+		writer_format_double(p, vector->z, precision, width);
+		p += width;
+		memcpy(p, ",\n", 2);
+		p += 2;
+	}
+}
+
+static void format_faces(mesh_face_vec_t *faces, size_t begin, size_t end, size_t width, char *out)
+{
+	char *p = out + begin * face_line_length(width);
+	size_t i;
+	for (i = begin; i < end; i++)
 	{
 		mesh_face_t *face = mesh_face_vec_get(faces, i);
-		fprintf(stream,
-"			%zu, %zu, %zu, -1,\n", face->vertices[0], face->vertices[1], face->vertices[2]);
+		memcpy(p, "			", 3);
+		p += 3;
+		writer_format_size(p, face->vertices[0], width);
+		p += width;
+		memcpy(p, ", ", 2);
+		p += 2;
+		writer_format_size(p, face->vertices[1], width);
+		p += width;
+		memcpy(p, ", ", 2);
+		p += 2;
+		writer_format_size(p, face->vertices[2], width);
+		p += width;
+		memcpy(p, ", -1,\n", 6);
+		p += 6;
 	}
-	fprintf(stream,
-"		]\n\
-	}\n\
-}\n");
 }
 
+static void *format_slice(void *arg)
+{
+	iv_slice_t *slice = arg;
+	iv_layout_t *layout = slice->layout;
+	mesh_t *mesh = layout->mesh;
+	format_vectors(mesh->points, slice->points_begin, slice->points_end, layout->precision, layout->point_width, layout->points);
+	format_vectors(mesh->normals, slice->normals_begin, slice->normals_end, layout->precision, layout->normal_width, layout->normals);
+	format_faces(mesh->faces, slice->faces_begin, slice->faces_end, layout->index_width, layout->faces);
+	return NULL;
+}
+
+static char *put_text(char *p, const char *text, size_t length)
+{
+	memcpy(p, text, length);
+	return p + length;
+}
+
+status_t mesh_write_iv_mapped(mesh_t *mesh, int fd, int precision, size_t num_threads)
+{
+	status_t error = SUCCESS;
+
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_normals = point3d_vec_size(mesh->normals);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	size_t num_slices = count_slices(num_points + num_normals + num_faces, num_threads);
+
+	iv_slice_t *slices;
+	INITIALIZE_OR_OUT_OF_MEM(slices, calloc(num_slices, sizeof *slices), error, exit0);
+
+	iv_layout_t layout = { .mesh = mesh, .precision = precision };
+	size_t i;
+	for (i = 0; i < num_slices; i++)
+	{
+		slices[i].layout = &layout;
+		slices[i].points_begin = num_points * i / num_slices;
+		slices[i].points_end = num_points * (i + 1) / num_slices;
+		slices[i].normals_begin = num_normals * i / num_slices;
+		slices[i].normals_end = num_normals * (i + 1) / num_slices;
+		slices[i].faces_begin = num_faces * i / num_slices;
+		slices[i].faces_end = num_faces * (i + 1) / num_slices;
+	}
+
+	mesh_run_slices(slices, sizeof *slices, num_slices, measure_slice);
+
+	vector_extent_t point_extent = { 0 };
+	vector_extent_t normal_extent = { 0 };
+	for (i = 0; i < num_slices; i++)
+	{
+		merge_extent(&point_extent, &slices[i].point_extent);
+		merge_extent(&normal_extent, &slices[i].normal_extent);
+	}
+	layout.point_width = extent_width(&point_extent, precision);
+	layout.normal_width = extent_width(&normal_extent, precision);
+	layout.index_width = writer_size_length(num_points > 0 ? num_points - 1 : 0);
+
+	size_t size = sizeof iv_begin_points_text - 1
+		+ num_points * vector_line_length(layout.point_width)
+		+ sizeof iv_end_points_text - 1
+		+ sizeof iv_begin_faces_text - 1
+		+ num_faces * face_line_length(layout.index_width)
+		+ sizeof iv_end_faces_text - 1;
+	if (num_normals > 0)
+	{
+		size += sizeof iv_begin_normals_text - 1
+			+ num_normals * vector_line_length(layout.normal_width)
+			+ sizeof iv_end_normals_text - 1;
+	}
+
+	//The mapping has to start on a page boundary, so it covers whatever the file already holds
+	off_t offset;
+	if ((offset = lseek(fd, 0, SEEK_CUR)) < 0 ||
+		ftruncate(fd, offset + size) ||
+		//Claims the blocks up front so that a full disk is an error here rather than a SIGBUS later
+		posix_fallocate(fd, offset, size))
+	{
+		error = FILE_WRITE_ERROR;
+		goto exit1;
+	}
+
+	size_t mapping_size = offset + size;
+	char *mapping;
+	if ((mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		error = FILE_WRITE_ERROR;
+		goto exit1;
+	}
+
+	char *p = mapping + offset;
+	p = put_text(p, iv_begin_points_text, sizeof iv_begin_points_text - 1);
+	layout.points = p;
+	p += num_points * vector_line_length(layout.point_width);
+	p = put_text(p, iv_end_points_text, sizeof iv_end_points_text - 1);
+	if (num_normals > 0)
+	{
+		p = put_text(p, iv_begin_normals_text, sizeof iv_begin_normals_text - 1);
+		layout.normals = p;
+		p += num_normals * vector_line_length(layout.normal_width);
+		p = put_text(p, iv_end_normals_text, sizeof iv_end_normals_text - 1);
+	}
+	p = put_text(p, iv_begin_faces_text, sizeof iv_begin_faces_text - 1);
+	layout.faces = p;
+	p += num_faces * face_line_length(layout.index_width);
+	put_text(p, iv_end_faces_text, sizeof iv_end_faces_text - 1);
+
+	mesh_run_slices(slices, sizeof *slices, num_slices, format_slice);
+
+	if (munmap(mapping, mapping_size) || lseek(fd, mapping_size, SEEK_SET) < 0)
+	{
+		error = FILE_WRITE_ERROR;
+	}
+
+exit1:
+	free(slices);
+exit0:
+	return error;
+}
+
+static char *put_float(char *p, double value)
+{
+	float f = value;
+	memcpy(p, &f, sizeof f);
+	return p + sizeof f;
+}
+
+static void ply_begin_header(writer_t *writer, size_t num_points, uint8_t has_normals)
+{
+	writer_string(writer, "ply\nformat binary_little_endian 1.0\nelement vertex ");
+	writer_size(writer, num_points);
+	writer_string(writer, "\nproperty float x\nproperty float y\nproperty float z\n");
+	if (has_normals)
+	{
+		writer_string(writer, "property float nx\nproperty float ny\nproperty float nz\n");
+	}
+}
+
+static void ply_header(writer_t *writer, size_t num_points, size_t num_faces, uint8_t has_normals)
+{
+	ply_begin_header(writer, num_points, has_normals);
+	writer_string(writer, "element face ");
+	writer_size(writer, num_faces);
+	writer_string(writer, "\nproperty list uchar int vertex_indices\nend_header\n");
+}
+
+static char *ply_vertex(char *p, point3d_t *point, point3d_t *normal)
+{
+	p = put_float(p, point->x);
+	p = put_float(p, point->y);
+	p = put_float(p, point->z);
+	if (normal != NULL)
+	{
+		p = put_float(p, normal->x);
+		p = put_float(p, normal->y);
+		p = put_float(p, normal->z);
+	}
+
+	return p;
+}
+
+static char *ply_face(char *p, mesh_face_t *face)
+{
+	int32_t indices[3] = { face->vertices[0], face->vertices[1], face->vertices[2] };
+	*p++ = 3;
+	memcpy(p, indices, sizeof indices);
+	return p + sizeof indices;
+}
+
+static void ply_vertices(mesh_t *mesh, uint8_t has_normals, writer_t *writer)
+{
+	point3d_vec_t *points = mesh->points;
+	point3d_vec_t *normals = mesh->normals;
+	size_t num_points = point3d_vec_size(points);
+
+	char block[EXPORT_BLOCK * 6 * sizeof(float)];
+	size_t i, j;
+	for (i = 0; i < num_points; i += EXPORT_BLOCK)
+	{
+		size_t end = i + EXPORT_BLOCK < num_points ? i + EXPORT_BLOCK : num_points;
+		char *p = block;
+		for (j = i; j < end; j++)
+		{
+			p = ply_vertex(p, point3d_vec_get(points, j), has_normals ? point3d_vec_get(normals, j) : NULL);
+		}
+		writer_bytes(writer, block, p - block);
+	}
+}
+
+void mesh_print_to_ply(mesh_t *mesh, writer_t *writer)
+{
+	mesh_face_vec_t *faces = mesh->faces;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(faces);
+	uint8_t has_normals = point3d_vec_size(mesh->normals) == num_points && num_points > 0;
+
+	ply_header(writer, num_points, num_faces, has_normals);
+	ply_vertices(mesh, has_normals, writer);
+
+	char block[EXPORT_BLOCK * PLY_FACE_SIZE];
+	size_t i, j;
+	for (i = 0; i < num_faces; i += EXPORT_BLOCK)
+	{
+		size_t end = i + EXPORT_BLOCK < num_faces ? i + EXPORT_BLOCK : num_faces;
+		char *p = block;
+		for (j = i; j < end; j++)
+		{
+			p = ply_face(p, mesh_face_vec_get(faces, j));
+		}
+		writer_bytes(writer, block, p - block);
+	}
+}
+
+void mesh_print_strips_to_ply(mesh_t *mesh, mesh_strips_t *strips, writer_t *writer)
+{
+	size_t num_points = point3d_vec_size(mesh->points);
+	uint8_t has_normals = point3d_vec_size(mesh->normals) == num_points && num_points > 0;
+
+	//All of the strips form a single list, in the tristrips element of the Stanford tools, with
+	//-1 between each strip and the next
+	size_t num_indices = strips->num_indices > 0 ? strips->num_indices - 1 : 0;
+	ply_begin_header(writer, num_points, has_normals);
+	writer_string(writer, "element tristrips 1\nproperty list int int vertex_indices\nend_header\n");
+	ply_vertices(mesh, has_normals, writer);
+
+	int32_t block[EXPORT_BLOCK];
+	block[0] = num_indices;
+	size_t count = 1;
+	size_t i;
+	for (i = 0; i < num_indices; i++)
+	{
+		block[count++] = strips->indices[i] == MESH_STRIP_END ? -1 : (int32_t) strips->indices[i];
+		if (count == EXPORT_BLOCK)
+		{
+			writer_bytes(writer, (char *) block, sizeof block);
+			count = 0;
+		}
+	}
+	writer_bytes(writer, (char *) block, count * sizeof *block);
+}
+
+static void stl_header(writer_t *writer, size_t num_faces)
+{
+	char header[STL_HEADER_SIZE] = "binary STL";
+	uint32_t count = num_faces;
+	writer_bytes(writer, header, sizeof header);
+	writer_bytes(writer, (char *) &count, sizeof count);
+}
+
+static char *stl_face(char *p, point3d_t *a, point3d_t *b, point3d_t *c)
+{
+	//STL only has facet normals, so they come from the winding rather than mesh->normals
+	double ux = b->x - a->x, uy = b->y - a->y, uz = b->z - a->z;
+	double vx = c->x - a->x, vy = c->y - a->y, vz = c->z - a->z;
+	double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+	double length = sqrt(nx * nx + ny * ny + nz * nz);
+	if (length > 0.0)
+	{
+		nx /= length;
+		ny /= length;
+		nz /= length;
+	}
+
+	p = put_float(p, nx);
+	p = put_float(p, ny);
+	p = put_float(p, nz);
+	p = ply_vertex(p, a, NULL);
+	p = ply_vertex(p, b, NULL);
+	p = ply_vertex(p, c, NULL);
+
+	uint16_t attributes = 0;
+	memcpy(p, &attributes, sizeof attributes);
+	return p + sizeof attributes;
+}
+
+void mesh_print_to_stl(mesh_t *mesh, writer_t *writer)
+{
+	point3d_vec_t *points = mesh->points;
+	mesh_face_vec_t *faces = mesh->faces;
+	size_t num_faces = mesh_face_vec_size(faces);
+
+	stl_header(writer, num_faces);
+
+	char block[EXPORT_BLOCK * STL_FACE_SIZE];
+	size_t i, j;
+	for (i = 0; i < num_faces; i += EXPORT_BLOCK)
+	{
+		size_t end = i + EXPORT_BLOCK < num_faces ? i + EXPORT_BLOCK : num_faces;
+		char *p = block;
+		for (j = i; j < end; j++)
+		{
+			mesh_face_t *face = mesh_face_vec_get(faces, j);
+			p = stl_face
+			(
+				p,
+				point3d_vec_get(points, face->vertices[0]),
+				point3d_vec_get(points, face->vertices[1]),
+				point3d_vec_get(points, face->vertices[2])
+			);
+		}
+		writer_bytes(writer, block, p - block);
+	}
+}
+
+size_t mesh_source_num_rows(mesh_source_t *source)
+{
+	return source->topology == MESH_TOPOLOGY_GRID ? source->num_u : source->num_v;
+}
+
+size_t mesh_source_num_points(mesh_source_t *source)
+{
+	if (source->topology == MESH_TOPOLOGY_GRID)
+	{
+		return source->num_u * source->num_v;
+	}
+
+	//The two poles plus the num_v - 2 rings in between, each of num_u - 1 distinct points
+	return 2 + (source->num_v - 2) * (source->num_u - 1);
+}
+
+size_t mesh_source_num_faces(mesh_source_t *source)
+{
+	if (source->topology == MESH_TOPOLOGY_GRID)
+	{
+		return 2 * (source->num_u - 1) * (source->num_v - 1);
+	}
+
+	//Each fan contributes num_u - 1 triangles and each band between rings twice that
+	return 2 * (source->num_u - 1) * (source->num_v - 2);
+}
+
+size_t mesh_source_max_row_size(mesh_source_t *source)
+{
+	return source->topology == MESH_TOPOLOGY_GRID ? source->num_v : source->num_u - 1;
+}
+
+size_t mesh_source_row_size(mesh_source_t *source, size_t row)
+{
+	if (source->topology == MESH_TOPOLOGY_GRID)
+	{
+		return source->num_v;
+	}
+
+	return row == 0 || row == source->num_v - 1 ? 1 : source->num_u - 1;
+}
+
+size_t mesh_source_row_start(mesh_source_t *source, size_t row)
+{
+	if (source->topology == MESH_TOPOLOGY_GRID)
+	{
+		return row * source->num_v;
+	}
+
+	return row == 0 ? 0 : 1 + (row - 1) * (source->num_u - 1);
+}
+
+static void set_face(mesh_face_t *face, size_t a, size_t b, size_t c)
+{
+	face->vertices[0] = a;
+	face->vertices[1] = b;
+	face->vertices[2] = c;
+}
+
+/*
+ * band_faces - computes, in closed form, the faces between row band - 1 and row band, in the same
+ * order and with the same windings as mesh_calculate_faces and mesh_calculate_sellipsoid_faces
+ * @param source - the source whose topology and dimensions define the faces
+ * @param band - the index of the second of the two rows, at least 1
+ * @param faces - out param; must hold 2 * mesh_source_max_row_size(source) faces
+ * @return - the number of faces written
+ */
+static size_t band_faces(mesh_source_t *source, size_t band, mesh_face_t *faces)
+{
+	size_t num = 0;
+	size_t i;
+
+	if (source->topology == MESH_TOPOLOGY_GRID)
+	{
+		size_t per = source->num_v;
+		size_t start = (band - 1) * per;
+		for (i = 0; i < per - 1; i++)
+		{
+			size_t curr = start + i;
+			set_face(faces + num++, curr + per, curr + per + 1, curr + 1);
+			set_face(faces + num++, curr + per, curr + 1, curr);
+		}
+
+		return num;
+	}
+
+	size_t per = source->num_u - 1;
+	if (band == 1)
+	{
+		for (i = 0; i < per - 1; i++)
+		{
+			set_face(faces + num++, i + 1, i + 2, 0);
+		}
+		set_face(faces + num++, per, 1, 0);
+	}
+	else if (band == source->num_v - 1)
+	{
+		size_t last = mesh_source_num_points(source) - 1;
+		for (i = 0; i < per - 1; i++)
+		{
+			set_face(faces + num++, last, last - (i + 1), last - (i + 2));
+		}
+		set_face(faces + num++, last, last - per, last - 1);
+	}
+	else
+	{
+		size_t start = mesh_source_row_start(source, band - 1);
+		for (i = 0; i < per; i++)
+		{
+			//The last point of each ring wraps around to the first
+			size_t curr = start + i;
+			size_t next = start + (i + 1) % per;
+			set_face(faces + num++, curr + per, next + per, next);
+			set_face(faces + num++, curr + per, next, curr);
+		}
+	}
+
+	return num;
+}
+
+status_t mesh_stream_to_iv(mesh_source_t *source, writer_t *writer)
+{
+	status_t error = SUCCESS;
+
+	size_t num_rows = mesh_source_num_rows(source);
+	size_t max_size = mesh_source_max_row_size(source);
+
+	point3d_t *row;
+	if ((row = malloc(max_size * sizeof *row)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit0;
+	}
+
+	mesh_face_t *faces;
+	if ((faces = malloc(2 * max_size * sizeof *faces)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit1;
+	}
+
+	size_t r, i;
+
+	iv_begin_points(writer);
+	source->rewind(source);
+	for (r = 0; r < num_rows; r++)
+	{
+		IF_ERROR_GOTO(source->next_row(source, row, NULL), error, exit2);
+		size_t size = mesh_source_row_size(source, r);
+		for (i = 0; i < size; i++)
+		{
+			iv_vector(writer, row + i);
+		}
+	}
+
+	iv_end_points(writer);
+
+	if (source->has_normals)
+	{
+		iv_begin_normals(writer);
+		source->rewind(source);
+		for (r = 0; r < num_rows; r++)
+		{
+			IF_ERROR_GOTO(source->next_row(source, NULL, row), error, exit2);
+			size_t size = mesh_source_row_size(source, r);
+			for (i = 0; i < size; i++)
+			{
+				iv_vector(writer, row + i);
+			}
+		}
+
+		iv_end_normals(writer);
+	}
+
+	iv_begin_faces(writer);
+	for (r = 1; r < num_rows; r++)
+	{
+		size_t num_faces = band_faces(source, r, faces);
+		for (i = 0; i < num_faces; i++)
+		{
+			iv_face(writer, faces + i);
+		}
+	}
+	iv_end_faces(writer);
+
+	error = writer_error(writer);
+
+exit2:
+	free(faces);
+exit1:
+	free(row);
+exit0:
+	return error;
+}
+
+status_t mesh_stream_to_ply(mesh_source_t *source, writer_t *writer)
+{
+	status_t error = SUCCESS;
+
+	size_t num_rows = mesh_source_num_rows(source);
+	size_t max_size = mesh_source_max_row_size(source);
+	uint8_t has_normals = source->has_normals;
+
+	point3d_t *row;
+	if ((row = malloc(2 * max_size * sizeof *row)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit0;
+	}
+	point3d_t *normals = has_normals ? row + max_size : NULL;
+
+	mesh_face_t *faces;
+	if ((faces = malloc(2 * max_size * sizeof *faces)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit1;
+	}
+
+	ply_header(writer, mesh_source_num_points(source), mesh_source_num_faces(source), has_normals);
+
+	char block[EXPORT_BLOCK * 6 * sizeof(float)];
+	size_t r, i, j;
+	source->rewind(source);
+	for (r = 0; r < num_rows; r++)
+	{
+		IF_ERROR_GOTO(source->next_row(source, row, normals), error, exit2);
+		size_t size = mesh_source_row_size(source, r);
+		for (i = 0; i < size; i += EXPORT_BLOCK)
+		{
+			size_t end = i + EXPORT_BLOCK < size ? i + EXPORT_BLOCK : size;
+			char *p = block;
+			for (j = i; j < end; j++)
+			{
+				p = ply_vertex(p, row + j, has_normals ? normals + j : NULL);
+			}
+			writer_bytes(writer, block, p - block);
+		}
+	}
+
+	for (r = 1; r < num_rows; r++)
+	{
+		size_t num_faces = band_faces(source, r, faces);
+		for (i = 0; i < num_faces; i += EXPORT_BLOCK)
+		{
+			size_t end = i + EXPORT_BLOCK < num_faces ? i + EXPORT_BLOCK : num_faces;
+			char *p = block;
+			for (j = i; j < end; j++)
+			{
+				p = ply_face(p, faces + j);
+			}
+			writer_bytes(writer, block, p - block);
+		}
+	}
+
+	error = writer_error(writer);
+
+exit2:
+	free(faces);
+exit1:
+	free(row);
+exit0:
+	return error;
+}
+
+status_t mesh_stream_to_stl(mesh_source_t *source, writer_t *writer)
+{
+	status_t error = SUCCESS;
+
+	size_t num_rows = mesh_source_num_rows(source);
+	size_t max_size = mesh_source_max_row_size(source);
+
+	//Every face spans two adjacent rows, so only those two are ever kept
+	point3d_t *prev;
+	if ((prev = malloc(2 * max_size * sizeof *prev)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit0;
+	}
+	point3d_t *rows = prev;
+	point3d_t *curr = prev + max_size;
+
+	mesh_face_t *faces;
+	if ((faces = malloc(2 * max_size * sizeof *faces)) == NULL)
+	{
+		error = OUT_OF_MEM;
+		goto exit1;
+	}
+
+	stl_header(writer, mesh_source_num_faces(source));
+
+	char block[EXPORT_BLOCK * STL_FACE_SIZE];
+	size_t r, i, j, k;
+	source->rewind(source);
+	IF_ERROR_GOTO(source->next_row(source, prev, NULL), error, exit2);
+	for (r = 1; r < num_rows; r++)
+	{
+		IF_ERROR_GOTO(source->next_row(source, curr, NULL), error, exit2);
+		size_t prev_start = mesh_source_row_start(source, r - 1);
+		size_t curr_start = mesh_source_row_start(source, r);
+
+		size_t num_faces = band_faces(source, r, faces);
+		for (i = 0; i < num_faces; i += EXPORT_BLOCK)
+		{
+			size_t end = i + EXPORT_BLOCK < num_faces ? i + EXPORT_BLOCK : num_faces;
+			char *p = block;
+			for (j = i; j < end; j++)
+			{
+				point3d_t *corners[3];
+				for (k = 0; k < 3; k++)
+				{
+					size_t index = faces[j].vertices[k];
+					corners[k] = index < curr_start ? prev + (index - prev_start) : curr + (index - curr_start);
+				}
+				p = stl_face(p, corners[0], corners[1], corners[2]);
+			}
+			writer_bytes(writer, block, p - block);
+		}
+
+		point3d_t *temp = prev;
+		prev = curr;
+		curr = temp;
+	}
+
+	error = writer_error(writer);
+
+exit2:
+	free(faces);
+exit1:
+	free(rows);
+exit0:
+	return error;
+}
+
+//Writes the whole mesh as the output asks, iv scenes starting with their header and anything the
+//program draws along with the mesh
+status_t mesh_print_output(mesh_t *mesh, mesh_output_t *output, int fd)
+{
+	status_t error = SUCCESS;
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(fd, output->precision), error, exit0);
+
+	mesh_strips_t strips;
+	if (output->strips)
+	{
+		IF_ERROR_GOTO(mesh_stripify(mesh, &strips), error, exit1);
+	}
+
+	switch (output->format)
+	{
+		case MESH_FORMAT_IV:
+			writer_string(writer, "#Inventor V2.0 ascii\n");
+			if (output->print_iv_scene != NULL)
+			{
+				output->print_iv_scene(output->scene, writer);
+			}
+			if (output->fixed_width)
+			{
+				//Everything before the mesh has to be in the file before the file is mapped
+				IF_ERROR_GOTO(writer_flush(writer), error, exit2);
+				IF_ERROR_GOTO(mesh_write_iv_mapped(mesh, fd, output->precision, output->num_threads), error, exit2);
+			}
+			else if (output->strips)
+			{
+				mesh_print_strips_to_iv(mesh, &strips, writer);
+			}
+			else
+			{
+				mesh_print_to_iv(mesh, writer);
+			}
+			break;
+		case MESH_FORMAT_PLY:
+			if (output->strips)
+			{
+				mesh_print_strips_to_ply(mesh, &strips, writer);
+			}
+			else
+			{
+				mesh_print_to_ply(mesh, writer);
+			}
+			break;
+		case MESH_FORMAT_STL:
+			mesh_print_to_stl(mesh, writer);
+			break;
+	}
+	error = writer_flush(writer);
+
+exit2:
+	if (output->strips)
+	{
+		mesh_strips_release(&strips);
+	}
+exit1:
+	writer_uninitialize(writer);
+exit0:
+	return error;
+}
+
+//Like mesh_print_output, a row of the source at a time; neither fixed-width output nor strips apply
+status_t mesh_stream_output(mesh_source_t *source, mesh_output_t *output, int fd)
+{
+	status_t error = SUCCESS;
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(fd, output->precision), error, exit0);
+
+	switch (output->format)
+	{
+		case MESH_FORMAT_IV:
+			writer_string(writer, "#Inventor V2.0 ascii\n");
+			if (output->print_iv_scene != NULL)
+			{
+				output->print_iv_scene(output->scene, writer);
+			}
+			error = mesh_stream_to_iv(source, writer);
+			break;
+		case MESH_FORMAT_PLY:
+			error = mesh_stream_to_ply(source, writer);
+			break;
+		case MESH_FORMAT_STL:
+			error = mesh_stream_to_stl(source, writer);
+			break;
+	}
+	IF_ERROR_GOTO(error, error, exit1);
+	error = writer_flush(writer);
+
+exit1:
+	writer_uninitialize(writer);
+exit0:
+	return error;
+}
+
+//Keeps welding cell indices, and their neighbours, well clear of overflow
+#define WELD_MAX_CELL 4e18
+#define NO_VERTEX SIZE_MAX
+
+/*
+ * weld_cell - finds the cell of the welding grid holding the coordinate
+ * @param coord     - the coordinate
+ * @param tolerance - the size of a cell; with 0, every distinct value gets its own cell
+ * @return - the index of the cell along the coordinate's axis
+ */
+static int64_t weld_cell(double coord, double tolerance)
+{
+	if (tolerance == 0.0)
+	{
+		//Adding 0 turns -0 into 0, so the two land in the same cell
+		double value = coord + 0.0;
+		int64_t bits;
+		memcpy(&bits, &value, sizeof bits);
+		return bits;
+	}
+
+	double cell = floor(coord / tolerance);
+	if (cell > WELD_MAX_CELL)
+	{
+		cell = WELD_MAX_CELL;
+	}
+	else if (cell < -WELD_MAX_CELL)
+	{
+		cell = -WELD_MAX_CELL;
+	}
+	return (int64_t) cell;
+}
+
+static size_t weld_bucket(int64_t x, int64_t y, int64_t z, size_t mask)
+{
+	uint64_t hash = (uint64_t) x * 0x9E3779B97F4A7C15ull ^ (uint64_t) y * 0xC2B2AE3D27D4EB4Full ^ (uint64_t) z * 0x165667B19E3779F9ull;
+	hash ^= hash >> 32;
+	return hash & mask;
+}
+
+static double distance_squared(point3d_t *a, point3d_t *b)
+{
+	double dx = a->x - b->x;
+	double dy = a->y - b->y;
+	double dz = a->z - b->z;
+	return dx * dx + dy * dy + dz * dz;
+}
+
+/*
+ * weld_find - looks through the cells around a point for a vertex already kept within the
+ * tolerance of it
+ * @param points    - the points of the mesh
+ * @param point     - the point to look for
+ * @param cell      - the cell holding the point
+ * @param tolerance - the largest distance at which two points are the same
+ * @param heads     - the first kept vertex in each bucket, or NO_VERTEX
+ * @param next      - the next kept vertex in the same bucket, by kept index, or NO_VERTEX
+ * @param first     - the index in points of each kept vertex
+ * @param mask      - one less than the number of buckets
+ * @return - the kept index of the match, or NO_VERTEX if there is none
+ */
+static size_t weld_find
+(
+	point3d_vec_t *points,
+	point3d_t *point,
+	int64_t cell[3],
+	double tolerance,
+	size_t *heads,
+	size_t *next,
+	size_t *first,
+	size_t mask
+)
+{
+	int reach = tolerance > 0.0 ? 1 : 0;
+	double limit = tolerance * tolerance;
+
+	int dx, dy, dz;
+	for (dx = -reach; dx <= reach; dx++)
+	{
+		for (dy = -reach; dy <= reach; dy++)
+		{
+			for (dz = -reach; dz <= reach; dz++)
+			{
+				size_t j = heads[weld_bucket(cell[0] + dx, cell[1] + dy, cell[2] + dz, mask)];
+				for (; j != NO_VERTEX; j = next[j])
+				{
+					if (distance_squared(point3d_vec_get(points, first[j]), point) <= limit)
+					{
+						return j;
+					}
+				}
+			}
+		}
+	}
+
+	return NO_VERTEX;
+}
+
+status_t mesh_weld(mesh_t *mesh, double tolerance)
+{
+	status_t error = SUCCESS;
+
+	point3d_vec_t *points = mesh->points;
+	point3d_vec_t *normals = mesh->normals;
+	mesh_face_vec_t *faces = mesh->faces;
+	size_t num_points = point3d_vec_size(points);
+	size_t num_faces = mesh_face_vec_size(faces);
+	uint8_t has_normals = point3d_vec_size(normals) == num_points && num_points > 0;
+
+	size_t num_buckets = 16;
+	while (num_buckets < 2 * num_points)
+	{
+		num_buckets *= 2;
+	}
+	size_t mask = num_buckets - 1;
+
+	//The scratch space is allocated up front, so running out of memory for it leaves the mesh
+	//untouched; growing the new vectors is not checked, as nowhere else in the tree is
+	size_t *heads;
+	size_t *next;
+	size_t *first;
+	size_t *remap;
+	point3d_t *sums = NULL;
+	point3d_vec_t *new_points;
+	point3d_vec_t *new_normals;
+	mesh_face_vec_t *new_faces;
+	INITIALIZE_OR_OUT_OF_MEM(heads, malloc(num_buckets * sizeof *heads), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(next, malloc((num_points + 1) * sizeof *next), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(first, malloc((num_points + 1) * sizeof *first), error, exit2);
+	INITIALIZE_OR_OUT_OF_MEM(remap, malloc((num_points + 1) * sizeof *remap), error, exit3);
+	if (has_normals)
+	{
+		INITIALIZE_OR_OUT_OF_MEM(sums, calloc(num_points, sizeof *sums), error, exit4);
+	}
+	INITIALIZE_OR_OUT_OF_MEM(new_points, point3d_vec_initialize(), error, exit5);
+	INITIALIZE_OR_OUT_OF_MEM(new_normals, point3d_vec_initialize(), error, exit6);
+	INITIALIZE_OR_OUT_OF_MEM(new_faces, mesh_face_vec_initialize(), error, exit7);
+
+	memset(heads, 0xff, num_buckets * sizeof *heads);
+
+	size_t num_kept = 0;
+	size_t i;
+	for (i = 0; i < num_points; i++)
+	{
+		point3d_t *point = point3d_vec_get(points, i);
+		size_t j = NO_VERTEX;
+		int64_t cell[3];
+
+		//Points that are not finite have no cell and are never welded
+		uint8_t finite = isfinite(point->x) && isfinite(point->y) && isfinite(point->z);
+		if (finite)
+		{
+			cell[0] = weld_cell(point->x, tolerance);
+			cell[1] = weld_cell(point->y, tolerance);
+			cell[2] = weld_cell(point->z, tolerance);
+			j = weld_find(points, point, cell, tolerance, heads, next, first, mask);
+		}
+
+		if (j == NO_VERTEX)
+		{
+			j = num_kept++;
+			first[j] = i;
+			next[j] = NO_VERTEX;
+			if (finite)
+			{
+				size_t bucket = weld_bucket(cell[0], cell[1], cell[2], mask);
+				next[j] = heads[bucket];
+				heads[bucket] = j;
+			}
+		}
+
+		remap[i] = j;
+		if (has_normals)
+		{
+			point3d_t *normal = point3d_vec_get(normals, i);
+			sums[j].x += normal->x;
+			sums[j].y += normal->y;
+			sums[j].z += normal->z;
+		}
+	}
+
+	for (i = 0; i < num_points; i++)
+	{
+		point3d_t *point = point3d_vec_get(points, i);
+		point3d_t *normal = has_normals ? point3d_vec_get(normals, i) : NULL;
+		size_t j = remap[i];
+		if (first[j] != i)
+		{
+			point3d_uninitialize(point);
+			if (normal != NULL)
+			{
+				point3d_uninitialize(normal);
+			}
+			continue;
+		}
+
+		point3d_vec_push_back(new_points, point);
+		if (normal != NULL)
+		{
+			//A vertex that stands for several takes the average of their normals, unless they
+			//cancel out
+			double length = sqrt(sums[j].x * sums[j].x + sums[j].y * sums[j].y + sums[j].z * sums[j].z);
+			if (length > 0.0 && isfinite(length))
+			{
+				normal->x = sums[j].x / length;
+				normal->y = sums[j].y / length;
+				normal->z = sums[j].z / length;
+			}
+			point3d_vec_push_back(new_normals, normal);
+		}
+	}
+
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(faces, i);
+		//Faces that refer past the last point have nothing to be welded to and are dropped along
+		//with the faces that collapse
+		if (face->vertices[0] >= num_points || face->vertices[1] >= num_points || face->vertices[2] >= num_points)
+		{
+			free(face);
+			continue;
+		}
+
+		size_t a = remap[face->vertices[0]];
+		size_t b = remap[face->vertices[1]];
+		size_t c = remap[face->vertices[2]];
+		if (a == b || b == c || c == a)
+		{
+			free(face);
+			continue;
+		}
+
+		face->vertices[0] = a;
+		face->vertices[1] = b;
+		face->vertices[2] = c;
+		mesh_face_vec_push_back(new_faces, face);
+	}
+
+	point3d_vec_uninitialize(points);
+	point3d_vec_uninitialize(normals);
+	mesh_face_vec_uninitialize(faces);
+	mesh->points = new_points;
+	mesh->normals = new_normals;
+	mesh->faces = new_faces;
+	//Welded vertices no longer form a grid
+	mesh->num_u = 0;
+	mesh->num_v = 0;
+	goto exit5;
+
+exit7:
+	point3d_vec_uninitialize(new_normals);
+exit6:
+	point3d_vec_uninitialize(new_points);
+exit5:
+	free(sums);
+exit4:
+	free(remap);
+exit3:
+	free(first);
+exit2:
+	free(next);
+exit1:
+	free(heads);
+exit0:
+	return error;
+}
+
+//The part of the work of mesh_adjacency_build done by one thread
+typedef struct
+{
+	mesh_t *mesh;
+	mesh_adjacency_t *adjacency;
+	//the next free place in adjacency->faces for each vertex while the faces are placed
+	size_t *cursors;
+	//whether other threads count and place corners alongside this one
+	uint8_t shared;
+	size_t faces_begin;
+	size_t faces_end;
+	size_t points_begin;
+	size_t points_end;
+} adjacency_slice_t;
+
+static void *count_corners_slice(void *arg)
+{
+	adjacency_slice_t *slice = arg;
+	mesh_adjacency_t *adjacency = slice->adjacency;
+	size_t i, j;
+	for (i = slice->faces_begin; i < slice->faces_end; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(slice->mesh->faces, i);
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] >= adjacency->num_points)
+			{
+				continue;
+			}
+
+			size_t *count = adjacency->offsets + face->vertices[j] + 1;
+			if (slice->shared)
+			{
+				__atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+			}
+			else
+			{
+				(*count)++;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void *place_corners_slice(void *arg)
+{
+	adjacency_slice_t *slice = arg;
+	mesh_adjacency_t *adjacency = slice->adjacency;
+	size_t i, j;
+	for (i = slice->faces_begin; i < slice->faces_end; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(slice->mesh->faces, i);
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] >= adjacency->num_points)
+			{
+				continue;
+			}
+
+			size_t *cursor = slice->cursors + face->vertices[j];
+			adjacency->faces[slice->shared ? __atomic_fetch_add(cursor, 1, __ATOMIC_RELAXED) : (*cursor)++] = i;
+		}
+	}
+
+	return NULL;
+}
+
+static int compare_sizes(const void *a, const void *b)
+{
+	size_t x = *(const size_t *) a, y = *(const size_t *) b;
+	return (x > y) - (x < y);
+}
+
+static void *sort_corners_slice(void *arg)
+{
+	adjacency_slice_t *slice = arg;
+	mesh_adjacency_t *adjacency = slice->adjacency;
+	size_t i;
+	for (i = slice->points_begin; i < slice->points_end; i++)
+	{
+		//The threads placed the faces in no particular order; most lists are short enough for an
+		//insertion sort, but not those around, e.g., the poles of a superellipsoid
+		size_t *faces = adjacency->faces + adjacency->offsets[i];
+		size_t count = adjacency->offsets[i + 1] - adjacency->offsets[i];
+		if (count > 32)
+		{
+			qsort(faces, count, sizeof *faces, compare_sizes);
+			continue;
+		}
+
+		size_t j, k;
+		for (j = 1; j < count; j++)
+		{
+			size_t f = faces[j];
+			for (k = j; k > 0 && faces[k - 1] > f; k--)
+			{
+				faces[k] = faces[k - 1];
+			}
+			faces[k] = f;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * find_twin - finds the half-edge running back along a half-edge
+ * @param adjacency - the adjacency, with its faces around every vertex in place
+ * @param mesh      - the mesh
+ * @param half_edge - the half-edge
+ * @return - the twin, or MESH_NO_TWIN if no face, or more than one, runs back along the edge, or
+ *           more than one face runs along it the same way
+ */
+static size_t find_twin(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t half_edge)
+{
+	mesh_face_t *face = mesh_face_vec_get(mesh->faces, half_edge / 3);
+	size_t from = face->vertices[half_edge % 3];
+	size_t to = face->vertices[(half_edge + 1) % 3];
+	if (from >= adjacency->num_points || to >= adjacency->num_points || from == to)
+	{
+		return MESH_NO_TWIN;
+	}
+
+	size_t twin = MESH_NO_TWIN;
+	size_t num_same = 0;
+	size_t k, j;
+	for (k = adjacency->offsets[from]; k < adjacency->offsets[from + 1]; k++)
+	{
+		size_t f = adjacency->faces[k];
+		mesh_face_t *other = mesh_face_vec_get(mesh->faces, f);
+		for (j = 0; j < 3; j++)
+		{
+			size_t a = other->vertices[j], b = other->vertices[(j + 1) % 3];
+			if (a == from && b == to)
+			{
+				num_same++;
+			}
+			else if (a == to && b == from)
+			{
+				if (twin != MESH_NO_TWIN)
+				{
+					return MESH_NO_TWIN;
+				}
+				twin = 3 * f + j;
+			}
+		}
+	}
+
+	//Demanding one face each way keeps the twins paired up even where the surface pinches
+	return num_same == 1 ? twin : MESH_NO_TWIN;
+}
+
+static void *find_twins_slice(void *arg)
+{
+	adjacency_slice_t *slice = arg;
+	mesh_adjacency_t *adjacency = slice->adjacency;
+	size_t i;
+	for (i = 3 * slice->faces_begin; i < 3 * slice->faces_end; i++)
+	{
+		//Each pair is found once, from the half-edge leaving the lower vertex, which is the only one
+		//to write either of the two
+		mesh_face_t *face = mesh_face_vec_get(slice->mesh->faces, i / 3);
+		if (face->vertices[i % 3] > face->vertices[(i + 1) % 3])
+		{
+			continue;
+		}
+
+		size_t twin = find_twin(adjacency, slice->mesh, i);
+		if (twin != MESH_NO_TWIN)
+		{
+			adjacency->twins[i] = twin;
+			adjacency->twins[twin] = i;
+		}
+	}
+
+	return NULL;
+}
+
+status_t mesh_adjacency_build(mesh_t *mesh, size_t num_threads, uint8_t twins, mesh_adjacency_t *adjacency)
+{
+	status_t error = SUCCESS;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+	adjacency->num_points = num_points;
+	adjacency->num_faces = num_faces;
+
+	INITIALIZE_OR_OUT_OF_MEM(adjacency->offsets, calloc(num_points + 1, sizeof *adjacency->offsets), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(adjacency->faces, malloc((3 * num_faces + 1) * sizeof *adjacency->faces), error, exit1);
+	adjacency->twins = NULL;
+	if (twins)
+	{
+		INITIALIZE_OR_OUT_OF_MEM(adjacency->twins, malloc((3 * num_faces + 1) * sizeof *adjacency->twins), error, exit2);
+	}
+
+	size_t *cursors;
+	INITIALIZE_OR_OUT_OF_MEM(cursors, malloc((num_points + 1) * sizeof *cursors), error, exit3);
+
+	size_t num_slices = count_slices(3 * num_faces > num_points ? 3 * num_faces : num_points, num_threads);
+	adjacency_slice_t *slices;
+	INITIALIZE_OR_OUT_OF_MEM(slices, calloc(num_slices, sizeof *slices), error, exit4);
+	size_t i;
+	for (i = 0; i < num_slices; i++)
+	{
+		slices[i].mesh = mesh;
+		slices[i].adjacency = adjacency;
+		slices[i].cursors = cursors;
+		slices[i].shared = num_slices > 1;
+		slices[i].faces_begin = num_faces * i / num_slices;
+		slices[i].faces_end = num_faces * (i + 1) / num_slices;
+		slices[i].points_begin = num_points * i / num_slices;
+		slices[i].points_end = num_points * (i + 1) / num_slices;
+	}
+
+	//A counting sort of the corners by vertex: count them, add up the counts into offsets...
+	mesh_run_slices(slices, sizeof *slices, num_slices, count_corners_slice);
+	for (i = 1; i <= num_points; i++)
+	{
+		adjacency->offsets[i] += adjacency->offsets[i - 1];
+	}
+
+	//...and place each corner's face at the next free place for its vertex, which leaves each list in
+	//order unless several threads were placing them at once
+	memcpy(cursors, adjacency->offsets, (num_points + 1) * sizeof *cursors);
+	mesh_run_slices(slices, sizeof *slices, num_slices, place_corners_slice);
+	if (num_slices > 1)
+	{
+		mesh_run_slices(slices, sizeof *slices, num_slices, sort_corners_slice);
+	}
+
+	//Every list has to be complete before any edge looks through one for its twin
+	if (twins)
+	{
+		memset(adjacency->twins, 0xff, 3 * num_faces * sizeof *adjacency->twins);
+		mesh_run_slices(slices, sizeof *slices, num_slices, find_twins_slice);
+	}
+	free(slices);
+	free(cursors);
+	goto exit0;
+
+exit4:
+	free(cursors);
+exit3:
+	free(adjacency->twins);
+exit2:
+	free(adjacency->faces);
+exit1:
+	free(adjacency->offsets);
+exit0:
+	return error;
+}
+
+void mesh_adjacency_release(mesh_adjacency_t *adjacency)
+{
+	free(adjacency->twins);
+	free(adjacency->faces);
+	free(adjacency->offsets);
+}
+
+size_t mesh_adjacency_ring(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t vertex, size_t *ring)
+{
+	size_t num_ring = 0;
+	size_t k, j, n;
+	for (k = adjacency->offsets[vertex]; k < adjacency->offsets[vertex + 1]; k++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, adjacency->faces[k]);
+		for (j = 0; j < 3; j++)
+		{
+			size_t other = face->vertices[j];
+			if (other == vertex || other >= adjacency->num_points)
+			{
+				continue;
+			}
+
+			//Rings are short, so a scan of what is already there is enough to skip repeats
+			for (n = 0; n < num_ring && ring[n] != other; n++)
+				;
+			if (n == num_ring)
+			{
+				ring[num_ring++] = other;
+			}
+		}
+	}
+
+	return num_ring;
+}
+
+uint8_t mesh_adjacency_on_boundary(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t vertex)
+{
+	size_t k, j;
+	for (k = adjacency->offsets[vertex]; k < adjacency->offsets[vertex + 1]; k++)
+	{
+		size_t f = adjacency->faces[k];
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, f);
+		for (j = 0; j < 3; j++)
+		{
+			//Both the edge leaving the vertex and the one reaching it count
+			if ((face->vertices[j] == vertex || face->vertices[(j + 1) % 3] == vertex) &&
+				adjacency->twins[3 * f + j] == MESH_NO_TWIN)
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+size_t mesh_adjacency_next_boundary(mesh_adjacency_t *adjacency, mesh_t *mesh, size_t half_edge)
+{
+	mesh_face_t *face = mesh_face_vec_get(mesh->faces, half_edge / 3);
+	size_t vertex = face->vertices[(half_edge + 1) % 3];
+	if (vertex >= adjacency->num_points)
+	{
+		return MESH_NO_TWIN;
+	}
+
+	//Around a manifold vertex, only one boundary edge leaves it; elsewhere, the first found will do
+	size_t k, j;
+	for (k = adjacency->offsets[vertex]; k < adjacency->offsets[vertex + 1]; k++)
+	{
+		size_t f = adjacency->faces[k];
+		face = mesh_face_vec_get(mesh->faces, f);
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] == vertex && adjacency->twins[3 * f + j] == MESH_NO_TWIN)
+			{
+				return 3 * f + j;
+			}
+		}
+	}
+
+	return MESH_NO_TWIN;
+}
+
+//The part of the work of mesh_compute_vertex_normals done by one thread
+typedef struct
+{
+	mesh_t *mesh;
+	mesh_normal_weighting_t weighting;
+	mesh_adjacency_t *adjacency;
+	//the unnormalized normal of each face, twice as long as the face is large
+	point3d_t *face_normals;
+	point3d_t **normals;
+	size_t faces_begin;
+	size_t faces_end;
+	size_t points_begin;
+	size_t points_end;
+} normals_slice_t;
+
+static void *face_normals_slice(void *arg)
+{
+	normals_slice_t *slice = arg;
+	mesh_t *mesh = slice->mesh;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t i;
+	for (i = slice->faces_begin; i < slice->faces_end; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		point3d_t *normal = slice->face_normals + i;
+		if (face->vertices[0] >= num_points || face->vertices[1] >= num_points || face->vertices[2] >= num_points)
+		{
+			normal->x = normal->y = normal->z = 0.0;
+			continue;
+		}
+
+		point3d_t *a = point3d_vec_get(mesh->points, face->vertices[0]);
+		point3d_t *b = point3d_vec_get(mesh->points, face->vertices[1]);
+		point3d_t *c = point3d_vec_get(mesh->points, face->vertices[2]);
+		double ux = b->x - a->x, uy = b->y - a->y, uz = b->z - a->z;
+		double vx = c->x - a->x, vy = c->y - a->y, vz = c->z - a->z;
+		normal->x = uy * vz - uz * vy;
+		normal->y = uz * vx - ux * vz;
+		normal->z = ux * vy - uy * vx;
+	}
+
+	return NULL;
+}
+
+/*
+ * corner_angle - returns the angle of a face at one of its corners
+ * @param corner - the corner
+ * @param next   - the corner after it
+ * @param prev   - the corner before it
+ * @return - the angle, in radians
+ */
+static double corner_angle(point3d_t *corner, point3d_t *next, point3d_t *prev)
+{
+	double ux = next->x - corner->x, uy = next->y - corner->y, uz = next->z - corner->z;
+	double vx = prev->x - corner->x, vy = prev->y - corner->y, vz = prev->z - corner->z;
+	double cx = uy * vz - uz * vy, cy = uz * vx - ux * vz, cz = ux * vy - uy * vx;
+	//atan2 stays accurate for the very thin and the very wide corners where acos would not
+	return atan2(sqrt(cx * cx + cy * cy + cz * cz), ux * vx + uy * vy + uz * vz);
+}
+
+static void *vertex_normals_slice(void *arg)
+{
+	normals_slice_t *slice = arg;
+	mesh_t *mesh = slice->mesh;
+	size_t i;
+	for (i = slice->points_begin; i < slice->points_end; i++)
+	{
+		double x = 0.0, y = 0.0, z = 0.0;
+		size_t k;
+		for (k = slice->adjacency->offsets[i]; k < slice->adjacency->offsets[i + 1]; k++)
+		{
+			size_t f = slice->adjacency->faces[k];
+			point3d_t *normal = slice->face_normals + f;
+			if (slice->weighting == MESH_NORMALS_AREA)
+			{
+				x += normal->x;
+				y += normal->y;
+				z += normal->z;
+				continue;
+			}
+
+			double length = sqrt(normal->x * normal->x + normal->y * normal->y + normal->z * normal->z);
+			if (length == 0.0)
+			{
+				continue;
+			}
+
+			mesh_face_t *face = mesh_face_vec_get(mesh->faces, f);
+			size_t corner = face->vertices[0] == i ? 0 : face->vertices[1] == i ? 1 : 2;
+			double angle = corner_angle
+			(
+				point3d_vec_get(mesh->points, face->vertices[corner]),
+				point3d_vec_get(mesh->points, face->vertices[(corner + 1) % 3]),
+				point3d_vec_get(mesh->points, face->vertices[(corner + 2) % 3])
+			);
+			x += normal->x * angle / length;
+			y += normal->y * angle / length;
+			z += normal->z * angle / length;
+		}
+
+		//A vertex on no face, or only on faces of no area, is left with a zero normal
+		double length = sqrt(x * x + y * y + z * z);
+		point3d_t *normal = slice->normals[i];
+		normal->x = length > 0.0 ? x / length : 0.0;
+		normal->y = length > 0.0 ? y / length : 0.0;
+		normal->z = length > 0.0 ? z / length : 0.0;
+	}
+
+	return NULL;
+}
+
+status_t mesh_compute_vertex_normals(mesh_t *mesh, mesh_normal_weighting_t weighting, size_t num_threads)
+{
+	status_t error = SUCCESS;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	mesh_adjacency_t adjacency;
+	IF_ERROR_GOTO(mesh_adjacency_build(mesh, num_threads, 0, &adjacency), error, exit0);
+
+	point3d_t *face_normals;
+	point3d_t **normals;
+	INITIALIZE_OR_OUT_OF_MEM(face_normals, malloc((num_faces + 1) * sizeof *face_normals), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(normals, malloc((num_points + 1) * sizeof *normals), error, exit2);
+
+	point3d_vec_t *new_normals;
+	INITIALIZE_OR_OUT_OF_MEM(new_normals, point3d_vec_initialize(), error, exit3);
+
+	size_t i;
+	for (i = 0; i < num_points; i++)
+	{
+		if ((normals[i] = point3d_initialize()) == NULL)
+		{
+			error = OUT_OF_MEM;
+			goto exit4;
+		}
+		point3d_vec_push_back(new_normals, normals[i]);
+	}
+
+	size_t num_slices = count_slices(num_faces > num_points ? num_faces : num_points, num_threads);
+	normals_slice_t *slices;
+	INITIALIZE_OR_OUT_OF_MEM(slices, calloc(num_slices, sizeof *slices), error, exit4);
+	for (i = 0; i < num_slices; i++)
+	{
+		slices[i].mesh = mesh;
+		slices[i].weighting = weighting;
+		slices[i].adjacency = &adjacency;
+		slices[i].face_normals = face_normals;
+		slices[i].normals = normals;
+		slices[i].faces_begin = num_faces * i / num_slices;
+		slices[i].faces_end = num_faces * (i + 1) / num_slices;
+		slices[i].points_begin = num_points * i / num_slices;
+		slices[i].points_end = num_points * (i + 1) / num_slices;
+	}
+
+	//Every face normal has to be ready before any vertex gathers the ones around it
+	mesh_run_slices(slices, sizeof *slices, num_slices, face_normals_slice);
+	mesh_run_slices(slices, sizeof *slices, num_slices, vertex_normals_slice);
+	free(slices);
+
+	size_t num_old = point3d_vec_size(mesh->normals);
+	for (i = 0; i < num_old; i++)
+	{
+		point3d_uninitialize(point3d_vec_get(mesh->normals, i));
+	}
+	point3d_vec_uninitialize(mesh->normals);
+	mesh->normals = new_normals;
+	goto exit3;
+
+exit4:
+	while (i > 0)
+	{
+		point3d_uninitialize(normals[--i]);
+	}
+	point3d_vec_uninitialize(new_normals);
+exit3:
+	free(normals);
+exit2:
+	free(face_normals);
+exit1:
+	mesh_adjacency_release(&adjacency);
+exit0:
+	return error;
+}
+
+/*
+ * cache_miss - uses a vertex in a simulated first-in, first-out vertex cache
+ * @param stamps     - the clock reading at which each vertex last entered the cache, starting at 0
+ * @param clock      - the clock, which starts past cache_size and ticks with every miss
+ * @param cache_size - the number of vertices the cache holds
+ * @param vertex     - the vertex used
+ * @return - 1 if the vertex had to be loaded into the cache; 0 if it was already there
+ */
+static uint8_t cache_miss(size_t *stamps, size_t *clock, size_t cache_size, size_t vertex)
+{
+	if (*clock - stamps[vertex] <= cache_size)
+	{
+		return 0;
+	}
+
+	stamps[vertex] = (*clock)++;
+	return 1;
+}
+
+status_t mesh_acmr(mesh_t *mesh, size_t cache_size, double *acmr)
+{
+	status_t error = SUCCESS;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	size_t *stamps;
+	INITIALIZE_OR_OUT_OF_MEM(stamps, calloc(num_points + 1, sizeof *stamps), error, exit0);
+
+	size_t clock = cache_size + 1;
+	size_t misses = 0;
+	size_t i, j;
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		for (j = 0; j < 3; j++)
+		{
+			//A vertex past the last point can never be cached
+			size_t vertex = face->vertices[j];
+			misses += vertex < num_points ? cache_miss(stamps, &clock, cache_size, vertex) : 1;
+		}
+	}
+
+	*acmr = num_faces > 0 ? (double) misses / num_faces : 0.0;
+	free(stamps);
+exit0:
+	return error;
+}
+
+//The state of mesh_reorder_faces as it fans around one vertex after another
+typedef struct
+{
+	size_t cache_size;
+	size_t num_points;
+	//the number of faces around each vertex not yet emitted
+	size_t *live;
+	size_t *stamps;
+	size_t clock;
+	//the vertices of the faces emitted so far, to which to fall back when a fan leads nowhere
+	size_t *dead_ends;
+	size_t top;
+	//the vertex from which to search for any with faces left once the dead ends run out
+	size_t cursor;
+} reorder_t;
+
+/*
+ * next_fan - picks the vertex around which to emit faces next
+ * @param reorder - the state of the reordering
+ * @param begin   - the position in dead_ends of the vertices of the fan just emitted
+ * @return - the vertex, or NO_VERTEX if every face has been emitted
+ */
+static size_t next_fan(reorder_t *reorder, size_t begin)
+{
+	//Prefer the oldest vertex of the last fan that would still be cached after all of its own
+	//faces were emitted, since it is the next to be lost; any vertex with faces left will do
+	//otherwise
+	size_t best = NO_VERTEX;
+	size_t best_priority = 0;
+	size_t i;
+	for (i = begin; i < reorder->top; i++)
+	{
+		size_t vertex = reorder->dead_ends[i];
+		if (reorder->live[vertex] == 0)
+		{
+			continue;
+		}
+
+		size_t age = reorder->clock - reorder->stamps[vertex];
+		size_t priority = age + 2 * reorder->live[vertex] <= reorder->cache_size ? age : 0;
+		if (best == NO_VERTEX || priority > best_priority)
+		{
+			best = vertex;
+			best_priority = priority;
+		}
+	}
+
+	if (best != NO_VERTEX)
+	{
+		return best;
+	}
+
+	while (reorder->top > 0)
+	{
+		size_t vertex = reorder->dead_ends[--reorder->top];
+		if (reorder->live[vertex] > 0)
+		{
+			return vertex;
+		}
+	}
+
+	for (; reorder->cursor < reorder->num_points; reorder->cursor++)
+	{
+		if (reorder->live[reorder->cursor] > 0)
+		{
+			return reorder->cursor;
+		}
+	}
+
+	return NO_VERTEX;
+}
+
+status_t mesh_reorder_faces(mesh_t *mesh, size_t cache_size)
+{
+	status_t error = SUCCESS;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	mesh_adjacency_t adjacency;
+	IF_ERROR_GOTO(mesh_adjacency_build(mesh, 1, 0, &adjacency), error, exit0);
+
+	reorder_t reorder =
+	{
+		.cache_size = cache_size,
+		.num_points = num_points,
+		.clock = cache_size + 1,
+		.top = 0,
+		.cursor = 0,
+	};
+	uint8_t *emitted;
+	mesh_face_t **order;
+	mesh_face_vec_t *new_faces;
+	INITIALIZE_OR_OUT_OF_MEM(reorder.live, malloc((num_points + 1) * sizeof *reorder.live), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(reorder.stamps, calloc(num_points + 1, sizeof *reorder.stamps), error, exit2);
+	INITIALIZE_OR_OUT_OF_MEM(reorder.dead_ends, malloc((3 * num_faces + 1) * sizeof *reorder.dead_ends), error, exit3);
+	INITIALIZE_OR_OUT_OF_MEM(emitted, calloc(num_faces + 1, sizeof *emitted), error, exit4);
+	INITIALIZE_OR_OUT_OF_MEM(order, malloc((num_faces + 1) * sizeof *order), error, exit5);
+	INITIALIZE_OR_OUT_OF_MEM(new_faces, mesh_face_vec_initialize(), error, exit6);
+
+	size_t i, j, k;
+	for (i = 0; i < num_points; i++)
+	{
+		reorder.live[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+	}
+
+	//Faces that refer past the last point are not reached from every corner, so rather than being
+	//fanned they are kept aside and put at the end
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		if (face->vertices[0] < num_points && face->vertices[1] < num_points && face->vertices[2] < num_points)
+		{
+			continue;
+		}
+
+		emitted[i] = 1;
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] < num_points)
+			{
+				reorder.live[face->vertices[j]]--;
+			}
+		}
+	}
+
+	//Tipsify: emit every face left around a vertex, then move on to a vertex of those faces that
+	//is still in the cache
+	size_t num_emitted = 0;
+	size_t fan = num_points > 0 ? 0 : NO_VERTEX;
+	while (fan != NO_VERTEX)
+	{
+		size_t begin = reorder.top;
+		for (k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; k++)
+		{
+			size_t f = adjacency.faces[k];
+			if (emitted[f])
+			{
+				continue;
+			}
+
+			mesh_face_t *face = mesh_face_vec_get(mesh->faces, f);
+			emitted[f] = 1;
+			order[num_emitted++] = face;
+			for (j = 0; j < 3; j++)
+			{
+				size_t vertex = face->vertices[j];
+				reorder.dead_ends[reorder.top++] = vertex;
+				reorder.live[vertex]--;
+				cache_miss(reorder.stamps, &reorder.clock, cache_size, vertex);
+			}
+		}
+
+		fan = next_fan(&reorder, begin);
+	}
+
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		if (face->vertices[0] >= num_points || face->vertices[1] >= num_points || face->vertices[2] >= num_points)
+		{
+			order[num_emitted++] = face;
+		}
+	}
+
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_vec_push_back(new_faces, order[i]);
+	}
+
+	mesh_face_vec_uninitialize(mesh->faces);
+	mesh->faces = new_faces;
+
+exit6:
+	free(order);
+exit5:
+	free(emitted);
+exit4:
+	free(reorder.dead_ends);
+exit3:
+	free(reorder.stamps);
+exit2:
+	free(reorder.live);
+exit1:
+	mesh_adjacency_release(&adjacency);
+exit0:
+	return error;
+}
+
+status_t mesh_reorder_vertices(mesh_t *mesh)
+{
+	status_t error = SUCCESS;
+	point3d_vec_t *points = mesh->points;
+	point3d_vec_t *normals = mesh->normals;
+	size_t num_points = point3d_vec_size(points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+	uint8_t has_normals = point3d_vec_size(normals) == num_points && num_points > 0;
+
+	size_t *remap;
+	size_t *order;
+	point3d_vec_t *new_points;
+	point3d_vec_t *new_normals = NULL;
+	INITIALIZE_OR_OUT_OF_MEM(remap, malloc((num_points + 1) * sizeof *remap), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(order, malloc((num_points + 1) * sizeof *order), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(new_points, point3d_vec_initialize(), error, exit2);
+	if (has_normals)
+	{
+		INITIALIZE_OR_OUT_OF_MEM(new_normals, point3d_vec_initialize(), error, exit3);
+	}
+
+	memset(remap, 0xff, num_points * sizeof *remap);
+
+	//Vertices are numbered in the order the faces first use them, and those on no face follow
+	size_t count = 0;
+	size_t i, j;
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		for (j = 0; j < 3; j++)
+		{
+			size_t vertex = face->vertices[j];
+			if (vertex < num_points && remap[vertex] == NO_VERTEX)
+			{
+				remap[vertex] = count;
+				order[count++] = vertex;
+			}
+		}
+	}
+
+	for (i = 0; i < num_points; i++)
+	{
+		if (remap[i] == NO_VERTEX)
+		{
+			remap[i] = count;
+			order[count++] = i;
+		}
+	}
+
+	for (i = 0; i < num_points; i++)
+	{
+		point3d_vec_push_back(new_points, point3d_vec_get(points, order[i]));
+		if (has_normals)
+		{
+			point3d_vec_push_back(new_normals, point3d_vec_get(normals, order[i]));
+		}
+	}
+
+	//Faces that refer past the last point keep doing so
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] < num_points)
+			{
+				face->vertices[j] = remap[face->vertices[j]];
+			}
+		}
+	}
+
+	point3d_vec_uninitialize(points);
+	mesh->points = new_points;
+	if (has_normals)
+	{
+		point3d_vec_uninitialize(normals);
+		mesh->normals = new_normals;
+	}
+	//Renumbered vertices no longer form a grid
+	mesh->num_u = 0;
+	mesh->num_v = 0;
+	goto exit2;
+
+exit3:
+	point3d_vec_uninitialize(new_points);
+exit2:
+	free(order);
+exit1:
+	free(remap);
+exit0:
+	return error;
+}
+
+//Reorders the faces for a vertex cache of the given size and then, if asked, the vertices to
+//follow them, measuring the ACMR before and after
+status_t mesh_reorder(mesh_t *mesh, size_t cache_size, uint8_t reorder_vertices, double *before, double *after)
+{
+	status_t error = SUCCESS;
+
+	IF_ERROR_GOTO(mesh_acmr(mesh, cache_size, before), error, exit0);
+	IF_ERROR_GOTO(mesh_reorder_faces(mesh, cache_size), error, exit0);
+	if (reorder_vertices)
+	{
+		IF_ERROR_GOTO(mesh_reorder_vertices(mesh), error, exit0);
+	}
+	IF_ERROR_GOTO(mesh_acmr(mesh, cache_size, after), error, exit0);
+
+exit0:
+	return error;
+}
+
+/*
+ * grid_faces - checks whether the faces of the mesh are exactly those made by mesh_calculate_faces
+ * for its num_u by num_v grid of points
+ * @param mesh - the mesh to check
+ * @return - 1 if they are; 0 otherwise
+ */
+static uint8_t grid_faces(mesh_t *mesh)
+{
+	size_t num_u = mesh->num_u;
+	size_t num_v = mesh->num_v;
+	if (num_u < 2 || num_v < 2 || point3d_vec_size(mesh->points) != num_u * num_v ||
+		mesh_face_vec_size(mesh->faces) != 2 * (num_u - 1) * (num_v - 1))
+	{
+		return 0;
+	}
+
+	mesh_face_t expected[2];
+	size_t num = 0;
+	size_t i, j, k;
+	for (i = 0; i < num_u - 1; i++)
+	{
+		for (j = 0; j < num_v - 1; j++)
+		{
+			size_t curr = i * num_v + j;
+			set_face(expected, curr + num_v, curr + num_v + 1, curr + 1);
+			set_face(expected + 1, curr + num_v, curr + 1, curr);
+			for (k = 0; k < 2; k++)
+			{
+				if (memcmp(mesh_face_vec_get(mesh->faces, num++), expected + k, sizeof *expected))
+				{
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+//The state of mesh_stripify as it grows one strip after another
+typedef struct
+{
+	mesh_t *mesh;
+	mesh_adjacency_t adjacency;
+	//whether each face is already in a strip
+	uint8_t *used;
+	//the last trial in which each face was taken, so that a strip never takes a face twice
+	size_t *taken;
+	size_t trial;
+} stripper_t;
+
+/*
+ * strip_next - finds a face, not yet in any strip, that has the directed edge from one vertex to
+ * another
+ * @param stripper - the state of the stripifier
+ * @param from     - the vertex at which the edge starts
+ * @param to       - the vertex at which the edge ends
+ * @param third    - out param; the remaining vertex of the face
+ * @return - the index of the face, or NO_VERTEX if there is none
+ */
+static size_t strip_next(stripper_t *stripper, size_t from, size_t to, size_t *third)
+{
+	mesh_adjacency_t *adjacency = &stripper->adjacency;
+	if (from >= adjacency->num_points)
+	{
+		return NO_VERTEX;
+	}
+
+	//Only a few edges are ever followed, so looking through the faces around the vertex as they
+	//come up costs less than pairing up the twins of every edge beforehand
+	size_t k, j;
+	for (k = adjacency->offsets[from]; k < adjacency->offsets[from + 1]; k++)
+	{
+		size_t f = adjacency->faces[k];
+		if (stripper->used[f] || stripper->taken[f] == stripper->trial)
+		{
+			continue;
+		}
+
+		mesh_face_t *face = mesh_face_vec_get(stripper->mesh->faces, f);
+		for (j = 0; j < 3; j++)
+		{
+			if (face->vertices[j] == from && face->vertices[(j + 1) % 3] == to)
+			{
+				*third = face->vertices[(j + 2) % 3];
+				return f;
+			}
+		}
+	}
+
+	return NO_VERTEX;
+}
+
+/*
+ * strip_grow - follows a strip from a face for as long as there are faces to continue it
+ * @param stripper - the state of the stripifier
+ * @param first    - the face with which the strip starts
+ * @param rotation - the corner of the face with which the strip starts
+ * @param out      - where to write the vertices of the strip, marking its faces used; NULL to
+ *                   only measure the strip
+ * @return - the number of faces in the strip
+ */
+static size_t strip_grow(stripper_t *stripper, size_t first, size_t rotation, size_t *out)
+{
+	mesh_face_t *face = mesh_face_vec_get(stripper->mesh->faces, first);
+	size_t prev = face->vertices[(rotation + 1) % 3];
+	size_t last = face->vertices[(rotation + 2) % 3];
+
+	stripper->trial++;
+	stripper->taken[first] = stripper->trial;
+	if (out != NULL)
+	{
+		out[0] = face->vertices[rotation];
+		out[1] = prev;
+		out[2] = last;
+		stripper->used[first] = 1;
+	}
+
+	size_t count = 1;
+	for (;;)
+	{
+		//Every other face of a strip is wound the opposite way from the order of its vertices in
+		//the strip, so it has the last edge the other way around
+		size_t third;
+		size_t f = count % 2 == 1 ? strip_next(stripper, last, prev, &third) : strip_next(stripper, prev, last, &third);
+		if (f == NO_VERTEX)
+		{
+			break;
+		}
+
+		stripper->taken[f] = stripper->trial;
+		if (out != NULL)
+		{
+			out[count + 2] = third;
+			stripper->used[f] = 1;
+		}
+
+		count++;
+		prev = last;
+		last = third;
+	}
+
+	return count;
+}
+
+//Each band between two rows of the grid is a single strip, zigzagging between the rows
+static void strip_grid(mesh_t *mesh, mesh_strips_t *strips)
+{
+	size_t num_v = mesh->num_v;
+	size_t i, j;
+	for (i = 0; i < mesh->num_u - 1; i++)
+	{
+		for (j = 0; j < num_v; j++)
+		{
+			strips->indices[strips->num_indices++] = i * num_v + j;
+			strips->indices[strips->num_indices++] = (i + 1) * num_v + j;
+		}
+		strips->indices[strips->num_indices++] = MESH_STRIP_END;
+		strips->num_strips++;
+	}
+}
+
+//Greedily starts a strip at each face not yet in one, in whichever of the three directions goes
+//furthest
+static status_t strip_greedy(mesh_t *mesh, mesh_strips_t *strips)
+{
+	status_t error = SUCCESS;
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	stripper_t stripper = { .mesh = mesh, .trial = 0 };
+	IF_ERROR_GOTO(mesh_adjacency_build(mesh, 1, 0, &stripper.adjacency), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(stripper.used, calloc(num_faces + 1, sizeof *stripper.used), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(stripper.taken, calloc(num_faces + 1, sizeof *stripper.taken), error, exit2);
+
+	size_t i, j;
+	for (i = 0; i < num_faces; i++)
+	{
+		if (stripper.used[i])
+		{
+			continue;
+		}
+
+		size_t best = 0;
+		size_t best_count = 0;
+		for (j = 0; j < 3; j++)
+		{
+			size_t count = strip_grow(&stripper, i, j, NULL);
+			if (count > best_count)
+			{
+				best = j;
+				best_count = count;
+			}
+		}
+
+		size_t count = strip_grow(&stripper, i, best, strips->indices + strips->num_indices);
+		strips->num_indices += count + 2;
+		strips->indices[strips->num_indices++] = MESH_STRIP_END;
+		strips->num_strips++;
+	}
+
+	free(stripper.taken);
+exit2:
+	free(stripper.used);
+exit1:
+	mesh_adjacency_release(&stripper.adjacency);
+exit0:
+	return error;
+}
+
+status_t mesh_stripify(mesh_t *mesh, mesh_strips_t *strips)
+{
+	status_t error = SUCCESS;
+
+	//No strip takes more than three vertices per face, plus its end
+	strips->num_indices = 0;
+	strips->num_strips = 0;
+	size_t capacity = 4 * mesh_face_vec_size(mesh->faces) + 1;
+	INITIALIZE_OR_OUT_OF_MEM(strips->indices, malloc(capacity * sizeof *strips->indices), error, exit0);
+
+	if (grid_faces(mesh))
+	{
+		strip_grid(mesh, strips);
+	}
+	else if ((error = strip_greedy(mesh, strips)))
+	{
+		free(strips->indices);
+	}
+
+exit0:
+	return error;
+}
+
+void mesh_strips_release(mesh_strips_t *strips)
+{
+	free(strips->indices);
+}
+
+//A vertex in the heap of mesh_decimate, under the cost of collapsing its cheapest edge
+typedef struct
+{
+	double cost;
+	size_t vertex;
+} heap_entry_t;
+
+//Everything about one vertex that mesh_decimate looks at together, kept together
+typedef struct
+{
+	//the quadric, as the upper triangle of a symmetric 4x4 matrix, and where the vertex is
+	double quadric[10];
+	double position[3];
+	//the faces around the vertex, some possibly dead, are pool[start] through
+	//pool[start + count - 1]
+	size_t start;
+	size_t count;
+	//the other vertex of the cheapest edge to collapse around the vertex, and where the vertex is
+	//in the heap, or NO_VERTEX
+	size_t target;
+	size_t heap_position;
+	//vertices on a boundary, or on an edge shared by more than two faces, never move
+	uint8_t boundary;
+	//whether the cheapest edge might have changed since it was found
+	uint8_t dirty;
+} decimator_vertex_t;
+
+//The state of mesh_decimate
+typedef struct
+{
+	size_t num_points;
+	size_t live_faces;
+	decimator_vertex_t *vertices;
+	//the corners of every face, kept pointing at the vertices that are left
+	size_t *corners;
+	uint8_t *dead;
+	size_t *pool;
+	size_t pool_size;
+	size_t pool_capacity;
+	//a binary heap of the vertices by the cost of their cheapest collapse
+	heap_entry_t *heap;
+	size_t heap_size;
+	//marks for finding the neighbours two vertices share
+	size_t *marks;
+	size_t mark;
+} decimator_t;
+
+static void quadric_add_plane(double *q, double nx, double ny, double nz, double d, double weight)
+{
+	q[0] += weight * nx * nx;
+	q[1] += weight * nx * ny;
+	q[2] += weight * nx * nz;
+	q[3] += weight * nx * d;
+	q[4] += weight * ny * ny;
+	q[5] += weight * ny * nz;
+	q[6] += weight * ny * d;
+	q[7] += weight * nz * nz;
+	q[8] += weight * nz * d;
+	q[9] += weight * d * d;
+}
+
+//Returns the sum of the squared distances, weighted by area, from a position to a quadric's planes
+static double quadric_error(double *q, double *p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double error =
+		q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+		q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+		q[7] * z * z + 2 * q[8] * z +
+		q[9];
+	return error > 0.0 ? error : 0.0;
+}
+
+/*
+ * quadric_minimum - finds the position at which a quadric is smallest
+ * @param q        - the quadric
+ * @param position - out param; the position
+ * @return - 1 if there is a single such position; 0 if the planes are too close to parallel to
+ *           fix one, e.g., on a flat part of the mesh
+ */
+static uint8_t quadric_minimum(double *q, double *position)
+{
+	//Cramer's rule on the upper 3x3 of the quadric against the negated last column
+	double m00 = q[0], m01 = q[1], m02 = q[2];
+	double m11 = q[4], m12 = q[5], m22 = q[7];
+	double r0 = -q[3], r1 = -q[6], r2 = -q[8];
+
+	double c00 = m11 * m22 - m12 * m12;
+	double c01 = m02 * m12 - m01 * m22;
+	double c02 = m01 * m12 - m02 * m11;
+	double det = m00 * c00 + m01 * c01 + m02 * c02;
+	double trace = m00 + m11 + m22;
+	if (!(fabs(det) > 1e-12 * trace * trace * trace))
+	{
+		return 0;
+	}
+
+	double c11 = m00 * m22 - m02 * m02;
+	double c12 = m01 * m02 - m00 * m12;
+	double c22 = m00 * m11 - m01 * m01;
+	position[0] = (c00 * r0 + c01 * r1 + c02 * r2) / det;
+	position[1] = (c01 * r0 + c11 * r1 + c12 * r2) / det;
+	position[2] = (c02 * r0 + c12 * r1 + c22 * r2) / det;
+	return isfinite(position[0]) && isfinite(position[1]) && isfinite(position[2]);
+}
+
+/*
+ * plan_collapse - works out where two vertices would go if the edge between them were collapsed,
+ * and how far that would take the mesh from its original surface
+ * @param decimator - the state of the decimation
+ * @param a         - one vertex of the edge
+ * @param b         - the other vertex of the edge
+ * @param position  - out param; where the merged vertex would go
+ * @param cost      - out param; the error of the merged vertex's quadric at that position
+ * @return - 1 if the edge may be collapsed; 0 if both of its vertices are fixed
+ */
+static uint8_t plan_collapse(decimator_t *decimator, size_t a, size_t b, double *position, double *cost)
+{
+	if (decimator->vertices[a].boundary && decimator->vertices[b].boundary)
+	{
+		return 0;
+	}
+
+	double q[10];
+	size_t i;
+	for (i = 0; i < 10; i++)
+	{
+		q[i] = decimator->vertices[a].quadric[i] + decimator->vertices[b].quadric[i];
+	}
+
+	double *pa = decimator->vertices[a].position;
+	double *pb = decimator->vertices[b].position;
+	if (decimator->vertices[a].boundary || decimator->vertices[b].boundary)
+	{
+		memcpy(position, decimator->vertices[a].boundary ? pa : pb, 3 * sizeof *position);
+	}
+	else if (!quadric_minimum(q, position))
+	{
+		//Without a single best position, take the best of the ends and the middle
+		double middle[3] = { (pa[0] + pb[0]) / 2, (pa[1] + pb[1]) / 2, (pa[2] + pb[2]) / 2 };
+		double *best = middle;
+		if (quadric_error(q, pa) < quadric_error(q, best))
+		{
+			best = pa;
+		}
+		if (quadric_error(q, pb) < quadric_error(q, best))
+		{
+			best = pb;
+		}
+		memcpy(position, best, 3 * sizeof *position);
+	}
+
+	*cost = quadric_error(q, position);
+	return 1;
+}
+
+static void heap_place(decimator_t *decimator, size_t i, heap_entry_t entry)
+{
+	decimator->heap[i] = entry;
+	decimator->vertices[entry.vertex].heap_position = i;
+}
+
+static void heap_sift_up(decimator_t *decimator, size_t i)
+{
+	heap_entry_t entry = decimator->heap[i];
+	while (i > 0 && entry.cost < decimator->heap[(i - 1) / 2].cost)
+	{
+		heap_place(decimator, i, decimator->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	heap_place(decimator, i, entry);
+}
+
+static void heap_sift_down(decimator_t *decimator, size_t i)
+{
+	heap_entry_t entry = decimator->heap[i];
+	for (;;)
+	{
+		size_t child = 2 * i + 1;
+		if (child >= decimator->heap_size)
+		{
+			break;
+		}
+		if (child + 1 < decimator->heap_size && decimator->heap[child + 1].cost < decimator->heap[child].cost)
+		{
+			child++;
+		}
+		if (!(decimator->heap[child].cost < entry.cost))
+		{
+			break;
+		}
+		heap_place(decimator, i, decimator->heap[child]);
+		i = child;
+	}
+	heap_place(decimator, i, entry);
+}
+
+//Puts a vertex into the heap, or moves it to where its changed cost belongs
+static void heap_update(decimator_t *decimator, size_t vertex, double cost)
+{
+	heap_entry_t entry = { .cost = cost, .vertex = vertex };
+	size_t i = decimator->vertices[vertex].heap_position;
+	if (i == NO_VERTEX)
+	{
+		i = decimator->heap_size++;
+	}
+
+	heap_place(decimator, i, entry);
+	heap_sift_up(decimator, i);
+	heap_sift_down(decimator, decimator->vertices[vertex].heap_position);
+}
+
+static void heap_remove(decimator_t *decimator, size_t vertex)
+{
+	size_t i = decimator->vertices[vertex].heap_position;
+	if (i == NO_VERTEX)
+	{
+		return;
+	}
+
+	decimator->vertices[vertex].heap_position = NO_VERTEX;
+	heap_entry_t last = decimator->heap[--decimator->heap_size];
+	if (i == decimator->heap_size)
+	{
+		return;
+	}
+
+	heap_place(decimator, i, last);
+	heap_sift_up(decimator, i);
+	heap_sift_down(decimator, decimator->vertices[last.vertex].heap_position);
+}
+
+//Finds the cheapest collapse of the edges around a vertex and files the vertex in the heap under
+//it, or takes the vertex out of the heap if none of its edges can be collapsed
+static void find_best_collapse(decimator_t *decimator, size_t vertex)
+{
+	double best = HUGE_VAL;
+	size_t target = NO_VERTEX;
+	size_t k, j;
+	for (k = 0; k < decimator->vertices[vertex].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[vertex].start + k];
+		size_t *corners = decimator->corners + 3 * f;
+		if (decimator->dead[f])
+		{
+			continue;
+		}
+
+		//Each edge out of the vertex runs forwards in just one of its faces; the only ones missed
+		//this way are along a boundary, where neither end may move
+		for (j = 0; corners[j] != vertex; j++);
+		size_t other = corners[(j + 1) % 3];
+		double position[3];
+		double cost;
+		if (plan_collapse(decimator, vertex, other, position, &cost) && cost < best)
+		{
+			best = cost;
+			target = other;
+		}
+	}
+
+	decimator->vertices[vertex].dirty = 0;
+	if (target == NO_VERTEX)
+	{
+		heap_remove(decimator, vertex);
+		return;
+	}
+
+	decimator->vertices[vertex].target = target;
+	heap_update(decimator, vertex, best);
+}
+
+static uint8_t face_has(size_t *corners, size_t vertex)
+{
+	return corners[0] == vertex || corners[1] == vertex || corners[2] == vertex;
+}
+
+static void face_normal(double *a, double *b, double *c, double *normal)
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal[0] = u[1] * v[2] - u[2] * v[1];
+	normal[1] = u[2] * v[0] - u[0] * v[2];
+	normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/*
+ * faces_keep_facing - checks that moving a vertex leaves each face around it, other than those
+ * on the edge being collapsed, facing the way it did
+ * @param decimator - the state of the decimation
+ * @param vertex    - the vertex being moved
+ * @param other     - the other vertex of the edge being collapsed
+ * @param position  - where the vertex is going
+ * @return - 1 if no face would flip over or collapse; 0 otherwise
+ */
+static uint8_t faces_keep_facing(decimator_t *decimator, size_t vertex, size_t other, double *position)
+{
+	size_t k, j;
+	for (k = 0; k < decimator->vertices[vertex].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[vertex].start + k];
+		size_t *corners = decimator->corners + 3 * f;
+		if (decimator->dead[f] || face_has(corners, other))
+		{
+			continue;
+		}
+
+		double *before[3];
+		double *after[3];
+		for (j = 0; j < 3; j++)
+		{
+			before[j] = decimator->vertices[corners[j]].position;
+			after[j] = corners[j] == vertex ? position : before[j];
+		}
+
+		double old_normal[3], new_normal[3];
+		face_normal(before[0], before[1], before[2], old_normal);
+		face_normal(after[0], after[1], after[2], new_normal);
+		double dot = old_normal[0] * new_normal[0] + old_normal[1] * new_normal[1] + old_normal[2] * new_normal[2];
+		//Faces that already had no area have no way to face, so they cannot flip
+		uint8_t had_area = old_normal[0] != 0.0 || old_normal[1] != 0.0 || old_normal[2] != 0.0;
+		if (had_area && !(dot > 0.0))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * collapse_allowed - checks that collapsing an edge keeps the mesh a manifold that faces the same
+ * way
+ * @param decimator - the state of the decimation
+ * @param keep      - the vertex that stays
+ * @param remove    - the vertex merged into it
+ * @param position  - where the merged vertex goes
+ * @return - 1 if the collapse is allowed; 0 otherwise
+ */
+static uint8_t collapse_allowed(decimator_t *decimator, size_t keep, size_t remove, double *position)
+{
+	size_t k, j;
+
+	//The two vertices may share only the neighbours across the faces on their edge; any more, and
+	//the collapse would pinch the surface
+	size_t mark = ++decimator->mark;
+	for (k = 0; k < decimator->vertices[remove].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[remove].start + k];
+		if (!decimator->dead[f])
+		{
+			for (j = 0; j < 3; j++)
+			{
+				decimator->marks[decimator->corners[3 * f + j]] = mark;
+			}
+		}
+	}
+
+	size_t shared_faces = 0;
+	size_t shared_neighbours = 0;
+	size_t counted = ++decimator->mark;
+	for (k = 0; k < decimator->vertices[keep].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[keep].start + k];
+		size_t *corners = decimator->corners + 3 * f;
+		if (decimator->dead[f])
+		{
+			continue;
+		}
+
+		shared_faces += face_has(corners, remove);
+		for (j = 0; j < 3; j++)
+		{
+			size_t vertex = corners[j];
+			if (vertex != keep && vertex != remove && decimator->marks[vertex] == mark)
+			{
+				decimator->marks[vertex] = counted;
+				shared_neighbours++;
+			}
+		}
+	}
+
+	if (shared_faces == 0 || shared_neighbours != shared_faces)
+	{
+		return 0;
+	}
+
+	return faces_keep_facing(decimator, keep, remove, position) && faces_keep_facing(decimator, remove, keep, position);
+}
+
+/*
+ * collapse_edge - merges one vertex into another, moving it to the given position, and finds the
+ * cheapest collapses around it again
+ * @param decimator - the state of the decimation
+ * @param keep      - the vertex that stays
+ * @param remove    - the vertex merged into it
+ * @param position  - where the merged vertex goes
+ * @return - OUT_OF_MEM if there was not enough memory; SUCCESS otherwise
+ */
+static status_t collapse_edge(decimator_t *decimator, size_t keep, size_t remove, double *position)
+{
+	size_t needed = decimator->pool_size + decimator->vertices[keep].count + decimator->vertices[remove].count;
+	if (needed > decimator->pool_capacity)
+	{
+		size_t capacity = 2 * needed;
+		size_t *pool = realloc(decimator->pool, capacity * sizeof *pool);
+		if (pool == NULL)
+		{
+			return OUT_OF_MEM;
+		}
+		decimator->pool = pool;
+		decimator->pool_capacity = capacity;
+	}
+
+	//The faces left around the two vertices are gathered into a fresh list for the one that stays,
+	//which leaves the dead faces behind
+	size_t start = decimator->pool_size;
+	size_t k, j;
+	for (k = 0; k < decimator->vertices[keep].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[keep].start + k];
+		if (decimator->dead[f])
+		{
+			continue;
+		}
+
+		if (face_has(decimator->corners + 3 * f, remove))
+		{
+			decimator->dead[f] = 1;
+			decimator->live_faces--;
+			continue;
+		}
+
+		decimator->pool[decimator->pool_size++] = f;
+	}
+
+	for (k = 0; k < decimator->vertices[remove].count; k++)
+	{
+		size_t f = decimator->pool[decimator->vertices[remove].start + k];
+		if (decimator->dead[f])
+		{
+			continue;
+		}
+
+		for (j = 0; j < 3; j++)
+		{
+			if (decimator->corners[3 * f + j] == remove)
+			{
+				decimator->corners[3 * f + j] = keep;
+			}
+		}
+		decimator->pool[decimator->pool_size++] = f;
+	}
+
+	decimator->vertices[keep].start = start;
+	decimator->vertices[keep].count = decimator->pool_size - start;
+	decimator->vertices[remove].count = 0;
+	memcpy(decimator->vertices[keep].position, position, 3 * sizeof *position);
+	for (j = 0; j < 10; j++)
+	{
+		decimator->vertices[keep].quadric[j] += decimator->vertices[remove].quadric[j];
+	}
+
+	//Only the edges around the vertex that stays have changed. Its neighbours are only marked, to
+	//be looked at again when they come to the top of the heap: merging quadrics never makes a
+	//collapse cheaper, so their old costs still put them no later than they belong.
+	heap_remove(decimator, remove);
+	find_best_collapse(decimator, keep);
+	for (k = 0; k < decimator->vertices[keep].count; k++)
+	{
+		size_t *corners = decimator->corners + 3 * decimator->pool[start + k];
+		for (j = 0; j < 3; j++)
+		{
+			size_t other = corners[j];
+			if (other != keep && decimator->vertices[other].heap_position == NO_VERTEX)
+			{
+				find_best_collapse(decimator, other);
+			}
+			else if (other != keep)
+			{
+				decimator->vertices[other].dirty = 1;
+			}
+		}
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * decimator_setup - finds the quadrics, the boundaries, and the cheapest collapses of the mesh
+ * @param decimator - the state of the decimation, with its arrays allocated and the faces around
+ *                    each vertex filled in
+ * @param mesh      - the mesh being decimated
+ * @param twins     - the twin of each half-edge of the mesh, as in mesh_adjacency_t
+ */
+static void decimator_setup(decimator_t *decimator, mesh_t *mesh, size_t *twins)
+{
+	size_t num_points = decimator->num_points;
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+	size_t i, j;
+
+	for (i = 0; i < num_points; i++)
+	{
+		point3d_t *point = point3d_vec_get(mesh->points, i);
+		decimator->vertices[i].position[0] = point->x;
+		decimator->vertices[i].position[1] = point->y;
+		decimator->vertices[i].position[2] = point->z;
+	}
+
+	//Faces that refer past the last point, or to the same point twice, are dropped
+	decimator->live_faces = 0;
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		size_t *corners = decimator->corners + 3 * i;
+		memcpy(corners, face->vertices, 3 * sizeof *corners);
+		decimator->dead[i] =
+			corners[0] >= num_points || corners[1] >= num_points || corners[2] >= num_points ||
+			corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0];
+		decimator->live_faces += !decimator->dead[i];
+	}
+
+	for (i = 0; i < num_faces; i++)
+	{
+		size_t *corners = decimator->corners + 3 * i;
+		if (decimator->dead[i])
+		{
+			continue;
+		}
+
+		double normal[3];
+		double *a = decimator->vertices[corners[0]].position;
+		face_normal(a, decimator->vertices[corners[1]].position, decimator->vertices[corners[2]].position, normal);
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length > 0.0 && isfinite(length))
+		{
+			double nx = normal[0] / length, ny = normal[1] / length, nz = normal[2] / length;
+			double d = -(nx * a[0] + ny * a[1] + nz * a[2]);
+			for (j = 0; j < 3; j++)
+			{
+				quadric_add_plane(decimator->vertices[corners[j]].quadric, nx, ny, nz, d, length / 2);
+			}
+		}
+
+		//An edge without a single live face running back along it is a boundary or a seam to be kept
+		for (j = 0; j < 3; j++)
+		{
+			size_t twin = twins[3 * i + j];
+			if (twin == MESH_NO_TWIN || decimator->dead[twin / 3])
+			{
+				decimator->vertices[corners[j]].boundary = 1;
+				decimator->vertices[corners[(j + 1) % 3]].boundary = 1;
+			}
+		}
+	}
+
+	for (i = 0; i < num_points; i++)
+	{
+		decimator->vertices[i].heap_position = NO_VERTEX;
+	}
+	for (i = 0; i < num_points; i++)
+	{
+		find_best_collapse(decimator, i);
+	}
+}
+
+/*
+ * decimator_finish - replaces the points and faces of the mesh with those left by the decimation
+ * @param decimator - the state of the decimation
+ * @param mesh      - the mesh being decimated
+ * @return - OUT_OF_MEM if there was not enough memory, in which case the mesh is unchanged;
+ *           SUCCESS otherwise
+ */
+static status_t decimator_finish(decimator_t *decimator, mesh_t *mesh)
+{
+	status_t error = SUCCESS;
+	size_t num_points = decimator->num_points;
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+
+	//The marks are no longer needed, so they become the new index of each vertex that is left
+	size_t *remap = decimator->marks;
+	point3d_vec_t *new_points;
+	mesh_face_vec_t *new_faces;
+	INITIALIZE_OR_OUT_OF_MEM(new_points, point3d_vec_initialize(), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(new_faces, mesh_face_vec_initialize(), error, exit1);
+
+	size_t i, j;
+	for (i = 0; i < num_points; i++)
+	{
+		remap[i] = NO_VERTEX;
+	}
+	for (i = 0; i < num_faces; i++)
+	{
+		for (j = 0; j < 3 && !decimator->dead[i]; j++)
+		{
+			remap[decimator->corners[3 * i + j]] = 0;
+		}
+	}
+
+	//Vertices on no face, including those merged away, are dropped
+	size_t count = 0;
+	for (i = 0; i < num_points; i++)
+	{
+		point3d_t *point = point3d_vec_get(mesh->points, i);
+		if (remap[i] == NO_VERTEX)
+		{
+			point3d_uninitialize(point);
+			continue;
+		}
+
+		remap[i] = count++;
+		point->x = decimator->vertices[i].position[0];
+		point->y = decimator->vertices[i].position[1];
+		point->z = decimator->vertices[i].position[2];
+		point3d_vec_push_back(new_points, point);
+	}
+
+	for (i = 0; i < num_faces; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(mesh->faces, i);
+		if (decimator->dead[i])
+		{
+			free(face);
+			continue;
+		}
+
+		for (j = 0; j < 3; j++)
+		{
+			face->vertices[j] = remap[decimator->corners[3 * i + j]];
+		}
+		mesh_face_vec_push_back(new_faces, face);
+	}
+
+	point3d_vec_uninitialize(mesh->points);
+	mesh_face_vec_uninitialize(mesh->faces);
+	mesh->points = new_points;
+	mesh->faces = new_faces;
+	//The vertices left no longer form a grid
+	mesh->num_u = 0;
+	mesh->num_v = 0;
+	goto exit0;
+
+exit1:
+	point3d_vec_uninitialize(new_points);
+exit0:
+	return error;
+}
+
+status_t mesh_decimate(mesh_t *mesh, size_t target_faces, double max_error, size_t num_threads)
+{
+	status_t error = SUCCESS;
+	size_t num_points = point3d_vec_size(mesh->points);
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+	uint8_t has_normals = point3d_vec_size(mesh->normals) == num_points && num_points > 0;
+
+	decimator_t decimator = { .num_points = num_points, .heap_size = 0, .mark = 0 };
+	mesh_adjacency_t adjacency;
+	IF_ERROR_GOTO(mesh_adjacency_build(mesh, num_threads, 1, &adjacency), error, exit0);
+
+	//The lists of the faces around each vertex are taken over as the start of the pool
+	decimator.pool = adjacency.faces;
+	adjacency.faces = NULL;
+	decimator.pool_size = adjacency.offsets[num_points];
+	decimator.pool_capacity = 3 * num_faces + 1;
+
+	INITIALIZE_OR_OUT_OF_MEM(decimator.vertices, calloc(num_points + 1, sizeof *decimator.vertices), error, exit1);
+	INITIALIZE_OR_OUT_OF_MEM(decimator.corners, malloc((3 * num_faces + 1) * sizeof *decimator.corners), error, exit2);
+	INITIALIZE_OR_OUT_OF_MEM(decimator.dead, malloc(num_faces + 1), error, exit3);
+	INITIALIZE_OR_OUT_OF_MEM(decimator.heap, malloc((num_points + 1) * sizeof *decimator.heap), error, exit4);
+	INITIALIZE_OR_OUT_OF_MEM(decimator.marks, calloc(num_points + 1, sizeof *decimator.marks), error, exit5);
+
+	size_t i;
+	for (i = 0; i < num_points; i++)
+	{
+		decimator.vertices[i].start = adjacency.offsets[i];
+		decimator.vertices[i].count = adjacency.offsets[i + 1] - adjacency.offsets[i];
+	}
+
+	decimator_setup(&decimator, mesh, adjacency.twins);
+
+	//Cheapest first, until the mesh is small enough or any further collapse would cost too much
+	while (decimator.live_faces > target_faces && decimator.heap_size > 0)
+	{
+		size_t vertex = decimator.heap[0].vertex;
+		size_t other = decimator.vertices[vertex].target;
+		if (decimator.vertices[vertex].dirty)
+		{
+			find_best_collapse(&decimator, vertex);
+			continue;
+		}
+
+		if (decimator.heap[0].cost > max_error)
+		{
+			break;
+		}
+
+		double position[3];
+		double cost;
+		plan_collapse(&decimator, vertex, other, position, &cost);
+		size_t keep = decimator.vertices[other].boundary ? other : vertex;
+		size_t remove = keep == vertex ? other : vertex;
+		if (!collapse_allowed(&decimator, keep, remove, position))
+		{
+			//The vertex comes back once something around it changes
+			heap_remove(&decimator, vertex);
+			continue;
+		}
+
+		IF_ERROR_GOTO(collapse_edge(&decimator, keep, remove, position), error, exit6);
+	}
+
+	IF_ERROR_GOTO(decimator_finish(&decimator, mesh), error, exit6);
+
+	//The old normals belonged to vertices that have moved or gone
+	if (has_normals)
+	{
+		error = mesh_compute_vertex_normals(mesh, MESH_NORMALS_AREA, num_threads);
+	}
+
+exit6:
+	free(decimator.marks);
+exit5:
+	free(decimator.heap);
+exit4:
+	free(decimator.dead);
+exit3:
+	free(decimator.corners);
+exit2:
+	free(decimator.vertices);
+exit1:
+	free(decimator.pool);
+	mesh_adjacency_release(&adjacency);
+exit0:
+	return error;
+}
+
+status_t mesh_parse_normal_weighting(char *string, mesh_normal_weighting_t *weighting)
+{
+	if (strcmp(string, "area") == 0)
+	{
+		*weighting = MESH_NORMALS_AREA;
+	}
+	else if (strcmp(string, "angle") == 0)
+	{
+		*weighting = MESH_NORMALS_ANGLE;
+	}
+	else
+	{
+		return ARGS_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+status_t mesh_parse_format(char *string, mesh_format_t *format)
+{
+	if (strcmp(string, "iv") == 0)
+	{
+		*format = MESH_FORMAT_IV;
+	}
+	else if (strcmp(string, "ply") == 0)
+	{
+		*format = MESH_FORMAT_PLY;
+	}
+	else if (strcmp(string, "stl") == 0)
+	{
+		*format = MESH_FORMAT_STL;
+	}
+	else
+	{
+		return ARGS_ERROR;
+	}
+
+	return SUCCESS;
+}
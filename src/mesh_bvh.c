@@ -0,0 +1,1224 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_bvh.h"
+
+#include "mesh.h"
+#include "mesh_face_vec.h"
+#include "mesh_slices.h"
+#include "point3d.h"
+#include "point3d_vec.h"
+#include "status.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 8
+//Past this depth, ranges are simply halved, so no path is longer than this plus 64
+#define BVH_SAH_DEPTH 64
+#define BVH_STACK_SIZE 128
+//How many subtrees each thread gets to build, so that a slow one does not hold up the rest
+#define BVH_TASKS_PER_THREAD 4
+#define BVH_MIN_TASK (1 << 12)
+//The fewest faces, triangles, or primitives worth a thread of their own in a single pass over them
+#define BVH_MIN_SLICE (1 << 16)
+//Marks, in place of an axis, a node whose subtree is being built as a task
+#define BVH_SPLICE UINT32_MAX
+
+//A triangle as the build sees it; the centre of its box, which it is binned by, is min + max halved
+typedef struct
+{
+	double min[3];
+	double max[3];
+	size_t face;
+} bvh_primitive_t;
+
+//A growing array of nodes, depth first, with every index relative to its start
+typedef struct
+{
+	mesh_bvh_node_t *nodes;
+	size_t num_nodes;
+	size_t capacity;
+} bvh_node_list_t;
+
+//The number of primitives in a bin of the surface area heuristic, or in any range, and the boxes
+//around them and around their centres
+typedef struct
+{
+	size_t count;
+	double min[3];
+	double max[3];
+	double centroid_min[3];
+	double centroid_max[3];
+} bvh_bin_t;
+
+//A subtree left by the top of the build for a thread to finish
+typedef struct
+{
+	size_t begin;
+	size_t end;
+	size_t depth;
+	bvh_bin_t bounds;
+	bvh_node_list_t list;
+} bvh_task_t;
+
+typedef struct
+{
+	bvh_primitive_t *primitives;
+	size_t num_threads;
+	//ranges no larger than this are left to tasks, and larger ones binned by up to num_threads
+	//threads; 0 to build everything in place
+	size_t cut;
+	bvh_task_t *tasks;
+	size_t num_tasks;
+	size_t tasks_capacity;
+
+	pthread_mutex_t lock;
+	size_t next_task;
+	status_t error;
+} bvh_builder_t;
+
+//A share of the faces, triangles, or primitives of a range, handled by one thread
+typedef struct
+{
+	mesh_t *mesh;
+	mesh_bvh_t *bvh;
+	bvh_primitive_t *primitives;
+	double *corners;
+	size_t begin;
+	size_t end;
+	//how the primitives are binned, and the bins; the first bin alone bounds the faces gathered
+	size_t axis;
+	double centroid_min;
+	double scale;
+	size_t num_bins;
+	bvh_bin_t bins[BVH_BINS];
+} bvh_slice_t;
+
+static inline void empty_box(double *min, double *max)
+{
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		min[a] = HUGE_VAL;
+		max[a] = -HUGE_VAL;
+	}
+}
+
+static inline void grow_box(double *min, double *max, double *other_min, double *other_max)
+{
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		min[a] = other_min[a] < min[a] ? other_min[a] : min[a];
+		max[a] = other_max[a] > max[a] ? other_max[a] : max[a];
+	}
+}
+
+//Half of the surface area of a box, which is all the heuristic needs; 0 for an empty box
+static inline double half_area(double *min, double *max)
+{
+	double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return dx < 0.0 ? 0.0 : dx * dy + dy * dz + dz * dx;
+}
+
+static inline void empty_bin(bvh_bin_t *bin)
+{
+	bin->count = 0;
+	empty_box(bin->min, bin->max);
+	empty_box(bin->centroid_min, bin->centroid_max);
+}
+
+static inline void grow_bin(bvh_bin_t *bin, bvh_bin_t *other)
+{
+	bin->count += other->count;
+	grow_box(bin->min, bin->max, other->min, other->max);
+	grow_box(bin->centroid_min, bin->centroid_max, other->centroid_min, other->centroid_max);
+}
+
+static inline void add_primitive(bvh_bin_t *bin, bvh_primitive_t *primitive)
+{
+	double centroid[3];
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		centroid[a] = (primitive->min[a] + primitive->max[a]) / 2;
+	}
+
+	bin->count++;
+	grow_box(bin->min, bin->max, primitive->min, primitive->max);
+	grow_box(bin->centroid_min, bin->centroid_max, centroid, centroid);
+}
+
+static void range_bounds(bvh_primitive_t *primitives, size_t begin, size_t end, bvh_bin_t *bounds)
+{
+	empty_bin(bounds);
+	size_t i;
+	for (i = begin; i < end; i++)
+	{
+		add_primitive(bounds, primitives + i);
+	}
+}
+
+//Splits a range in the middle, when the order of the range is as good as any
+static size_t halve(bvh_primitive_t *primitives, size_t begin, size_t end, bvh_bin_t *left, bvh_bin_t *right)
+{
+	size_t mid = begin + (end - begin) / 2;
+	range_bounds(primitives, begin, mid, left);
+	range_bounds(primitives, mid, end, right);
+	return mid;
+}
+
+static inline size_t bin_of(bvh_primitive_t *primitive, size_t axis, double centroid_min, double scale, size_t num_bins)
+{
+	size_t bin = (size_t) (((primitive->min[axis] + primitive->max[axis]) / 2 - centroid_min) * scale);
+	return bin < num_bins ? bin : num_bins - 1;
+}
+
+/*
+ * split_slices - splits some items evenly among as many slices as are worth a thread
+ * @param template    - the fields every slice shares
+ * @param begin       - the first item
+ * @param end         - one past the last item
+ * @param num_threads - the most threads to use
+ * @param local       - a slice to use if only one is needed or no more can be allocated
+ * @param num_slices  - out param; the number of slices
+ * @return - the slices, to be freed unless they are local
+ */
+static bvh_slice_t *split_slices(bvh_slice_t *template, size_t begin, size_t end, size_t num_threads, bvh_slice_t *local,
+	size_t *num_slices)
+{
+	size_t count = end - begin;
+	*num_slices = count / BVH_MIN_SLICE + 1;
+	*num_slices = *num_slices < num_threads ? *num_slices : num_threads;
+	bvh_slice_t *slices = *num_slices > 1 ? malloc(*num_slices * sizeof *slices) : NULL;
+	if (slices == NULL)
+	{
+		slices = local;
+		*num_slices = 1;
+	}
+
+	size_t i;
+	for (i = 0; i < *num_slices; i++)
+	{
+		slices[i] = *template;
+		slices[i].begin = begin + count * i / *num_slices;
+		slices[i].end = begin + count * (i + 1) / *num_slices;
+	}
+
+	return slices;
+}
+
+static void *bin_slice(void *arg)
+{
+	bvh_slice_t *slice = arg;
+	size_t i;
+	for (i = 0; i < slice->num_bins; i++)
+	{
+		empty_bin(slice->bins + i);
+	}
+	for (i = slice->begin; i < slice->end; i++)
+	{
+		bvh_primitive_t *primitive = slice->primitives + i;
+		add_primitive(slice->bins + bin_of(primitive, slice->axis, slice->centroid_min, slice->scale, slice->num_bins), primitive);
+	}
+
+	return NULL;
+}
+
+static status_t push_node(bvh_node_list_t *list, size_t *index)
+{
+	if (list->num_nodes == list->capacity)
+	{
+		size_t capacity = list->capacity > 0 ? 2 * list->capacity : 64;
+		mesh_bvh_node_t *nodes = realloc(list->nodes, capacity * sizeof *nodes);
+		if (nodes == NULL)
+		{
+			return OUT_OF_MEM;
+		}
+
+		list->nodes = nodes;
+		list->capacity = capacity;
+	}
+
+	*index = list->num_nodes++;
+	return SUCCESS;
+}
+
+/*
+ * find_split - decides where to split a range of primitives, and partitions them to match
+ * @param builder    - the state of the build
+ * @param begin      - the first primitive of the range
+ * @param end        - one past the last primitive of the range
+ * @param depth      - the depth of the node over the range
+ * @param bounds     - the bounds of the range
+ * @param axis       - out param; the axis of the split
+ * @param left       - out param; the bounds of the first half, if split
+ * @param right      - out param; the bounds of the second half, if split
+ * @return - the first primitive of the second half, or begin if the range is better off as a leaf
+ */
+static size_t find_split(bvh_builder_t *builder, size_t begin, size_t end, size_t depth, bvh_bin_t *bounds,
+	uint32_t *axis, bvh_bin_t *left, bvh_bin_t *right)
+{
+	bvh_primitive_t *primitives = builder->primitives;
+	size_t count = end - begin;
+	size_t a, k;
+	*axis = 0;
+	for (a = 1; a < 3; a++)
+	{
+		if (bounds->centroid_max[a] - bounds->centroid_min[a] > bounds->centroid_max[*axis] - bounds->centroid_min[*axis])
+		{
+			*axis = a;
+		}
+	}
+
+	double centroid_min = bounds->centroid_min[*axis];
+	double extent = bounds->centroid_max[*axis] - centroid_min;
+	if (count <= 1 || ((depth >= BVH_SAH_DEPTH || extent <= 0.0) && count <= BVH_MAX_LEAF))
+	{
+		return begin;
+	}
+	if (depth >= BVH_SAH_DEPTH || extent <= 0.0)
+	{
+		//Every centre is in the same place, or the tree is already deep enough
+		return halve(primitives, begin, end, left, right);
+	}
+
+	//Only the axis along which the centres spread furthest is binned, into no more bins than there
+	//are primitives. It is scaled just short of the number of bins, so that the highest centre stays
+	//in the last one. Ranges too large for a task are binned by several threads, each into bins of
+	//its own, which are then merged
+	size_t num_bins = count < BVH_BINS ? count : BVH_BINS;
+	double scale = num_bins * (1.0 - 1e-9) / extent;
+	bvh_slice_t template = { .primitives = primitives, .axis = *axis, .centroid_min = centroid_min, .scale = scale,
+		.num_bins = num_bins };
+	bvh_slice_t local;
+	size_t num_slices;
+	bvh_slice_t *slices = split_slices(&template, begin, end, count > builder->cut ? builder->num_threads : 1, &local,
+		&num_slices);
+	mesh_run_slices(slices, sizeof *slices, num_slices, bin_slice);
+
+	bvh_bin_t bins[BVH_BINS];
+	memcpy(bins, slices[0].bins, num_bins * sizeof *bins);
+	for (a = 1; a < num_slices; a++)
+	{
+		for (k = 0; k < num_bins; k++)
+		{
+			grow_bin(bins + k, slices[a].bins + k);
+		}
+	}
+	if (slices != &local)
+	{
+		free(slices);
+	}
+
+	//Splitting costs a traversal step plus each half's triangles weighted by the chance of reaching
+	//them, against one test per triangle for a leaf; both are scaled by the area of the node. Both
+	//the lowest and the highest centre have a bin of their own, so some split is always possible
+	double best_cost = count <= BVH_MAX_LEAF ? (count - 1.0) * half_area(bounds->min, bounds->max) : HUGE_VAL;
+	size_t best_bin = 0;
+	double right_costs[BVH_BINS];
+	double min[3], max[3];
+	size_t right_count = 0;
+	empty_box(min, max);
+	for (k = num_bins - 1; k > 0; k--)
+	{
+		right_count += bins[k].count;
+		grow_box(min, max, bins[k].min, bins[k].max);
+		right_costs[k] = right_count > 0 ? half_area(min, max) * right_count : HUGE_VAL;
+	}
+
+	size_t left_count = 0;
+	empty_box(min, max);
+	for (k = 1; k < num_bins; k++)
+	{
+		left_count += bins[k - 1].count;
+		grow_box(min, max, bins[k - 1].min, bins[k - 1].max);
+		double cost = left_count > 0 ? half_area(min, max) * left_count + right_costs[k] : HUGE_VAL;
+		if (cost < best_cost)
+		{
+			best_cost = cost;
+			best_bin = k;
+		}
+	}
+
+	if (best_bin == 0)
+	{
+		//Only boxes too large for their areas to be told apart keep a large range from splitting
+		return count <= BVH_MAX_LEAF ? begin : halve(primitives, begin, end, left, right);
+	}
+
+	empty_bin(left);
+	empty_bin(right);
+	for (k = 0; k < num_bins; k++)
+	{
+		grow_bin(k < best_bin ? left : right, bins + k);
+	}
+
+	size_t low = begin, high = end;
+	while (low < high)
+	{
+		if (bin_of(primitives + low, *axis, centroid_min, scale, num_bins) < best_bin)
+		{
+			low++;
+			continue;
+		}
+
+		bvh_primitive_t swap = primitives[low];
+		primitives[low] = primitives[--high];
+		primitives[high] = swap;
+	}
+
+	return low;
+}
+
+/*
+ * build_node - builds the subtree over a range of primitives, appending it to a list
+ * @param builder - the state of the build
+ * @param list    - the list to which to append the nodes
+ * @param begin   - the first primitive of the range
+ * @param end     - one past the last primitive of the range
+ * @param depth   - the depth of the subtree's root
+ * @param bounds  - the bounds of the range
+ * @param top     - whether to leave ranges no larger than the builder's cut as tasks
+ * @return - OUT_OF_MEM if there was not enough memory; SUCCESS otherwise
+ */
+static status_t build_node(bvh_builder_t *builder, bvh_node_list_t *list, size_t begin, size_t end, size_t depth,
+	bvh_bin_t *bounds, uint8_t top)
+{
+	status_t error = SUCCESS;
+
+	size_t index;
+	IF_ERROR_GOTO(push_node(list, &index), error, exit0);
+
+	mesh_bvh_node_t *node = list->nodes + index;
+	memcpy(node->min, bounds->min, sizeof node->min);
+	memcpy(node->max, bounds->max, sizeof node->max);
+	if (top && end - begin <= builder->cut)
+	{
+		if (builder->num_tasks == builder->tasks_capacity)
+		{
+			size_t capacity = builder->tasks_capacity > 0 ? 2 * builder->tasks_capacity : 16;
+			bvh_task_t *tasks;
+			INITIALIZE_OR_OUT_OF_MEM(tasks, realloc(builder->tasks, capacity * sizeof *tasks), error, exit0);
+			builder->tasks = tasks;
+			builder->tasks_capacity = capacity;
+		}
+
+		bvh_task_t task = { .begin = begin, .end = end, .depth = depth, .bounds = *bounds, .list = { NULL, 0, 0 } };
+		node->index = builder->num_tasks;
+		node->count = 0;
+		node->axis = BVH_SPLICE;
+		builder->tasks[builder->num_tasks++] = task;
+		goto exit0;
+	}
+
+	uint32_t axis;
+	bvh_bin_t left, right;
+	size_t mid = find_split(builder, begin, end, depth, bounds, &axis, &left, &right);
+	node->axis = axis;
+	if (mid == begin)
+	{
+		node->index = begin;
+		node->count = end - begin;
+		goto exit0;
+	}
+
+	//The list may move as it grows, so the node is found again by its index afterwards
+	node->count = 0;
+	IF_ERROR_GOTO(build_node(builder, list, begin, mid, depth + 1, &left, top), error, exit0);
+	list->nodes[index].index = list->num_nodes;
+	IF_ERROR_GOTO(build_node(builder, list, mid, end, depth + 1, &right, top), error, exit0);
+
+exit0:
+	return error;
+}
+
+static void *build_worker(void *arg)
+{
+	bvh_builder_t *builder = arg;
+	while (1)
+	{
+		pthread_mutex_lock(&builder->lock);
+		size_t next = builder->error ? builder->num_tasks : builder->next_task;
+		if (next < builder->num_tasks)
+		{
+			builder->next_task++;
+		}
+		pthread_mutex_unlock(&builder->lock);
+
+		if (next >= builder->num_tasks)
+		{
+			break;
+		}
+
+		bvh_task_t *task = builder->tasks + next;
+		status_t error = build_node(builder, &task->list, task->begin, task->end, task->depth, &task->bounds, 0);
+		if (error)
+		{
+			pthread_mutex_lock(&builder->lock);
+			builder->error = error;
+			pthread_mutex_unlock(&builder->lock);
+		}
+	}
+
+	return NULL;
+}
+
+//Runs the tasks on up to num_threads threads, the calling thread among them
+static status_t run_tasks(bvh_builder_t *builder, size_t num_threads)
+{
+	size_t num_workers = num_threads < builder->num_tasks ? num_threads : builder->num_tasks;
+	pthread_t *threads = num_workers > 1 ? malloc(num_workers * sizeof *threads) : NULL;
+	pthread_mutex_init(&builder->lock, NULL);
+
+	//Any thread that cannot be started just leaves more of the tasks to the others
+	size_t started = 0;
+	while (threads != NULL && started + 1 < num_workers && pthread_create(threads + started, NULL, build_worker, builder) == 0)
+	{
+		started++;
+	}
+
+	build_worker(builder);
+	while (started > 0)
+	{
+		pthread_join(threads[--started], NULL);
+	}
+
+	free(threads);
+	pthread_mutex_destroy(&builder->lock);
+	return builder->error;
+}
+
+/*
+ * splice_tasks - puts the subtrees built by the tasks in place of their nodes in the top of the tree
+ * @param builder - the state of the build, with every task done
+ * @param top     - the top of the tree
+ * @param bvh     - the hierarchy whose nodes to set
+ * @return - OUT_OF_MEM if there was not enough memory; SUCCESS otherwise
+ */
+static status_t splice_tasks(bvh_builder_t *builder, bvh_node_list_t *top, mesh_bvh_t *bvh)
+{
+	status_t error = SUCCESS;
+
+	//Each task's subtree takes the place of one node, pushing every later node along
+	size_t *moved;
+	INITIALIZE_OR_OUT_OF_MEM(moved, malloc((top->num_nodes + 1) * sizeof *moved), error, exit0);
+	size_t shift = 0;
+	size_t i, k;
+	for (i = 0; i < top->num_nodes; i++)
+	{
+		moved[i] = i + shift;
+		if (top->nodes[i].axis == BVH_SPLICE)
+		{
+			shift += builder->tasks[top->nodes[i].index].list.num_nodes - 1;
+		}
+	}
+
+	bvh->num_nodes = top->num_nodes + shift;
+	INITIALIZE_OR_OUT_OF_MEM(bvh->nodes, malloc(bvh->num_nodes * sizeof *bvh->nodes), error, exit1);
+	for (i = 0; i < top->num_nodes; i++)
+	{
+		mesh_bvh_node_t *node = top->nodes + i;
+		mesh_bvh_node_t *out = bvh->nodes + moved[i];
+		if (node->axis != BVH_SPLICE)
+		{
+			*out = *node;
+			out->index = node->count == 0 ? moved[node->index] : node->index;
+			continue;
+		}
+
+		bvh_node_list_t *list = &builder->tasks[node->index].list;
+		memcpy(out, list->nodes, list->num_nodes * sizeof *out);
+		for (k = 0; k < list->num_nodes; k++)
+		{
+			out[k].index += out[k].count == 0 ? moved[i] : 0;
+		}
+	}
+
+exit1:
+	free(moved);
+exit0:
+	return error;
+}
+
+//Gathers the corners and the box of each face of a slice, marking the faces left out
+static void *gather_slice(void *arg)
+{
+	bvh_slice_t *slice = arg;
+	size_t num_points = point3d_vec_size(slice->mesh->points);
+	empty_bin(slice->bins);
+	size_t i, j, a;
+	for (i = slice->begin; i < slice->end; i++)
+	{
+		mesh_face_t *face = mesh_face_vec_get(slice->mesh->faces, i);
+		bvh_primitive_t *primitive = slice->primitives + i;
+		primitive->face = MESH_BVH_NO_HIT;
+		if (face->vertices[0] >= num_points || face->vertices[1] >= num_points || face->vertices[2] >= num_points)
+		{
+			continue;
+		}
+
+		double *corner = slice->corners + 9 * i;
+		empty_box(primitive->min, primitive->max);
+		for (j = 0; j < 3; j++)
+		{
+			point3d_t *point = point3d_vec_get(slice->mesh->points, face->vertices[j]);
+			corner[3 * j] = point->x;
+			corner[3 * j + 1] = point->y;
+			corner[3 * j + 2] = point->z;
+			grow_box(primitive->min, primitive->max, corner + 3 * j, corner + 3 * j);
+		}
+
+		//A triangle with a corner at infinity or at no number at all can be neither binned nor hit
+		uint8_t finite = 1;
+		for (a = 0; a < 9; a++)
+		{
+			finite &= isfinite(corner[a]) != 0;
+		}
+		if (finite)
+		{
+			primitive->face = i;
+			add_primitive(slice->bins, primitive);
+		}
+	}
+
+	return NULL;
+}
+
+//Copies the corners of the triangles of a slice into the order of the leaves
+static void *copy_slice(void *arg)
+{
+	bvh_slice_t *slice = arg;
+	size_t i;
+	for (i = slice->begin; i < slice->end; i++)
+	{
+		size_t face = slice->primitives[i].face;
+		memcpy(slice->bvh->triangles + 9 * i, slice->corners + 9 * face, 9 * sizeof *slice->corners);
+		slice->bvh->faces[i] = face;
+	}
+
+	return NULL;
+}
+
+status_t mesh_bvh_build(mesh_t *mesh, size_t num_threads, mesh_bvh_t *bvh)
+{
+	status_t error = SUCCESS;
+	size_t num_faces = mesh_face_vec_size(mesh->faces);
+	num_threads = num_threads > 0 ? num_threads : 1;
+
+	bvh->nodes = NULL;
+	bvh->num_nodes = 0;
+	bvh->num_triangles = 0;
+
+	bvh_builder_t builder = { .num_threads = num_threads, .cut = 0, .tasks = NULL, .num_tasks = 0, .tasks_capacity = 0, .next_task = 0, .error = SUCCESS };
+	bvh_node_list_t top = { NULL, 0, 0 };
+	INITIALIZE_OR_OUT_OF_MEM(builder.primitives, malloc((num_faces + 1) * sizeof *builder.primitives), error, exit0);
+	//The corners are gathered once by face, and only copied into the order of the leaves at the end
+	double *corners;
+	INITIALIZE_OR_OUT_OF_MEM(corners, malloc((9 * num_faces + 1) * sizeof *corners), error, exit1);
+
+	//Every face is gathered in its own place by several threads, and the ones left out closed up after
+	bvh_slice_t template = { .mesh = mesh, .bvh = bvh, .primitives = builder.primitives, .corners = corners };
+	bvh_slice_t local;
+	size_t num_slices;
+	bvh_slice_t *slices = split_slices(&template, 0, num_faces, num_threads, &local, &num_slices);
+	mesh_run_slices(slices, sizeof *slices, num_slices, gather_slice);
+
+	bvh_bin_t bounds = slices[0].bins[0];
+	size_t i;
+	for (i = 1; i < num_slices; i++)
+	{
+		grow_bin(&bounds, slices[i].bins);
+	}
+	if (slices != &local)
+	{
+		free(slices);
+	}
+	for (i = 0; i < num_faces; i++)
+	{
+		if (builder.primitives[i].face != MESH_BVH_NO_HIT)
+		{
+			builder.primitives[bvh->num_triangles++] = builder.primitives[i];
+		}
+	}
+
+	size_t num_triangles = bvh->num_triangles;
+	INITIALIZE_OR_OUT_OF_MEM(bvh->triangles, malloc((9 * num_triangles + 1) * sizeof *bvh->triangles), error, exit2);
+	INITIALIZE_OR_OUT_OF_MEM(bvh->faces, malloc((num_triangles + 1) * sizeof *bvh->faces), error, exit3);
+
+	//The top of the tree is built here, and the subtrees below it by as many threads as there are
+	if (num_threads > 1)
+	{
+		builder.cut = num_triangles / (BVH_TASKS_PER_THREAD * num_threads);
+		builder.cut = builder.cut > BVH_MIN_TASK ? builder.cut : BVH_MIN_TASK;
+	}
+
+	if (num_triangles > 0)
+	{
+		IF_ERROR_GOTO(build_node(&builder, &top, 0, num_triangles, 0, &bounds, 1), error, exit4);
+	}
+
+	if (builder.num_tasks == 0)
+	{
+		bvh->nodes = top.nodes;
+		bvh->num_nodes = top.num_nodes;
+		top.nodes = NULL;
+	}
+	else
+	{
+		IF_ERROR_GOTO(run_tasks(&builder, num_threads), error, exit4);
+		IF_ERROR_GOTO(splice_tasks(&builder, &top, bvh), error, exit4);
+	}
+
+	//The triangles are copied out in the order of the leaves, so each leaf reads one run of them
+	slices = split_slices(&template, 0, num_triangles, num_threads, &local, &num_slices);
+	mesh_run_slices(slices, sizeof *slices, num_slices, copy_slice);
+	if (slices != &local)
+	{
+		free(slices);
+	}
+	goto exit5;
+
+exit4:
+	free(bvh->nodes);
+	free(bvh->faces);
+exit3:
+	free(bvh->triangles);
+exit5:
+	free(top.nodes);
+	for (i = 0; i < builder.num_tasks; i++)
+	{
+		free(builder.tasks[i].list.nodes);
+	}
+	free(builder.tasks);
+exit2:
+	free(corners);
+exit1:
+	free(builder.primitives);
+exit0:
+	return error;
+}
+
+void mesh_bvh_release(mesh_bvh_t *bvh)
+{
+	free(bvh->nodes);
+	free(bvh->triangles);
+	free(bvh->faces);
+}
+
+/*
+ * hit_box - checks whether a ray passes through the box of a node
+ * @param node    - the node
+ * @param origin  - the origin of the ray
+ * @param inverse - the reciprocal of each coordinate of the direction of the ray
+ * @param t_min   - the nearest distance along the ray that counts
+ * @param t_max   - the furthest distance along the ray that counts
+ * @return - 1 if the ray passes through the box between t_min and t_max; 0 otherwise
+ */
+static uint8_t hit_box(mesh_bvh_node_t *node, double *origin, double *inverse, double t_min, double t_max)
+{
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		//A ray along the face of a slab makes 0 * infinity, which fails both comparisons and so
+		//leaves the range alone
+		double t0 = (node->min[a] - origin[a]) * inverse[a];
+		double t1 = (node->max[a] - origin[a]) * inverse[a];
+		double near = t0 < t1 ? t0 : t1;
+		double far = t0 < t1 ? t1 : t0;
+		t_min = near > t_min ? near : t_min;
+		t_max = far < t_max ? far : t_max;
+	}
+
+	return t_min <= t_max;
+}
+
+/*
+ * hit_triangle - intersects a ray with a triangle from either side (Moller-Trumbore)
+ * @param triangle  - the corners of the triangle, nine coordinates
+ * @param origin    - the origin of the ray
+ * @param direction - the direction of the ray
+ * @param t_min     - the nearest distance along the ray that counts
+ * @param t_max     - the furthest distance along the ray that counts
+ * @param hit       - out param; the distance and weights of the hit, if any; its face is not set
+ * @return - 1 if the ray hits the triangle between t_min and t_max; 0 otherwise
+ */
+static uint8_t hit_triangle(double *triangle, double *origin, double *direction, double t_min, double t_max, mesh_bvh_hit_t *hit)
+{
+	double *a = triangle, *b = triangle + 3, *c = triangle + 6;
+	double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	double p[3] =
+	{
+		direction[1] * e2[2] - direction[2] * e2[1],
+		direction[2] * e2[0] - direction[0] * e2[2],
+		direction[0] * e2[1] - direction[1] * e2[0],
+	};
+	double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (det == 0.0)
+	{
+		return 0;
+	}
+
+	double inverse = 1.0 / det;
+	double s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+	if (u < 0.0 || u > 1.0)
+	{
+		return 0;
+	}
+
+	double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	double v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+	if (v < 0.0 || u + v > 1.0)
+	{
+		return 0;
+	}
+
+	double t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+	if (!(t >= t_min && t <= t_max))
+	{
+		return 0;
+	}
+
+	hit->t = t;
+	hit->u = u;
+	hit->v = v;
+	return 1;
+}
+
+uint8_t mesh_bvh_intersect(mesh_bvh_t *bvh, mesh_bvh_ray_t *ray, mesh_bvh_hit_t *hit)
+{
+	hit->face = MESH_BVH_NO_HIT;
+	hit->t = ray->t_max;
+	if (bvh->num_nodes == 0)
+	{
+		return 0;
+	}
+
+	double inverse[3] = { 1.0 / ray->direction[0], 1.0 / ray->direction[1], 1.0 / ray->direction[2] };
+	size_t stack[BVH_STACK_SIZE];
+	size_t depth = 0;
+	size_t index = 0;
+	while (1)
+	{
+		mesh_bvh_node_t *node = bvh->nodes + index;
+		if (hit_box(node, ray->origin, inverse, ray->t_min, hit->t))
+		{
+			if (node->count == 0)
+			{
+				//The child on the side the ray comes from goes first, so that the other can often
+				//be skipped once something nearer is hit
+				uint8_t flip = ray->direction[node->axis] < 0.0;
+				stack[depth++] = flip ? index + 1 : node->index;
+				index = flip ? node->index : index + 1;
+				continue;
+			}
+
+			size_t k;
+			for (k = node->index; k < node->index + node->count; k++)
+			{
+				if (hit_triangle(bvh->triangles + 9 * k, ray->origin, ray->direction, ray->t_min, hit->t, hit))
+				{
+					hit->face = bvh->faces[k];
+				}
+			}
+		}
+
+		if (depth == 0)
+		{
+			break;
+		}
+		index = stack[--depth];
+	}
+
+	return hit->face != MESH_BVH_NO_HIT;
+}
+
+//The rays of a packet, one array per coordinate, so that each step runs across all of them at once
+typedef struct
+{
+	double origin[3][MESH_BVH_PACKET_SIZE];
+	double direction[3][MESH_BVH_PACKET_SIZE];
+	double inverse[3][MESH_BVH_PACKET_SIZE];
+	double t_min[MESH_BVH_PACKET_SIZE];
+	double t_max[MESH_BVH_PACKET_SIZE];
+	double u[MESH_BVH_PACKET_SIZE];
+	double v[MESH_BVH_PACKET_SIZE];
+	size_t triangle[MESH_BVH_PACKET_SIZE];
+} bvh_packet_t;
+
+//Whether any ray of the packet passes through the box of a node
+static uint8_t packet_hit_box(mesh_bvh_node_t *node, bvh_packet_t *packet)
+{
+	uint8_t any = 0;
+	size_t i, a;
+	for (i = 0; i < MESH_BVH_PACKET_SIZE; i++)
+	{
+		double t_min = packet->t_min[i], t_max = packet->t_max[i];
+		for (a = 0; a < 3; a++)
+		{
+			double t0 = (node->min[a] - packet->origin[a][i]) * packet->inverse[a][i];
+			double t1 = (node->max[a] - packet->origin[a][i]) * packet->inverse[a][i];
+			double near = t0 < t1 ? t0 : t1;
+			double far = t0 < t1 ? t1 : t0;
+			t_min = near > t_min ? near : t_min;
+			t_max = far < t_max ? far : t_max;
+		}
+		any |= t_min <= t_max;
+	}
+
+	return any;
+}
+
+//Tests every ray of the packet against one triangle, keeping the hits nearer than what each has
+static void packet_hit_triangle(double *triangle, size_t k, bvh_packet_t *packet)
+{
+	double *a = triangle, *b = triangle + 3, *c = triangle + 6;
+	double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	size_t i;
+	for (i = 0; i < MESH_BVH_PACKET_SIZE; i++)
+	{
+		//The same steps as hit_triangle, but without branches, so the rays can go side by side
+		double dx = packet->direction[0][i], dy = packet->direction[1][i], dz = packet->direction[2][i];
+		double px = dy * e2[2] - dz * e2[1], py = dz * e2[0] - dx * e2[2], pz = dx * e2[1] - dy * e2[0];
+		double det = e1[0] * px + e1[1] * py + e1[2] * pz;
+		double inverse = 1.0 / det;
+		double sx = packet->origin[0][i] - a[0], sy = packet->origin[1][i] - a[1], sz = packet->origin[2][i] - a[2];
+		double u = (sx * px + sy * py + sz * pz) * inverse;
+		double qx = sy * e1[2] - sz * e1[1], qy = sz * e1[0] - sx * e1[2], qz = sx * e1[1] - sy * e1[0];
+		double v = (dx * qx + dy * qy + dz * qz) * inverse;
+		double t = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inverse;
+		uint8_t hit = det != 0.0 && u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t >= packet->t_min[i] && t <= packet->t_max[i];
+		packet->t_max[i] = hit ? t : packet->t_max[i];
+		packet->u[i] = hit ? u : packet->u[i];
+		packet->v[i] = hit ? v : packet->v[i];
+		packet->triangle[i] = hit ? k : packet->triangle[i];
+	}
+}
+
+void mesh_bvh_intersect_packet(mesh_bvh_t *bvh, mesh_bvh_ray_t *rays, size_t num_rays, mesh_bvh_hit_t *hits)
+{
+	bvh_packet_t packet;
+	size_t i, a;
+	for (i = 0; i < MESH_BVH_PACKET_SIZE; i++)
+	{
+		//Lanes past the last ray get an empty range, so they never hit anything
+		uint8_t used = i < num_rays;
+		for (a = 0; a < 3; a++)
+		{
+			packet.origin[a][i] = used ? rays[i].origin[a] : 0.0;
+			packet.direction[a][i] = used ? rays[i].direction[a] : 0.0;
+			packet.inverse[a][i] = used ? 1.0 / rays[i].direction[a] : 0.0;
+		}
+		packet.t_min[i] = used ? rays[i].t_min : HUGE_VAL;
+		packet.t_max[i] = used ? rays[i].t_max : -HUGE_VAL;
+		packet.u[i] = packet.v[i] = 0.0;
+		packet.triangle[i] = MESH_BVH_NO_HIT;
+	}
+
+	size_t stack[BVH_STACK_SIZE];
+	size_t depth = 0;
+	size_t index = 0;
+	while (bvh->num_nodes > 0)
+	{
+		mesh_bvh_node_t *node = bvh->nodes + index;
+		if (packet_hit_box(node, &packet))
+		{
+			if (node->count == 0)
+			{
+				//The rays are taken to head the same way as the first
+				uint8_t flip = packet.direction[node->axis][0] < 0.0;
+				stack[depth++] = flip ? index + 1 : node->index;
+				index = flip ? node->index : index + 1;
+				continue;
+			}
+
+			size_t k;
+			for (k = node->index; k < node->index + node->count; k++)
+			{
+				packet_hit_triangle(bvh->triangles + 9 * k, k, &packet);
+			}
+		}
+
+		if (depth == 0)
+		{
+			break;
+		}
+		index = stack[--depth];
+	}
+
+	for (i = 0; i < num_rays; i++)
+	{
+		hits[i].face = packet.triangle[i] != MESH_BVH_NO_HIT ? bvh->faces[packet.triangle[i]] : MESH_BVH_NO_HIT;
+		hits[i].t = packet.t_max[i];
+		hits[i].u = packet.u[i];
+		hits[i].v = packet.v[i];
+	}
+}
+
+//The squared distance from a point to the box of a node, 0 if the point is inside
+static double box_distance(mesh_bvh_node_t *node, double *point)
+{
+	double distance = 0.0;
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		double d = point[a] < node->min[a] ? node->min[a] - point[a] : point[a] > node->max[a] ? point[a] - node->max[a] : 0.0;
+		distance += d * d;
+	}
+
+	return distance;
+}
+
+static double dot(double *u, double *v)
+{
+	return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+/*
+ * closest_on_triangle - finds the point of a triangle nearest to a point, by working out which
+ * corner, edge, or the inside of the triangle it falls against
+ * @param triangle - the corners of the triangle, nine coordinates
+ * @param point    - the point
+ * @param closest  - out param; the nearest point of the triangle
+ */
+static void closest_on_triangle(double *triangle, double *point, double *closest)
+{
+	double *a = triangle, *b = triangle + 3, *c = triangle + 6;
+	double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	double ap[3] = { point[0] - a[0], point[1] - a[1], point[2] - a[2] };
+	double bp[3] = { point[0] - b[0], point[1] - b[1], point[2] - b[2] };
+	double cp[3] = { point[0] - c[0], point[1] - c[1], point[2] - c[2] };
+	double d1 = dot(ab, ap), d2 = dot(ac, ap);
+	double d3 = dot(ab, bp), d4 = dot(ac, bp);
+	double d5 = dot(ab, cp), d6 = dot(ac, cp);
+	double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+	double s, t;
+	size_t i;
+
+	if (d1 <= 0.0 && d2 <= 0.0)
+	{
+		s = 0.0, t = 0.0;
+	}
+	else if (d3 >= 0.0 && d4 <= d3)
+	{
+		s = 1.0, t = 0.0;
+	}
+	else if (d6 >= 0.0 && d5 <= d6)
+	{
+		s = 0.0, t = 1.0;
+	}
+	else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+	{
+		s = d1 / (d1 - d3), t = 0.0;
+	}
+	else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+	{
+		s = 0.0, t = d2 / (d2 - d6);
+	}
+	else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+	{
+		t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		s = 1.0 - t;
+	}
+	else
+	{
+		double denominator = va + vb + vc;
+		s = vb / denominator;
+		t = vc / denominator;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		closest[i] = a[i] + ab[i] * s + ac[i] * t;
+	}
+}
+
+uint8_t mesh_bvh_closest_point(mesh_bvh_t *bvh, double *point, double max_distance, mesh_bvh_closest_t *closest)
+{
+	closest->face = MESH_BVH_NO_HIT;
+	double best = max_distance * max_distance;
+	size_t stack[BVH_STACK_SIZE];
+	size_t depth = 0;
+	size_t index = 0;
+	while (bvh->num_nodes > 0)
+	{
+		mesh_bvh_node_t *node = bvh->nodes + index;
+		if (box_distance(node, point) <= best)
+		{
+			if (node->count == 0)
+			{
+				//The nearer child goes first, so that the other can often be skipped
+				size_t first = index + 1, second = node->index;
+				uint8_t flip = box_distance(bvh->nodes + second, point) < box_distance(bvh->nodes + first, point);
+				stack[depth++] = flip ? first : second;
+				index = flip ? second : first;
+				continue;
+			}
+
+			size_t k;
+			for (k = node->index; k < node->index + node->count; k++)
+			{
+				double candidate[3];
+				closest_on_triangle(bvh->triangles + 9 * k, point, candidate);
+				double d[3] = { candidate[0] - point[0], candidate[1] - point[1], candidate[2] - point[2] };
+				double distance = dot(d, d);
+				if (distance <= best)
+				{
+					best = distance;
+					closest->face = bvh->faces[k];
+					memcpy(closest->point, candidate, sizeof candidate);
+				}
+			}
+		}
+
+		if (depth == 0)
+		{
+			break;
+		}
+		index = stack[--depth];
+	}
+
+	closest->distance = sqrt(best);
+	return closest->face != MESH_BVH_NO_HIT;
+}
+
+/*
+ * triangle_overlaps_box - checks whether a triangle overlaps a box by looking for a separating axis
+ * among the box's axes, the triangle's normal, and the cross products of their edges
+ * (Akenine-Moller)
+ * @param triangle - the corners of the triangle, nine coordinates
+ * @param center   - the center of the box
+ * @param half     - half the size of the box along each axis
+ * @return - 1 if they overlap; 0 otherwise
+ */
+static uint8_t triangle_overlaps_box(double *triangle, double *center, double *half)
+{
+	double corners[3][3];
+	size_t i, j, a;
+	for (i = 0; i < 3; i++)
+	{
+		for (a = 0; a < 3; a++)
+		{
+			corners[i][a] = triangle[3 * i + a] - center[a];
+		}
+	}
+
+	//The box's own axes come down to comparing bounds
+	for (a = 0; a < 3; a++)
+	{
+		double lo = corners[0][a], hi = corners[0][a];
+		for (i = 1; i < 3; i++)
+		{
+			lo = corners[i][a] < lo ? corners[i][a] : lo;
+			hi = corners[i][a] > hi ? corners[i][a] : hi;
+		}
+		if (lo > half[a] || hi < -half[a])
+		{
+			return 0;
+		}
+	}
+
+	double edges[3][3];
+	for (i = 0; i < 3; i++)
+	{
+		for (a = 0; a < 3; a++)
+		{
+			edges[i][a] = corners[(i + 1) % 3][a] - corners[i][a];
+		}
+	}
+
+	//The normal is tried along with the nine edge cross products, as axis index 9
+	for (j = 0; j < 10; j++)
+	{
+		double axis[3];
+		double *edge = edges[j < 9 ? j / 3 : 0];
+		if (j < 9)
+		{
+			//The cross product of the jth box axis with the edge
+			size_t b = j % 3, c = (b + 1) % 3, d = (b + 2) % 3;
+			axis[b] = 0.0;
+			axis[c] = -edge[d];
+			axis[d] = edge[c];
+		}
+		else
+		{
+			axis[0] = edges[0][1] * edges[1][2] - edges[0][2] * edges[1][1];
+			axis[1] = edges[0][2] * edges[1][0] - edges[0][0] * edges[1][2];
+			axis[2] = edges[0][0] * edges[1][1] - edges[0][1] * edges[1][0];
+		}
+
+		double lo = dot(axis, corners[0]), hi = lo;
+		for (i = 1; i < 3; i++)
+		{
+			double p = dot(axis, corners[i]);
+			lo = p < lo ? p : lo;
+			hi = p > hi ? p : hi;
+		}
+		double radius = half[0] * fabs(axis[0]) + half[1] * fabs(axis[1]) + half[2] * fabs(axis[2]);
+		if (lo > radius || hi < -radius)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+size_t mesh_bvh_overlap(mesh_bvh_t *bvh, double *min, double *max, size_t *faces, size_t capacity)
+{
+	double center[3], half[3];
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		center[a] = (min[a] + max[a]) / 2;
+		half[a] = (max[a] - min[a]) / 2;
+	}
+
+	size_t count = 0;
+	size_t stack[BVH_STACK_SIZE];
+	size_t depth = 0;
+	size_t index = 0;
+	while (bvh->num_nodes > 0)
+	{
+		mesh_bvh_node_t *node = bvh->nodes + index;
+		uint8_t overlaps = 1;
+		for (a = 0; a < 3; a++)
+		{
+			overlaps &= node->min[a] <= max[a] && node->max[a] >= min[a];
+		}
+
+		if (overlaps && node->count == 0)
+		{
+			stack[depth++] = node->index;
+			index++;
+			continue;
+		}
+
+		size_t k;
+		for (k = node->index; overlaps && k < node->index + node->count; k++)
+		{
+			if (triangle_overlaps_box(bvh->triangles + 9 * k, center, half))
+			{
+				if (count < capacity)
+				{
+					faces[count] = bvh->faces[k];
+				}
+				count++;
+			}
+		}
+
+		if (depth == 0)
+		{
+			break;
+		}
+		index = stack[--depth];
+	}
+
+	return count;
+}
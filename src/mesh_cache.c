@@ -0,0 +1,596 @@
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mesh_cache.h"
+
+#include "mesh.h"
+#include "point3d.h"
+#include "point3d_vec.h"
+#include "status.h"
+#include "writer.h"
+
+#define MESH_CACHE_MAGIC "CGMC"
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_SUFFIX ".mesh"
+//Followed by the pid of the process writing the entry
+#define MESH_CACHE_TEMP_SUFFIX ".tmp"
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+//The start of every entry, followed by the surface bytes padded to a multiple of 8, the points,
+//and then the normals, if any
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t topology;
+	uint32_t has_normals;
+	uint64_t num_u;
+	uint64_t num_v;
+	uint64_t num_points;
+	uint64_t surface_size;
+} mesh_cache_header_t;
+
+static_assert(sizeof(mesh_cache_header_t) == 48, "The cache header must not be padded.");
+static_assert(sizeof(point3d_t) == 3 * sizeof(double), "Points are stored as packed coordinates.");
+
+//A file in the cache directory, as seen while deciding what to evict
+typedef struct
+{
+	char *name;
+	size_t size;
+	struct timespec used;
+} cache_file_t;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+	for (i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * surface_word - reads a double of the surface bytes, in a form that is the same for every
+ * representation of the same value
+ * @param bytes - the bytes of the double, with no particular alignment
+ * @return - the bits of the double, with -0 turned into 0
+ */
+static uint64_t surface_word(const char *bytes)
+{
+	double value;
+	memcpy(&value, bytes, sizeof value);
+	//Adding 0 turns -0 into 0
+	value += 0.0;
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof bits);
+	return bits;
+}
+
+/*
+ * surface_hash - continues a hash over the surface bytes of a key, taking them as doubles
+ * @param hash - the hash so far
+ * @param key  - the key
+ * @return - the hash
+ */
+static uint64_t surface_hash(uint64_t hash, mesh_cache_key_t *key)
+{
+	const char *bytes = key->surface;
+	size_t i;
+	for (i = 0; i + sizeof(double) <= key->surface_size; i += sizeof(double))
+	{
+		uint64_t word = surface_word(bytes + i);
+		hash = fnv1a(hash, &word, sizeof word);
+	}
+
+	return fnv1a(hash, bytes + i, key->surface_size - i);
+}
+
+/*
+ * surface_matches - checks stored surface bytes against those of a key, taking them as doubles
+ * @param stored - the stored bytes
+ * @param key    - the key
+ * @return - whether they describe the same surface
+ */
+static uint8_t surface_matches(const char *stored, mesh_cache_key_t *key)
+{
+	const char *bytes = key->surface;
+	size_t i;
+	for (i = 0; i + sizeof(double) <= key->surface_size; i += sizeof(double))
+	{
+		if (surface_word(stored + i) != surface_word(bytes + i))
+		{
+			return 0;
+		}
+	}
+
+	return memcmp(stored + i, bytes + i, key->surface_size - i) == 0;
+}
+
+static void make_header(mesh_cache_key_t *key, size_t num_points, mesh_cache_header_t *header)
+{
+	memset(header, 0, sizeof *header);
+	memcpy(header->magic, MESH_CACHE_MAGIC, sizeof header->magic);
+	header->version = MESH_CACHE_VERSION;
+	header->topology = key->topology;
+	header->has_normals = key->has_normals;
+	header->num_u = key->num_u;
+	header->num_v = key->num_v;
+	header->num_points = num_points;
+	header->surface_size = key->surface_size;
+}
+
+static size_t key_num_points(mesh_cache_key_t *key)
+{
+	mesh_source_t shape = { .topology = key->topology, .num_u = key->num_u, .num_v = key->num_v };
+	return mesh_source_num_points(&shape);
+}
+
+static size_t padded_surface_size(mesh_cache_key_t *key)
+{
+	return (key->surface_size + 7) & ~(size_t) 7;
+}
+
+static size_t entry_size(mesh_cache_key_t *key)
+{
+	return sizeof(mesh_cache_header_t) + padded_surface_size(key)
+		+ (key->has_normals ? 2 : 1) * key_num_points(key) * sizeof(point3d_t);
+}
+
+static uint64_t key_hash(mesh_cache_key_t *key)
+{
+	mesh_cache_header_t header;
+	make_header(key, key_num_points(key), &header);
+	uint64_t hash = fnv1a(FNV_OFFSET_BASIS, &header, sizeof header);
+	return surface_hash(hash, key);
+}
+
+/*
+ * entry_path - returns the path of the entry for the key
+ * @param cache  - the cache holding the entry
+ * @param key    - the key of the entry
+ * @param suffix - appended to the path, e.g., to name a temporary file
+ * @return - the path, to be freed by the caller, or NULL if out of memory
+ */
+static char *entry_path(mesh_cache_t *cache, mesh_cache_key_t *key, const char *suffix)
+{
+	size_t length = strlen(cache->directory) + 1 + 16 + strlen(MESH_CACHE_SUFFIX) + strlen(suffix) + 1;
+	char *path;
+	if ((path = malloc(length)) != NULL)
+	{
+		snprintf(path, length, "%s/%016" PRIx64 MESH_CACHE_SUFFIX "%s", cache->directory, key_hash(key), suffix);
+	}
+
+	return path;
+}
+
+uint8_t mesh_cache_lookup(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_cache_entry_t *entry)
+{
+	uint8_t hit = 0;
+
+	char *path;
+	if ((path = entry_path(cache, key, "")) == NULL)
+	{
+		goto exit0;
+	}
+
+	int fd;
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		goto exit1;
+	}
+
+	size_t size = entry_size(key);
+	struct stat info;
+	if (fstat(fd, &info) || (size_t) info.st_size != size)
+	{
+		goto exit2;
+	}
+
+	char *mapping;
+	if ((mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		goto exit2;
+	}
+
+	//The hash names the file, but only the whole key identifies the mesh
+	mesh_cache_header_t header;
+	size_t num_points = key_num_points(key);
+	make_header(key, num_points, &header);
+	if (memcmp(mapping, &header, sizeof header) ||
+		!surface_matches(mapping + sizeof header, key))
+	{
+		munmap(mapping, size);
+		goto exit2;
+	}
+
+	//Touching the entry is what makes it recently used; failing to is harmless
+	futimens(fd, NULL);
+
+	entry->mapping = mapping;
+	entry->mapping_size = size;
+	entry->points = (point3d_t *) (mapping + sizeof header + padded_surface_size(key));
+	entry->normals = key->has_normals ? entry->points + num_points : NULL;
+	entry->cursor = 0;
+	hit = 1;
+
+exit2:
+	close(fd);
+exit1:
+	free(path);
+exit0:
+	return hit;
+}
+
+void mesh_cache_release(mesh_cache_entry_t *entry)
+{
+	munmap(entry->mapping, entry->mapping_size);
+	entry->mapping = NULL;
+}
+
+static void source_rewind(mesh_source_t *source)
+{
+	mesh_cache_entry_t *entry = source->surface;
+	entry->cursor = 0;
+	source->row = 0;
+}
+
+static status_t source_next_row(mesh_source_t *source, point3d_t *points, point3d_t *normals)
+{
+	mesh_cache_entry_t *entry = source->surface;
+	size_t size = mesh_source_row_size(source, source->row);
+	if (points != NULL)
+	{
+		memcpy(points, entry->points + entry->cursor, size * sizeof *points);
+	}
+	if (normals != NULL)
+	{
+		memcpy(normals, entry->normals + entry->cursor, size * sizeof *normals);
+	}
+
+	entry->cursor += size;
+	source->row++;
+	return SUCCESS;
+}
+
+void mesh_cache_source_initialize(mesh_source_t *source, mesh_cache_key_t *key, mesh_cache_entry_t *entry)
+{
+	source->topology = key->topology;
+	source->num_u = key->num_u;
+	source->num_v = key->num_v;
+	source->has_normals = key->has_normals;
+	source->surface = entry;
+	source->rewind = source_rewind;
+	source->next_row = source_next_row;
+	source_rewind(source);
+}
+
+static int compare_used(const void *a, const void *b)
+{
+	const struct timespec *x = &((const cache_file_t *) a)->used;
+	const struct timespec *y = &((const cache_file_t *) b)->used;
+	if (x->tv_sec != y->tv_sec)
+	{
+		return x->tv_sec < y->tv_sec ? -1 : 1;
+	}
+
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/*
+ * stale_temp - checks whether a file is the temporary file of an entry whose writer died before
+ * renaming it into place
+ * @param name - the name of the file
+ * @return - whether the file is such a leftover
+ */
+static uint8_t stale_temp(const char *name)
+{
+	const char *temp;
+	if ((temp = strstr(name, MESH_CACHE_SUFFIX MESH_CACHE_TEMP_SUFFIX)) == NULL)
+	{
+		return 0;
+	}
+
+	const char *start = temp + strlen(MESH_CACHE_SUFFIX MESH_CACHE_TEMP_SUFFIX);
+	char *end;
+	long pid = strtol(start, &end, 10);
+	if (end == start || *end != '\0' || pid <= 0)
+	{
+		return 0;
+	}
+
+	//Another process still writing its entry keeps its file
+	return kill((pid_t) pid, 0) && errno == ESRCH;
+}
+
+/*
+ * evict - removes the temporary files left behind by writers that died, and then the least
+ * recently used entries until the entries together fit in the cache
+ * @param cache - the cache from which to evict
+ * @return - an indication of whether an error occurred
+ */
+static status_t evict(mesh_cache_t *cache)
+{
+	status_t error = SUCCESS;
+
+	DIR *directory;
+	if ((directory = opendir(cache->directory)) == NULL)
+	{
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	cache_file_t *files = NULL;
+	size_t num_files = 0;
+	size_t capacity = 0;
+	size_t total = 0;
+	size_t suffix_length = strlen(MESH_CACHE_SUFFIX);
+
+	struct dirent *file;
+	while ((file = readdir(directory)) != NULL)
+	{
+		if (stale_temp(file->d_name))
+		{
+			unlinkat(dirfd(directory), file->d_name, 0);
+			continue;
+		}
+
+		size_t length = strlen(file->d_name);
+		struct stat info;
+		if (length <= suffix_length ||
+			strcmp(file->d_name + length - suffix_length, MESH_CACHE_SUFFIX) ||
+			fstatat(dirfd(directory), file->d_name, &info, 0) ||
+			!S_ISREG(info.st_mode))
+		{
+			continue;
+		}
+
+		if (num_files == capacity)
+		{
+			capacity = capacity == 0 ? 16 : 2 * capacity;
+			cache_file_t *grown;
+			INITIALIZE_OR_OUT_OF_MEM(grown, realloc(files, capacity * sizeof *files), error, exit1);
+			files = grown;
+		}
+
+		INITIALIZE_OR_OUT_OF_MEM(files[num_files].name, strdup(file->d_name), error, exit1);
+		files[num_files].size = info.st_size;
+		files[num_files].used = info.st_mtim;
+		total += info.st_size;
+		num_files++;
+	}
+
+	if (total > cache->max_size)
+	{
+		qsort(files, num_files, sizeof *files, compare_used);
+
+		size_t i;
+		for (i = 0; i < num_files && total > cache->max_size; i++)
+		{
+			if (unlinkat(dirfd(directory), files[i].name, 0) == 0)
+			{
+				total -= files[i].size;
+			}
+		}
+	}
+
+exit1:
+	while (num_files > 0)
+	{
+		free(files[--num_files].name);
+	}
+	free(files);
+	closedir(directory);
+exit0:
+	return error;
+}
+
+static status_t write_mesh_body(void *body, mesh_cache_key_t *key, writer_t *writer)
+{
+	mesh_t *mesh = body;
+	size_t num_points = key_num_points(key);
+
+	size_t i;
+	for (i = 0; i < num_points; i++)
+	{
+		writer_bytes(writer, (char *) point3d_vec_get(mesh->points, i), sizeof(point3d_t));
+	}
+
+	if (key->has_normals)
+	{
+		for (i = 0; i < num_points; i++)
+		{
+			writer_bytes(writer, (char *) point3d_vec_get(mesh->normals, i), sizeof(point3d_t));
+		}
+	}
+
+	return writer_error(writer);
+}
+
+static status_t write_source_body(void *body, mesh_cache_key_t *key, writer_t *writer)
+{
+	status_t error = SUCCESS;
+	mesh_source_t *source = body;
+	size_t num_rows = mesh_source_num_rows(source);
+
+	point3d_t *row;
+	INITIALIZE_OR_OUT_OF_MEM(row, malloc(mesh_source_max_row_size(source) * sizeof *row), error, exit0);
+
+	size_t r;
+	source->rewind(source);
+	for (r = 0; r < num_rows; r++)
+	{
+		IF_ERROR_GOTO(source->next_row(source, row, NULL), error, exit1);
+		writer_bytes(writer, (char *) row, mesh_source_row_size(source, r) * sizeof *row);
+	}
+
+	if (key->has_normals)
+	{
+		source->rewind(source);
+		for (r = 0; r < num_rows; r++)
+		{
+			IF_ERROR_GOTO(source->next_row(source, NULL, row), error, exit1);
+			writer_bytes(writer, (char *) row, mesh_source_row_size(source, r) * sizeof *row);
+		}
+	}
+
+	error = writer_error(writer);
+
+exit1:
+	free(row);
+exit0:
+	return error;
+}
+
+/*
+ * store_entry - writes an entry to a temporary file and renames it into place, so that a reader
+ * never sees a partial entry, then evicts as needed
+ * @param cache      - the cache to which to add the entry
+ * @param key        - the key of the entry
+ * @param write_body - writes the points and normals of the entry
+ * @param body       - passed along to write_body
+ * @return - an indication of whether an error occurred
+ */
+static status_t store_entry
+(
+	mesh_cache_t *cache,
+	mesh_cache_key_t *key,
+	status_t (*write_body)(void *body, mesh_cache_key_t *key, writer_t *writer),
+	void *body
+)
+{
+	status_t error = SUCCESS;
+
+	if (entry_size(key) > cache->max_size)
+	{
+		goto exit0;
+	}
+
+	//The directory most likely exists already, and if it cannot be made, the open says so
+	mkdir(cache->directory, 0777);
+
+	char suffix[32];
+	snprintf(suffix, sizeof suffix, MESH_CACHE_TEMP_SUFFIX "%ld", (long) getpid());
+
+	char *path;
+	char *temp_path;
+	INITIALIZE_OR_OUT_OF_MEM(path, entry_path(cache, key, ""), error, exit0);
+	INITIALIZE_OR_OUT_OF_MEM(temp_path, entry_path(cache, key, suffix), error, exit1);
+
+	int fd;
+	if ((fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+	{
+		error = FILE_OPEN_ERROR;
+		goto exit2;
+	}
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(fd, WRITER_DEFAULT_PRECISION), error, exit3);
+
+	mesh_cache_header_t header;
+	make_header(key, key_num_points(key), &header);
+	static const char padding[8];
+	writer_bytes(writer, (char *) &header, sizeof header);
+	writer_bytes(writer, key->surface, key->surface_size);
+	writer_bytes(writer, padding, padded_surface_size(key) - key->surface_size);
+	IF_ERROR_GOTO(write_body(body, key, writer), error, exit4);
+	IF_ERROR_GOTO(writer_flush(writer), error, exit4);
+
+	if (rename(temp_path, path))
+	{
+		error = FILE_WRITE_ERROR;
+		goto exit4;
+	}
+
+	error = evict(cache);
+
+exit4:
+	writer_uninitialize(writer);
+exit3:
+	close(fd);
+	if (error)
+	{
+		unlink(temp_path);
+	}
+exit2:
+	free(temp_path);
+exit1:
+	free(path);
+exit0:
+	return error;
+}
+
+status_t mesh_cache_store(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_t *mesh)
+{
+	//Sampling by accumulating a floating-point step can come up a row or column short, and such a
+	//mesh would not play back the same as it was written
+	size_t num_points = key_num_points(key);
+	if (point3d_vec_size(mesh->points) != num_points ||
+		(key->has_normals && point3d_vec_size(mesh->normals) != num_points))
+	{
+		return SUCCESS;
+	}
+
+	return store_entry(cache, key, write_mesh_body, mesh);
+}
+
+status_t mesh_cache_store_source(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_source_t *source)
+{
+	return store_entry(cache, key, write_source_body, source);
+}
+
+status_t mesh_cache_output(mesh_cache_t *cache, mesh_cache_key_t *key, mesh_source_t *generator, mesh_output_t *output,
+	int fd, uint8_t *hit)
+{
+	status_t error = SUCCESS;
+
+	mesh_cache_entry_t entry;
+	*hit = mesh_cache_lookup(cache, key, &entry);
+	if (!*hit && generator != NULL)
+	{
+		//A streamed mesh is never held in memory, so it goes into the cache a row at a time and is
+		//then played back from there
+		IF_ERROR_GOTO(mesh_cache_store_source(cache, key, generator), error, exit0);
+		*hit = mesh_cache_lookup(cache, key, &entry);
+	}
+
+	if (*hit)
+	{
+		mesh_source_t source;
+		mesh_cache_source_initialize(&source, key, &entry);
+		error = mesh_stream_output(&source, output, fd);
+		mesh_cache_release(&entry);
+	}
+
+exit0:
+	return error;
+}
+
+status_t mesh_cache_parse_max_size(char *string, size_t *max_size)
+{
+	char *end;
+	long value = strtol(string, &end, 10);
+	if (*string == '\0' || *end != '\0' || value < 1 || (unsigned long) value > SIZE_MAX >> 20)
+	{
+		return ARGS_ERROR;
+	}
+
+	*max_size = (size_t) value << 20;
+	return SUCCESS;
+}
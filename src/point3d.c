@@ -6,6 +6,7 @@
 
 #include "matrix.h"
 #include "status.h"
+#include "writer.h"
 
 point3d_t *point3d_initialize(void)
 {
@@ -84,9 +85,9 @@ void point3d_fmad(point3d_t *dst, point3d_t *src, double s)
 	dst->z += src->z * s;
 }
 
-void point3d_print_to_iv(point3d_t *point, FILE *file, double r)
+void point3d_print_to_iv(point3d_t *point, writer_t *writer, double r)
 {
-	fprintf(file,
+	writer_string(writer,
 "Separator {\n\
 	LightModel {\n\
 		model PHONG\n\
@@ -95,12 +96,141 @@ void point3d_print_to_iv(point3d_t *point, FILE *file, double r)
 		diffuseColor 1.0 1.0 1.0\n\
 	}\n\
 	Transform {\n\
-		translation %lf %lf %lf\n\
+		translation ");
+	writer_point(writer, point->x, point->y, point->z);
+	writer_string(writer, "\n\
 	}\n\
 	Sphere {\n\
-		radius %lf\n\
+		radius ");
+	writer_double(writer, r);
+	writer_string(writer, "\n\
 	}\n\
-}\n", point->x, point->y, point->z, r);
+}\n");
+}
+
+static void print_instanced_to_iv(point3d_t *points, size_t count, double r, writer_t *writer)
+{
+	writer_string(writer,
+"Separator {\n\
+	LightModel {\n\
+		model PHONG\n\
+	}\n\
+	Material {\n\
+		diffuseColor 1.0 1.0 1.0\n\
+	}\n");
+
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		point3d_t *point = points + i;
+		writer_string(writer,
+"	Separator {\n\
+		Translation {\n\
+			translation ");
+		writer_point(writer, point->x, point->y, point->z);
+		writer_string(writer, "\n\
+		}\n");
+
+		//The first sphere is the one every later point shares
+		if (i == 0)
+		{
+			writer_string(writer,
+"		DEF ControlPoint Sphere {\n\
+			radius ");
+			writer_double(writer, r);
+			writer_string(writer, "\n\
+		}\n");
+		}
+		else
+		{
+			writer_string(writer, "		USE ControlPoint\n");
+		}
+
+		writer_string(writer, "	}\n");
+	}
+
+	writer_string(writer, "}\n");
+}
+
+static void print_pointset_to_iv(point3d_t *points, size_t count, writer_t *writer)
+{
+	writer_string(writer,
+"Separator {\n\
+	LightModel {\n\
+		model BASE_COLOR\n\
+	}\n\
+	Material {\n\
+		diffuseColor 1.0 1.0 1.0\n\
+	}\n\
+	Coordinate3 {\n\
+		point [\n");
+
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		point3d_t *point = points + i;
+		writer_string(writer, "			");
+		writer_point(writer, point->x, point->y, point->z);
+		writer_string(writer, ",\n");
+	}
+
+	writer_string(writer,
+"		]\n\
+	}\n\
+	PointSet {\n\
+	}\n\
+}\n");
+}
+
+void point3d_print_array_to_iv(point3d_t *points, size_t count, double r, point3d_style_t style, writer_t *writer)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	switch (style)
+	{
+		case POINT3D_STYLE_SPHERES:
+		{
+			size_t i;
+			for (i = 0; i < count; i++)
+			{
+				point3d_print_to_iv(points + i, writer, r);
+			}
+			break;
+		}
+
+		case POINT3D_STYLE_INSTANCED:
+			print_instanced_to_iv(points, count, r, writer);
+			break;
+
+		case POINT3D_STYLE_POINTSET:
+			print_pointset_to_iv(points, count, writer);
+			break;
+	}
+}
+
+status_t point3d_parse_style(char *string, point3d_style_t *style)
+{
+	if (strcmp(string, "spheres") == 0)
+	{
+		*style = POINT3D_STYLE_SPHERES;
+	}
+	else if (strcmp(string, "instanced") == 0)
+	{
+		*style = POINT3D_STYLE_INSTANCED;
+	}
+	else if (strcmp(string, "points") == 0)
+	{
+		*style = POINT3D_STYLE_POINTSET;
+	}
+	else
+	{
+		return ARGS_ERROR;
+	}
+
+	return SUCCESS;
 }
 
 status_t point3d_initialize_matrix(matrix_t **m, double *pos)
@@ -115,8 +245,8 @@ success:
 }
 
 
-void point3d_print_matrix_to_iv(matrix_t *m, FILE *file, double r)
+void point3d_print_matrix_to_iv(matrix_t *m, writer_t *writer, double r)
 {
 	point3d_t p = { matrix_get(m, 0, 0), matrix_get(m, 1, 0), matrix_get(m, 2, 0) };
-	point3d_print_to_iv(&p, file, r);
+	point3d_print_to_iv(&p, writer, r);
 }
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "point3d_buffer.h"
+
+#include "point3d.h"
+#include "status.h"
+
+#define POINT3D_BUFFER_MIN_CAPACITY 16
+
+point3d_buffer_t *point3d_buffer_initialize(void)
+{
+	point3d_buffer_t *buffer;
+	if ((buffer = malloc(sizeof *buffer)) == NULL)
+	{
+		return NULL;
+	}
+
+	buffer->points = NULL;
+	buffer->size = 0;
+	buffer->capacity = 0;
+	buffer->mapping = NULL;
+	buffer->mapping_size = 0;
+	return buffer;
+}
+
+static void release(point3d_buffer_t *buffer)
+{
+	if (buffer->mapping != NULL)
+	{
+		munmap(buffer->mapping, buffer->mapping_size);
+		buffer->mapping = NULL;
+		buffer->mapping_size = 0;
+	}
+	else
+	{
+		free(buffer->points);
+	}
+}
+
+void point3d_buffer_uninitialize(point3d_buffer_t *buffer)
+{
+	release(buffer);
+	free(buffer);
+}
+
+status_t point3d_buffer_reserve(point3d_buffer_t *buffer, size_t capacity)
+{
+	if (capacity <= buffer->capacity)
+	{
+		return SUCCESS;
+	}
+
+	//Points borrowed from a mapping are copied out rather than grown in place
+	point3d_t *points;
+	if (capacity > SIZE_MAX / sizeof *points ||
+		(points = realloc(buffer->mapping != NULL ? NULL : buffer->points, capacity * sizeof *points)) == NULL)
+	{
+		return OUT_OF_MEM;
+	}
+
+	if (buffer->mapping != NULL)
+	{
+		memcpy(points, buffer->points, buffer->size * sizeof *points);
+		release(buffer);
+	}
+
+	buffer->points = points;
+	buffer->capacity = capacity;
+	return SUCCESS;
+}
+
+void point3d_buffer_adopt_mapping(point3d_buffer_t *buffer, void *mapping, size_t mapping_size, point3d_t *points, size_t count)
+{
+	release(buffer);
+	buffer->points = points;
+	buffer->size = count;
+	buffer->capacity = count;
+	buffer->mapping = mapping;
+	buffer->mapping_size = mapping_size;
+}
+
+void point3d_buffer_drop_front(point3d_buffer_t *buffer, size_t count)
+{
+	if (buffer->mapping != NULL)
+	{
+		//Borrowed points are never freed by pointer, so the window can just move
+		buffer->points += count;
+		buffer->capacity -= count;
+	}
+	else
+	{
+		memmove(buffer->points, buffer->points + count, (buffer->size - count) * sizeof *buffer->points);
+	}
+	buffer->size -= count;
+}
+
+status_t point3d_buffer_push_back(point3d_buffer_t *buffer, double x, double y, double z)
+{
+	status_t error = SUCCESS;
+
+	if (buffer->size == buffer->capacity)
+	{
+		size_t capacity = buffer->capacity < POINT3D_BUFFER_MIN_CAPACITY ?
+			POINT3D_BUFFER_MIN_CAPACITY : 2 * buffer->capacity;
+		IF_ERROR_GOTO(point3d_buffer_reserve(buffer, capacity), error, exit0);
+	}
+
+	point3d_t *point = buffer->points + buffer->size++;
+	point->x = x;
+	point->y = y;
+	point->z = z;
+
+exit0:
+	return error;
+}
+
+point3d_t *point3d_buffer_get(point3d_buffer_t *buffer, size_t index)
+{
+	return buffer->points + index;
+}
+
+size_t point3d_buffer_size(point3d_buffer_t *buffer)
+{
+	return buffer->size;
+}
@@ -3,6 +3,11 @@
 
 #include "polyline.h"
 
+#include "point3d.h"
+#include "point3d_vec.h"
+#include "status.h"
+#include "writer.h"
+
 polyline_t *polyline_initialize(void)
 {
 	polyline_t *polyline = malloc(sizeof *polyline);
@@ -55,9 +60,45 @@ exit0:
 	return error;
 }
 
-void polyline_print_to_iv(polyline_t *poly, FILE *stream)
+status_t polyline_weld(polyline_t *poly, double tolerance)
+{
+	point3d_vec_t *welded;
+	if ((welded = point3d_vec_initialize()) == NULL)
+	{
+		return OUT_OF_MEM;
+	}
+
+	double limit = tolerance * tolerance;
+	point3d_t *last = NULL;
+	size_t num = point3d_vec_size(poly->points);
+	size_t i;
+	for (i = 0; i < num; i++)
+	{
+		point3d_t *point = point3d_vec_get(poly->points, i);
+		if (last != NULL)
+		{
+			double dx = point->x - last->x;
+			double dy = point->y - last->y;
+			double dz = point->z - last->z;
+			if (dx * dx + dy * dy + dz * dz <= limit)
+			{
+				point3d_uninitialize(point);
+				continue;
+			}
+		}
+
+		point3d_vec_push_back(welded, point);
+		last = point;
+	}
+
+	point3d_vec_uninitialize(poly->points);
+	poly->points = welded;
+	return SUCCESS;
+}
+
+void polyline_print_to_iv(polyline_t *poly, writer_t *writer)
 {
-	fprintf(stream,
+	writer_string(writer,
 "Separator {\n\
 	LightModel {\n\
 		model BASE_COLOR\n\
@@ -75,11 +116,12 @@ void polyline_print_to_iv(polyline_t *poly, FILE *stream)
 	for (i = 0; i < num; i++)
 	{
 		point3d_t *point = point3d_vec_get(poly->points, i);
-		fprintf(stream,
-"			%lf %lf %lf,\n", point->x, point->y, point->z);
+		writer_string(writer, "			");
+		writer_point(writer, point->x, point->y, point->z);
+		writer_string(writer, ",\n");
 	}
 
-	fprintf(stream,
+	writer_string(writer,
 "		]\n\
 }\n\
 	IndexedLineSet {\n\
@@ -87,11 +129,12 @@ void polyline_print_to_iv(polyline_t *poly, FILE *stream)
 
 	for (i = 0; i < num; i++)
 	{
-		fprintf(stream,
-"			%zu,\n", i);
+		writer_string(writer, "			");
+		writer_size(writer, i);
+		writer_string(writer, ",\n");
 	}
 
-	fprintf(stream,
+	writer_string(writer,
 "			-1,\n\
 		]\n\
 	}\n\
@@ -0,0 +1,145 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "graphics.h"
+#include "point3d_buffer.h"
+#include "status.h"
+#include "writer.h"
+
+typedef struct
+{
+	char *input;
+	char *output;
+	long scalar_size;
+	long num_threads;
+} args_t;
+
+status_t parse_args(int argc, char **argv, args_t *args);
+void usage(char *prog);
+
+int main(int argc, char **argv)
+{
+	status_t error = SUCCESS;
+
+	args_t args;
+	if ((error = parse_args(argc, argv, &args)))
+	{
+		usage(argv[0]);
+		goto exit0;
+	}
+
+	FILE *file = stdin;
+	if (args.input != NULL && (file = fopen(args.input, "r")) == NULL)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args.input);
+		error = FILE_OPEN_ERROR;
+		goto exit0;
+	}
+
+	point3d_buffer_t *points;
+	INITIALIZE_OR_OUT_OF_MEM(points, point3d_buffer_initialize(), error, exit1);
+
+	if ((error = read_points_parallel(file, points, args.num_threads)))
+	{
+		goto exit2;
+	}
+
+	int fd = STDOUT_FILENO;
+	if (args.output != NULL && (fd = open(args.output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		fprintf(stderr, "ERROR: could not open file %s\n", args.output);
+		error = FILE_OPEN_ERROR;
+		goto exit2;
+	}
+
+	writer_t *writer;
+	INITIALIZE_OR_OUT_OF_MEM(writer, writer_initialize(fd, WRITER_DEFAULT_PRECISION), error, exit3);
+
+	if ((error = write_points_binary(points, args.scalar_size, writer)) ||
+		(error = writer_flush(writer)))
+	{
+		fprintf(stderr, "ERROR: could not write the points\n");
+	}
+
+	writer_uninitialize(writer);
+exit3:
+	if (fd != STDOUT_FILENO)
+	{
+		close(fd);
+	}
+exit2:
+	point3d_buffer_uninitialize(points);
+exit1:
+	if (file != stdin)
+	{
+		fclose(file);
+	}
+exit0:
+	return error;
+}
+
+status_t parse_args(int argc, char **argv, args_t *args)
+{
+	args->input = NULL;
+	args->output = NULL;
+	args->scalar_size = sizeof(double);
+	long procs = sysconf(_SC_NPROCESSORS_ONLN);
+	args->num_threads = procs > 0 ? procs : 1;
+
+#define CHECK_OR_RETURN(cond) do { if (cond) { return ARGS_ERROR; } } while (0)
+
+	char opt;
+	while ((opt = getopt(argc, argv, "f:o:s:j:")) > 0)
+	{
+		switch (opt)
+		{
+			case 'f':
+			{
+				args->input = optarg;
+				break;
+			}
+
+			case 'o':
+			{
+				args->output = optarg;
+				break;
+			}
+
+			case 's':
+			{
+				char *end;
+				args->scalar_size = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(*end != '\0' ||
+					(args->scalar_size != sizeof(float) && args->scalar_size != sizeof(double)));
+				break;
+			}
+
+			case 'j':
+			{
+				char *end;
+				args->num_threads = strtol(optarg, &end, 10);
+				CHECK_OR_RETURN(args->num_threads < 1 || *end != '\0');
+				break;
+			}
+
+			case '?':
+			{
+				return ARGS_ERROR;
+			}
+		}
+	}
+
+#undef CHECK_OR_RETURN
+
+	return optind == argc ? SUCCESS : ARGS_ERROR;
+}
+
+void usage(char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-f input file] [-o output file] [-s 4 (floats) or 8 (doubles)]\n"
+		"	[-j number of parsing threads]\n", prog);
+}
@@ -0,0 +1,273 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "quaternion.h"
+
+#include "matrix.h"
+#include "transforms.h"
+
+//Number of quaternions converted together, in structure-of-arrays form, by the array functions
+#define QUATERNION_BLOCK 64
+
+void quaternion_identity(quaternion_t *q)
+{
+	q->w = 1.0;
+	q->x = q->y = q->z = 0.0;
+}
+
+void quaternion_from_axis_angle(quaternion_t *q, double *axis, double t)
+{
+	double length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	double s = sin(t / 2.0) / length;
+	q->w = cos(t / 2.0);
+	q->x = axis[0] * s;
+	q->y = axis[1] * s;
+	q->z = axis[2] * s;
+}
+
+void quaternion_from_rotation(quaternion_t *q, double t, rotatedir_t dir)
+{
+	double axis[3] = { 0.0, 0.0, 0.0 };
+	axis[dir == ROTATE_X ? 0 : dir == ROTATE_Y ? 1 : 2] = 1.0;
+	quaternion_from_axis_angle(q, axis, t);
+}
+
+void quaternion_to_axis_angle(quaternion_t *q, double *axis, double *t)
+{
+	double w = q->w > 1.0 ? 1.0 : q->w < -1.0 ? -1.0 : q->w;
+	double s = sqrt(q->x * q->x + q->y * q->y + q->z * q->z);
+	*t = 2.0 * atan2(s, w);
+	if (s == 0.0)
+	{
+		axis[0] = 1.0;
+		axis[1] = axis[2] = 0.0;
+		return;
+	}
+
+	axis[0] = q->x / s;
+	axis[1] = q->y / s;
+	axis[2] = q->z / s;
+}
+
+void quaternion_multiply(quaternion_t *c, quaternion_t *a, quaternion_t *b)
+{
+	quaternion_t r =
+	{
+		a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z,
+		a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y,
+		a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x,
+		a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w,
+	};
+	*c = r;
+}
+
+void quaternion_conjugate(quaternion_t *q)
+{
+	q->x = -q->x;
+	q->y = -q->y;
+	q->z = -q->z;
+}
+
+void quaternion_normalize(quaternion_t *q)
+{
+	double length = sqrt(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
+	q->w /= length;
+	q->x /= length;
+	q->y /= length;
+	q->z /= length;
+}
+
+void quaternion_slerp(quaternion_t *c, quaternion_t *a, quaternion_t *b, double t)
+{
+	double cos_theta = a->w * b->w + a->x * b->x + a->y * b->y + a->z * b->z;
+
+	//q and -q are the same rotation, so flip b if need be to go the short way around
+	double sign = 1.0;
+	if (cos_theta < 0.0)
+	{
+		cos_theta = -cos_theta;
+		sign = -1.0;
+	}
+
+	double wa, wb;
+	if (cos_theta > 0.9995)
+	{
+		//Nearly parallel, where sin(theta) is too small to divide by; a normalized lerp is accurate
+		wa = 1.0 - t;
+		wb = t;
+	}
+	else
+	{
+		double theta = acos(cos_theta);
+		double sin_theta = sin(theta);
+		wa = sin((1.0 - t) * theta) / sin_theta;
+		wb = sin(t * theta) / sin_theta;
+	}
+	wb *= sign;
+
+	quaternion_t r =
+	{
+		wa * a->w + wb * b->w,
+		wa * a->x + wb * b->x,
+		wa * a->y + wb * b->y,
+		wa * a->z + wb * b->z,
+	};
+	quaternion_normalize(&r);
+	*c = r;
+}
+
+void quaternion_rotate_point(quaternion_t *q, double *in, double *out)
+{
+	//v' = v + 2w(u x v) + 2u x (u x v), where u is the vector part of q
+	double ux = q->x, uy = q->y, uz = q->z;
+	double tx = 2.0 * (uy * in[2] - uz * in[1]);
+	double ty = 2.0 * (uz * in[0] - ux * in[2]);
+	double tz = 2.0 * (ux * in[1] - uy * in[0]);
+
+	double x = in[0] + q->w * tx + (uy * tz - uz * ty);
+	double y = in[1] + q->w * ty + (uz * tx - ux * tz);
+	double z = in[2] + q->w * tz + (ux * ty - uy * tx);
+	out[0] = x;
+	out[1] = y;
+	out[2] = z;
+}
+
+//Writes the top three rows of the rotation for one quaternion, which the 4x4 and 3x4 layouts share
+static inline void rotation_rows(double w, double x, double y, double z, double *r)
+{
+	double xx = x * x, yy = y * y, zz = z * z;
+	double xy = x * y, xz = x * z, yz = y * z;
+	double wx = w * x, wy = w * y, wz = w * z;
+
+	r[0] = 1.0 - 2.0 * (yy + zz);
+	r[1] = 2.0 * (xy - wz);
+	r[2] = 2.0 * (xz + wy);
+	r[3] = 0.0;
+	r[4] = 2.0 * (xy + wz);
+	r[5] = 1.0 - 2.0 * (xx + zz);
+	r[6] = 2.0 * (yz - wx);
+	r[7] = 0.0;
+	r[8] = 2.0 * (xz - wy);
+	r[9] = 2.0 * (yz + wx);
+	r[10] = 1.0 - 2.0 * (xx + yy);
+	r[11] = 0.0;
+}
+
+void quaternion_to_array(quaternion_t *q, double *array)
+{
+	rotation_rows(q->w, q->x, q->y, q->z, array);
+	array[12] = array[13] = array[14] = 0.0;
+	array[15] = 1.0;
+}
+
+void quaternion_to_array_3x4(quaternion_t *q, double *array)
+{
+	rotation_rows(q->w, q->x, q->y, q->z, array);
+}
+
+matrix_t *quaternion_to_matrix(quaternion_t *q)
+{
+	double array[16];
+	quaternion_to_array(q, array);
+	return matrix_initialize_with_array(4, 4, array);
+}
+
+void quaternion_to_matrix_assign(matrix_t *m, quaternion_t *q)
+{
+	double array[16];
+	quaternion_to_array(q, array);
+	matrix_assign_from_array(m, array);
+}
+
+void quaternion_array_multiply(quaternion_t *c, quaternion_t *a, quaternion_t *b, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+	{
+		quaternion_multiply(c + i, a + i, b + i);
+	}
+}
+
+void quaternion_array_chain(quaternion_t *world, quaternion_t *local, size_t n)
+{
+	if (n == 0)
+	{
+		return;
+	}
+
+	world[0] = local[0];
+	size_t i;
+	for (i = 1; i < n; i++)
+	{
+		quaternion_multiply(world + i, world + i - 1, local + i);
+	}
+}
+
+//Converts up to QUATERNION_BLOCK quaternions at once. The components are first gathered into one
+//array each so that the arithmetic runs straight across lanes and can be vectorized.
+static void convert_block(quaternion_t *q, size_t n, double *arrays, size_t stride)
+{
+	double w[QUATERNION_BLOCK], x[QUATERNION_BLOCK], y[QUATERNION_BLOCK], z[QUATERNION_BLOCK];
+	double r[12][QUATERNION_BLOCK];
+
+	size_t i, k;
+	for (i = 0; i < n; i++)
+	{
+		w[i] = q[i].w;
+		x[i] = q[i].x;
+		y[i] = q[i].y;
+		z[i] = q[i].z;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		double xx = x[i] * x[i], yy = y[i] * y[i], zz = z[i] * z[i];
+		double xy = x[i] * y[i], xz = x[i] * z[i], yz = y[i] * z[i];
+		double wx = w[i] * x[i], wy = w[i] * y[i], wz = w[i] * z[i];
+
+		r[0][i] = 1.0 - 2.0 * (yy + zz);
+		r[1][i] = 2.0 * (xy - wz);
+		r[2][i] = 2.0 * (xz + wy);
+		r[4][i] = 2.0 * (xy + wz);
+		r[5][i] = 1.0 - 2.0 * (xx + zz);
+		r[6][i] = 2.0 * (yz - wx);
+		r[8][i] = 2.0 * (xz - wy);
+		r[9][i] = 2.0 * (yz + wx);
+		r[10][i] = 1.0 - 2.0 * (xx + yy);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		double *out = arrays + stride * i;
+		for (k = 0; k < 12; k++)
+		{
+			out[k] = (k & 3) == 3 ? 0.0 : r[k][i];
+		}
+
+		if (stride == 16)
+		{
+			out[12] = out[13] = out[14] = 0.0;
+			out[15] = 1.0;
+		}
+	}
+}
+
+void quaternion_array_to_arrays(quaternion_t *q, size_t n, double *arrays)
+{
+	size_t first;
+	for (first = 0; first < n; first += QUATERNION_BLOCK)
+	{
+		size_t count = n - first < QUATERNION_BLOCK ? n - first : QUATERNION_BLOCK;
+		convert_block(q + first, count, arrays + 16 * first, 16);
+	}
+}
+
+void quaternion_array_to_arrays_3x4(quaternion_t *q, size_t n, double *arrays)
+{
+	size_t first;
+	for (first = 0; first < n; first += QUATERNION_BLOCK)
+	{
+		size_t count = n - first < QUATERNION_BLOCK ? n - first : QUATERNION_BLOCK;
+		convert_block(q + first, count, arrays + 12 * first, 12);
+	}
+}
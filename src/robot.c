@@ -0,0 +1,200 @@
+#include <stdlib.h>
+
+#include "robot.h"
+
+#include "affine.h"
+#include "cuboid.h"
+#include "draw_list.h"
+#include "hierarchical.h"
+#include "point3d.h"
+#include "status.h"
+#include "transforms.h"
+#include "writer.h"
+
+const rotatedir_t robot_joint_axes[ROBOT_JOINTS] = { ROTATE_Z, ROTATE_Y, ROTATE_Y };
+
+static status_t point_emit(model_t *model, affine_t *transform, writer_t *writer)
+{
+	point3d_t real_coords;
+	affine_transform_point(transform, model->points, &real_coords);
+	point3d_print_to_iv(&real_coords, writer, 0.2);
+
+	return SUCCESS;
+}
+
+static status_t point_model_initialize(hierarchical_t *model, double *loc, double *pt)
+{
+	status_t error = SUCCESS;
+
+	INITIALIZE_OR_OUT_OF_MEM
+	(
+		model->model.points,
+		point3d_initialize_with_coords(loc[0], loc[1], loc[2]),
+		error, exit0
+	);
+
+	translation_affine(&model->from_parent, pt[0], pt[1], pt[2]);
+	model->dirty = 1;
+
+	model->model.emit = point_emit;
+	model->sibling = NULL;
+	model->child = NULL;
+
+exit0:
+	return error;
+}
+
+static void point_model_uninitialize(hierarchical_t *model)
+{
+	point3d_uninitialize(model->model.points);
+}
+
+static status_t cuboid_emit(model_t *model, affine_t *transform, writer_t *writer)
+{
+	point3d_t real_coords[CUBOID_POINTS];
+
+	size_t i;
+	for (i = 0; i < CUBOID_POINTS; i++)
+	{
+		affine_transform_point(transform, model->points + i, real_coords + i);
+	}
+	cuboid_print_points_to_iv(real_coords, writer);
+
+	return SUCCESS;
+}
+
+static status_t cuboid_model_initialize(hierarchical_t *model, double *ll, double *ur, double *pt, double pr, rotatedir_t dir)
+{
+	status_t error = SUCCESS;
+
+	INITIALIZE_OR_OUT_OF_MEM(model->model.points, malloc(CUBOID_POINTS * sizeof *model->model.points), error, exit0);
+	cuboid_corners(model->model.points, ll, ur);
+
+	translation_rotation_affine(&model->from_parent, pt[0], pt[1], pt[2], pr, dir);
+	model->dirty = 1;
+
+	model->model.emit = cuboid_emit;
+	model->sibling = NULL;
+	model->child = NULL;
+
+exit0:
+	return error;
+}
+
+static void cuboid_model_uninitialize(hierarchical_t *model)
+{
+	free(model->model.points);
+}
+
+static void joint_transform(robot_t *robot, size_t joint, double theta)
+{
+	double offset = joint == 0 ? ROBOT_BASE_HEIGHT : robot->lengths[joint - 1];
+	translation_rotation_affine(&robot->local, 0.0, 0.0, offset, theta, robot_joint_axes[joint]);
+}
+
+status_t robot_initialize(robot_t *robot, double *lengths, double *thetas)
+{
+	status_t error = SUCCESS;
+	hierarchical_t *models = robot->models;
+
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		robot->lengths[i] = lengths[i];
+	}
+
+	IF_ERROR_GOTO
+	(
+		point_model_initialize(models + 0, (double[]) { 0.0, 0.0, 0.0 }, (double[]) { 0.0, 0.0, 0.0 }), error, exit0
+	);
+
+	IF_ERROR_GOTO
+	(
+		cuboid_model_initialize
+		(
+			models + 1,
+			(double[]) { -2, -2, 0 }, (double[]) { 2, 2, ROBOT_BASE_HEIGHT },
+			(double[]) { 0, 0, 0 }, 0, ROTATE_X
+		),
+		error, exit1
+	);
+	models[0].child = models + 1;
+
+	//Each link is a cuboid sitting on top of the previous piece, rotating around its joint's axis
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		double offset = i == 0 ? ROBOT_BASE_HEIGHT : lengths[i - 1];
+		IF_ERROR_GOTO
+		(
+			cuboid_model_initialize
+			(
+				models + i + 2,
+				(double[]) { -.5, -.5, 0 }, (double[]) { .5, .5, lengths[i] },
+				(double[]) { 0, 0, offset }, thetas[i], robot_joint_axes[i]
+			),
+			error, exit2
+		);
+		models[i + 1].child = models + i + 2;
+	}
+
+	IF_ERROR_GOTO
+	(
+		point_model_initialize
+		(
+			models + ROBOT_NODES - 1,
+			(double[]) { 0.0, 0.0, 0.0 }, (double[]) { 0.0, 0.0, lengths[ROBOT_JOINTS - 1] }
+		),
+		error, exit2
+	);
+	models[ROBOT_NODES - 2].child = models + ROBOT_NODES - 1;
+
+	INITIALIZE_OR_OUT_OF_MEM(robot->flat, hierarchical_compile(models + 0), error, exit3);
+	affine_identity(&robot->base);
+
+	goto success;
+
+exit3:
+	point_model_uninitialize(models + ROBOT_NODES - 1);
+exit2:
+	while (i-- > 0)
+	{
+		cuboid_model_uninitialize(models + i + 2);
+	}
+	cuboid_model_uninitialize(models + 1);
+exit1:
+	point_model_uninitialize(models + 0);
+exit0:
+
+success:
+	return error;
+}
+
+void robot_uninitialize(robot_t *robot)
+{
+	hierarchical_flat_uninitialize(robot->flat);
+	point_model_uninitialize(robot->models + ROBOT_NODES - 1);
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		cuboid_model_uninitialize(robot->models + i + 2);
+	}
+	cuboid_model_uninitialize(robot->models + 1);
+	point_model_uninitialize(robot->models + 0);
+}
+
+void robot_set_angles(robot_t *robot, double *thetas)
+{
+	//The models form a single chain, so each model's pre-order index is its position in the array
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		joint_transform(robot, i, thetas[i]);
+		hierarchical_set_from_parent(robot->models + i + 2, &robot->local);
+		hierarchical_flat_set_local(robot->flat, i + 2, &robot->local);
+	}
+}
+
+status_t robot_draw(robot_t *robot, draw_list_t *list)
+{
+	return hierarchical_flat_draw(robot->flat, &robot->base, list);
+}
@@ -0,0 +1,393 @@
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "robot_fk.h"
+
+#include "robot.h"
+#include "status.h"
+#include "transforms.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Point clouds are written in host order.");
+static_assert(sizeof(robot_fk_header_t) == 24, "Point cloud header must be packed.");
+
+//Number of samples each round of threads evaluates before the results are written out
+#define FK_CHUNK (1 << 20)
+
+size_t robot_fk_num_samples(robot_fk_samples_t *samples)
+{
+	if (samples->sampling == FK_RANDOM)
+	{
+		return samples->count;
+	}
+
+	size_t total = 1;
+	size_t i;
+	for (i = 0; i < ROBOT_JOINTS; i++)
+	{
+		total *= samples->steps;
+	}
+
+	return total;
+}
+
+static uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+void robot_fk_sample_angles(robot_fk_samples_t *samples, size_t first, size_t n, double **thetas)
+{
+	size_t i, j;
+	if (samples->sampling == FK_RANDOM)
+	{
+		for (j = 0; j < ROBOT_JOINTS; j++)
+		{
+			double lo = samples->lo[j];
+			double range = samples->hi[j] - lo;
+			for (i = 0; i < n; i++)
+			{
+				uint64_t bits = splitmix64(samples->seed ^ ((first + i) * ROBOT_JOINTS + j));
+				thetas[j][i] = lo + range * ((bits >> 11) * 0x1.0p-53);
+			}
+		}
+		return;
+	}
+
+	//The last joint varies fastest
+	size_t steps = samples->steps;
+	double denom = steps > 1 ? (double) (steps - 1) : 1.0;
+	for (i = 0; i < n; i++)
+	{
+		size_t index = first + i;
+		for (j = ROBOT_JOINTS; j-- > 0;)
+		{
+			double lo = samples->lo[j];
+			thetas[j][i] = lo + (samples->hi[j] - lo) * ((index % steps) / denom);
+			index /= steps;
+		}
+	}
+}
+
+static void grow_bounds(robot_bounds_t *bounds, double *x, double *y, double *z, size_t n)
+{
+	double *coords[3] = { x, y, z };
+	size_t k;
+	for (k = 0; k < 3; k++)
+	{
+		double min = bounds->min[k];
+		double max = bounds->max[k];
+		size_t i;
+		for (i = 0; i < n; i++)
+		{
+			min = coords[k][i] < min ? coords[k][i] : min;
+			max = coords[k][i] > max ? coords[k][i] : max;
+		}
+		bounds->min[k] = min;
+		bounds->max[k] = max;
+	}
+}
+
+static void merge_bounds(robot_bounds_t *dst, robot_bounds_t *src)
+{
+	size_t k;
+	for (k = 0; k < 3; k++)
+	{
+		dst->min[k] = src->min[k] < dst->min[k] ? src->min[k] : dst->min[k];
+		dst->max[k] = src->max[k] > dst->max[k] ? src->max[k] : dst->max[k];
+	}
+}
+
+static void empty_bounds(robot_bounds_t *bounds)
+{
+	size_t k;
+	for (k = 0; k < 3; k++)
+	{
+		bounds->min[k] = DBL_MAX;
+		bounds->max[k] = -DBL_MAX;
+	}
+}
+
+static void evaluate_block(double *lengths, double **thetas, size_t n, float *positions, robot_bounds_t *bounds)
+{
+	//The running orientation, as its three columns, and position of the end of the arm, one lane
+	//per sample. Every loop below runs straight across the lanes so it can be vectorized.
+	double col[3][3][ROBOT_FK_BLOCK];
+	double pos[3][ROBOT_FK_BLOCK];
+	double c[ROBOT_FK_BLOCK], s[ROBOT_FK_BLOCK];
+
+	size_t i, j, k;
+	for (i = 0; i < n; i++)
+	{
+		col[0][0][i] = 1.0; col[0][1][i] = 0.0; col[0][2][i] = 0.0;
+		col[1][0][i] = 0.0; col[1][1][i] = 1.0; col[1][2][i] = 0.0;
+		col[2][0][i] = 0.0; col[2][1][i] = 0.0; col[2][2][i] = 1.0;
+		pos[0][i] = 0.0;
+		pos[1][i] = 0.0;
+		pos[2][i] = ROBOT_BASE_HEIGHT;
+	}
+
+	for (j = 0; j < ROBOT_JOINTS; j++)
+	{
+		double *t = thetas[j];
+		for (i = 0; i < n; i++)
+		{
+			c[i] = cos(t[i]);
+			s[i] = sin(t[i]);
+		}
+
+		//Post-multiplying by the joint's rotation only mixes the two columns perpendicular to its axis
+		size_t a, b;
+		switch (robot_joint_axes[j])
+		{
+			case ROTATE_X:
+				a = 1, b = 2;
+				break;
+			case ROTATE_Y:
+				a = 2, b = 0;
+				break;
+			case ROTATE_Z:
+			default:
+				a = 0, b = 1;
+				break;
+		}
+
+		for (k = 0; k < 3; k++)
+		{
+			double *ca = col[a][k], *cb = col[b][k];
+			for (i = 0; i < n; i++)
+			{
+				double na = c[i] * ca[i] + s[i] * cb[i];
+				double nb = c[i] * cb[i] - s[i] * ca[i];
+				ca[i] = na;
+				cb[i] = nb;
+			}
+		}
+
+		//Each link extends along its own z-axis
+		double length = lengths[j];
+		for (k = 0; k < 3; k++)
+		{
+			double *p = pos[k], *z = col[2][k];
+			for (i = 0; i < n; i++)
+			{
+				p[i] += length * z[i];
+			}
+		}
+
+		if (bounds != NULL)
+		{
+			grow_bounds(bounds + j, pos[0], pos[1], pos[2], n);
+		}
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		positions[3 * i + 0] = (float) pos[0][i];
+		positions[3 * i + 1] = (float) pos[1][i];
+		positions[3 * i + 2] = (float) pos[2][i];
+	}
+}
+
+void robot_fk_evaluate(double *lengths, double **thetas, size_t n, float *positions, robot_bounds_t *bounds)
+{
+	robot_bounds_t ends[ROBOT_JOINTS];
+	size_t j;
+	for (j = 0; j < ROBOT_JOINTS; j++)
+	{
+		empty_bounds(ends + j);
+	}
+
+	size_t first;
+	for (first = 0; first < n; first += ROBOT_FK_BLOCK)
+	{
+		size_t count = n - first < ROBOT_FK_BLOCK ? n - first : ROBOT_FK_BLOCK;
+		double *block[ROBOT_JOINTS];
+		for (j = 0; j < ROBOT_JOINTS; j++)
+		{
+			block[j] = thetas[j] + first;
+		}
+		evaluate_block(lengths, block, count, positions + 3 * first, bounds == NULL ? NULL : ends);
+	}
+
+	if (bounds == NULL || n == 0)
+	{
+		return;
+	}
+
+	//A link's centerline runs from the end of the previous link (or the top of the base) to its own
+	//end, so its bounds are those of both ends
+	double base[3] = { 0.0, 0.0, ROBOT_BASE_HEIGHT };
+	for (j = 0; j < ROBOT_JOINTS; j++)
+	{
+		merge_bounds(bounds + j, ends + j);
+		if (j == 0)
+		{
+			grow_bounds(bounds + j, base + 0, base + 1, base + 2, 1);
+		}
+		else
+		{
+			merge_bounds(bounds + j, ends + j - 1);
+		}
+	}
+}
+
+typedef struct
+{
+	double *lengths;
+	robot_fk_samples_t *samples;
+	size_t first;
+	size_t n;
+	float *positions;
+	robot_bounds_t *bounds;
+	robot_bounds_t link_bounds[ROBOT_JOINTS];
+	uint8_t threaded;
+} fk_task_t;
+
+static void *fk_worker(void *arg)
+{
+	fk_task_t *task = arg;
+
+	double angles[ROBOT_JOINTS][ROBOT_FK_BLOCK];
+	double *thetas[ROBOT_JOINTS];
+	size_t j;
+	for (j = 0; j < ROBOT_JOINTS; j++)
+	{
+		thetas[j] = angles[j];
+	}
+
+	size_t done;
+	for (done = 0; done < task->n; done += ROBOT_FK_BLOCK)
+	{
+		size_t count = task->n - done < ROBOT_FK_BLOCK ? task->n - done : ROBOT_FK_BLOCK;
+		robot_fk_sample_angles(task->samples, task->first + done, count, thetas);
+		robot_fk_evaluate(task->lengths, thetas, count, task->positions + 3 * done, task->bounds);
+	}
+
+	return NULL;
+}
+
+status_t robot_fk_run(double *lengths, robot_fk_samples_t *samples, size_t num_threads, uint8_t with_bounds, FILE *stream)
+{
+	status_t error = SUCCESS;
+
+	size_t total = robot_fk_num_samples(samples);
+	if (num_threads == 0)
+	{
+		num_threads = 1;
+	}
+
+	robot_fk_header_t header = { .version = ROBOT_FK_VERSION, .count = total };
+	memcpy(header.magic, ROBOT_FK_MAGIC, sizeof header.magic);
+	header.flags = with_bounds ? ROBOT_FK_HAS_BOUNDS : 0;
+	if (fwrite(&header, sizeof header, 1, stream) != 1)
+	{
+		error = FILE_WRITE_ERROR;
+		goto exit0;
+	}
+
+	size_t chunk = total < FK_CHUNK ? total : FK_CHUNK;
+	float *positions;
+	INITIALIZE_OR_OUT_OF_MEM(positions, malloc((3 * chunk + 1) * sizeof *positions), error, exit0);
+
+	fk_task_t *tasks;
+	INITIALIZE_OR_OUT_OF_MEM(tasks, calloc(num_threads, sizeof *tasks), error, exit1);
+
+	pthread_t *threads;
+	INITIALIZE_OR_OUT_OF_MEM(threads, malloc(num_threads * sizeof *threads), error, exit2);
+
+	size_t t, j;
+	for (t = 0; t < num_threads; t++)
+	{
+		for (j = 0; j < ROBOT_JOINTS; j++)
+		{
+			empty_bounds(tasks[t].link_bounds + j);
+		}
+	}
+
+	size_t first;
+	for (first = 0; first < total; first += chunk)
+	{
+		size_t n = total - first < chunk ? total - first : chunk;
+		size_t per_thread = (n + num_threads - 1) / num_threads;
+
+		for (t = 0; t < num_threads; t++)
+		{
+			fk_task_t *task = tasks + t;
+			size_t offset = t * per_thread < n ? t * per_thread : n;
+			task->lengths = lengths;
+			task->samples = samples;
+			task->first = first + offset;
+			task->n = n - offset < per_thread ? n - offset : per_thread;
+			task->positions = positions + 3 * offset;
+			task->bounds = with_bounds ? task->link_bounds : NULL;
+
+			//The calling thread takes the first share itself, along with any share for which a thread
+			//could not be started
+			task->threaded = t > 0 && pthread_create(threads + t, NULL, fk_worker, task) == 0;
+		}
+
+		for (t = 0; t < num_threads; t++)
+		{
+			if (!tasks[t].threaded)
+			{
+				fk_worker(tasks + t);
+			}
+		}
+
+		for (t = 0; t < num_threads; t++)
+		{
+			if (tasks[t].threaded)
+			{
+				pthread_join(threads[t], NULL);
+			}
+		}
+
+		if (fwrite(positions, 3 * sizeof *positions, n, stream) != n)
+		{
+			error = FILE_WRITE_ERROR;
+			goto exit3;
+		}
+	}
+
+	if (with_bounds)
+	{
+		robot_bounds_t bounds[ROBOT_JOINTS];
+		for (j = 0; j < ROBOT_JOINTS; j++)
+		{
+			bounds[j] = tasks[0].link_bounds[j];
+			for (t = 1; t < num_threads; t++)
+			{
+				merge_bounds(bounds + j, tasks[t].link_bounds + j);
+			}
+		}
+
+		if (fwrite(bounds, sizeof *bounds, ROBOT_JOINTS, stream) != ROBOT_JOINTS)
+		{
+			error = FILE_WRITE_ERROR;
+			goto exit3;
+		}
+	}
+
+	if (fflush(stream))
+	{
+		error = FILE_WRITE_ERROR;
+	}
+
+exit3:
+	free(threads);
+exit2:
+	free(tasks);
+exit1:
+	free(positions);
+exit0:
+	return error;
+}
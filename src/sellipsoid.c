@@ -1,6 +1,9 @@
 #include <assert.h>
+#include <float.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "sellipsoid.h"
 
@@ -35,6 +38,21 @@
 	#define V_INIT (M_PI / 2)
 #endif
 
+//How many points the inside-outside function is evaluated for at once, in loops the compiler can
+//turn into SIMD instructions
+#define LANES 8
+//Adding and then subtracting this rounds any double of magnitude below 2^51 to an integer
+#define ROUNDER 0x1.8p52
+//The furthest from 0 lane_exp2 takes its power, beyond which results may not be normal numbers
+#define LANE_POWER_LIMIT 1000.0
+//How many points along each piece of a ray are checked for a crossing when the gauge bends both ways
+#define RAY_SAMPLES (2 * LANES)
+//The most pieces the coordinate planes split a ray into
+#define RAY_MAX_PIECES 4
+#define RAY_MAX_STEPS 100
+//Ray searches stop once a step is shorter than this part of the stretch of the ray searched
+#define RAY_TOLERANCE 1e-13
+
 static double c(double w, double m)
 {
 	return sgn(cos(w)) * pow(fabs(cos(w)), m);
@@ -55,15 +73,27 @@ static double inline calc_dv(size_t num_v)
 	return -sgn(V_INIT) * fabs(-V_INIT - V_INIT) / (((double) num_v) - 1.0);
 }
 
+static void evaluate_point(point3d_t *point, double s1, double s2, double A, double B, double C, double u, double v)
+{
+	point->x = A * c(v, s1) * c(u, s2);
+	point->y = B * c(v, s1) * s(u, s2);
+	point->z = C * s(v, s1);
+}
+
+static void evaluate_normal(point3d_t *normal, double s1, double s2, double A, double B, double C, double u, double v)
+{
+	normal->x = (1.0 / A) * c(v, 2 - s1) * c(u, 2 - s2);
+	normal->y = (1.0 / B) * c(v, 2 - s1) * s(u, 2 - s2);
+	normal->z = (1.0 / C) * s(v, 2 - s1);
+}
+
 static status_t add_mesh_point(point3d_vec_t *points, double s1, double s2, double A, double B, double C, double u, double v)
 {
 	status_t error = SUCCESS;
 
 	point3d_t *new_point;
 	POINT_INIT_OR_GOTO(new_point, error, exit0);
-	new_point->x = A * c(v, s1) * c(u, s2);
-	new_point->y = B * c(v, s1) * s(u, s2);
-	new_point->z = C * s(v, s1);
+	evaluate_point(new_point, s1, s2, A, B, C, u, v);
 
 	point3d_vec_push_back(points, new_point);
 
@@ -77,9 +107,7 @@ static status_t add_mesh_normal(point3d_vec_t *normals, double s1, double s2, do
 
 	point3d_t *normal;
 	POINT_INIT_OR_GOTO(normal, error, exit0);
-	normal->x = (1.0 / A) * c(v, 2 - s1) * c(u, 2 - s2);
-	normal->y = (1.0 / B) * c(v, 2 - s1) * s(u, 2 - s2);
-	normal->z = (1.0 / C) * s(v, 2 - s1);
+	evaluate_normal(normal, s1, s2, A, B, C, u, v);
 
 	point3d_vec_push_back(normals, normal);
 
@@ -171,3 +199,775 @@ status_t sellipsoid_calculate_mesh_normals(sellipsoid_t *sellipsoid, mesh_t *mes
 exit0:
 	return error;
 }
+
+static void source_rewind(mesh_source_t *source)
+{
+	source->row = 0;
+	source->param = V_INIT;
+}
+
+static status_t source_next_row(mesh_source_t *source, point3d_t *points, point3d_t *normals)
+{
+	sellipsoid_t *sellipsoid = source->surface;
+	S_EXTRACT(s1);
+	S_EXTRACT(s2);
+	S_EXTRACT(A);
+	S_EXTRACT(B);
+	S_EXTRACT(C);
+	size_t num_u = source->num_u;
+	size_t num_v = source->num_v;
+	size_t row = source->row++;
+
+	//The poles are lone points; v accumulates exactly as in sellipsoid_calculate_mesh_points so the
+	//streamed rows match the materialized mesh bit for bit.
+	if (row == 0 || row == num_v - 1)
+	{
+		double v = row == 0 ? V_INIT : -V_INIT;
+		if (points != NULL)
+		{
+			evaluate_point(points, s1, s2, A, B, C, 0.0, v);
+		}
+		if (normals != NULL)
+		{
+			evaluate_normal(normals, s1, s2, A, B, C, 0.0, v);
+		}
+		return SUCCESS;
+	}
+
+	double v = source->param += calc_dv(num_v);
+	double du = calc_du(num_u);
+	size_t i;
+	double u;
+	for (i = 0, u = 0; i < num_u - 1; i++, u += du)
+	{
+		if (points != NULL)
+		{
+			evaluate_point(points + i, s1, s2, A, B, C, u, v);
+		}
+		if (normals != NULL)
+		{
+			evaluate_normal(normals + i, s1, s2, A, B, C, u, v);
+		}
+	}
+
+	return SUCCESS;
+}
+
+void sellipsoid_source_initialize(mesh_source_t *source, sellipsoid_t *sellipsoid, size_t num_u, size_t num_v, uint8_t has_normals)
+{
+	source->topology = MESH_TOPOLOGY_POLES;
+	source->num_u = num_u;
+	source->num_v = num_v;
+	source->has_normals = has_normals;
+	source->surface = sellipsoid;
+	source->rewind = source_rewind;
+	source->next_row = source_next_row;
+	source_rewind(source);
+}
+
+//The constants of the inside-outside function of a superellipsoid
+typedef struct
+{
+	//the reciprocals of A, B, and C
+	double inverse[3];
+	//the extents of the box around the superellipsoid
+	double extent[3];
+	//2 / s2, 2 / s1, s2 / s1, and s1 / 2
+	double xy_power;
+	double z_power;
+	double ring_power;
+	double gauge_power;
+} implicit_t;
+
+//How the gauge of a superellipsoid bends along a ray, which decides how crossings are found
+typedef enum
+{
+	//s1 and s2 at most 2: convex along the whole ray
+	RAY_BEND_CONVEX,
+	//s1 and s2 at least 2: concave along each piece of the ray within a single octant
+	RAY_BEND_CONCAVE,
+	//either way
+	RAY_BEND_MIXED,
+} ray_bend_t;
+
+static void implicit_initialize(implicit_t *implicit, sellipsoid_t *sellipsoid)
+{
+	S_EXTRACT(s1);
+	S_EXTRACT(s2);
+	S_EXTRACT(A);
+	S_EXTRACT(B);
+	S_EXTRACT(C);
+	implicit->inverse[0] = 1.0 / A;
+	implicit->inverse[1] = 1.0 / B;
+	implicit->inverse[2] = 1.0 / C;
+	implicit->extent[0] = fabs(A);
+	implicit->extent[1] = fabs(B);
+	implicit->extent[2] = fabs(C);
+	implicit->xy_power = 2.0 / s2;
+	implicit->z_power = 2.0 / s1;
+	implicit->ring_power = s2 / s1;
+	implicit->gauge_power = s1 / 2.0;
+}
+
+static inline uint64_t bits_of(double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof bits);
+	return bits;
+}
+
+static inline double double_of(uint64_t bits)
+{
+	double d;
+	memcpy(&d, &bits, sizeof d);
+	return d;
+}
+
+/*
+ * lane_log2 - computes the base 2 logarithm of a number like log2, but only with arithmetic that
+ * SIMD units have, so that loops over it can be vectorized
+ * @param x - the number, positive, finite, and not subnormal
+ * @return - the logarithm, to within a few units in the last place
+ */
+static inline double lane_log2(double x)
+{
+	//Offsetting the bits by those of 1 / sqrt(2) splits x into a power of 2 and a mantissa between
+	//1 / sqrt(2) and sqrt(2), without any comparison. The offset of 2^62 keeps the difference
+	//positive, and the power is read as a number by putting it at the bottom of the mantissa of 2^52
+	uint64_t offset = bits_of(x) - bits_of(M_SQRT1_2) + (1ULL << 62);
+	double exponent = double_of((offset >> 52) | bits_of(0x1p52)) - 0x1p52 - 1024.0;
+	double mantissa = double_of((offset & 0x000fffffffffffffULL) + bits_of(M_SQRT1_2));
+
+	//ln(m) = 2 atanh(s) for s = (m - 1) / (m + 1), here no larger than 0.172, by its series to s^21
+	double s = (mantissa - 1.0) / (mantissa + 1.0);
+	double s_2 = s * s;
+	double series = 1.0 / 21;
+	series = series * s_2 + 1.0 / 19;
+	series = series * s_2 + 1.0 / 17;
+	series = series * s_2 + 1.0 / 15;
+	series = series * s_2 + 1.0 / 13;
+	series = series * s_2 + 1.0 / 11;
+	series = series * s_2 + 1.0 / 9;
+	series = series * s_2 + 1.0 / 7;
+	series = series * s_2 + 1.0 / 5;
+	series = series * s_2 + 1.0 / 3;
+	series = series * s_2 + 1.0;
+	return exponent + 2.0 * s * series * M_LOG2E;
+}
+
+//2 to the power of an integer between -1022 and 1023, given as a double
+static inline double lane_power_of_two(double k)
+{
+	//Rounding puts k at the bottom of the mantissa, from where it is shifted into the exponent
+	return double_of((bits_of(k + ROUNDER) + 1023) << 52);
+}
+
+/*
+ * lane_exp2 - computes 2 to the power of a number like exp2, but only with arithmetic that SIMD
+ * units have, so that loops over it can be vectorized
+ * @param y - the power, between -LANE_POWER_LIMIT and LANE_POWER_LIMIT
+ * @return - 2 to the power of y, to within a few units in the last place
+ */
+static inline double lane_exp2(double y)
+{
+	double k = (y + ROUNDER) - ROUNDER;
+
+	//e^z for z = (y - k) ln(2), here no larger than 0.347 either way, by its Taylor series to z^13, the
+	//coefficients written as reciprocals of the factorials so that they fold into constants
+	double z = (y - k) * M_LN2;
+	double series = 1.0 / 6227020800;
+	series = series * z + 1.0 / 479001600;
+	series = series * z + 1.0 / 39916800;
+	series = series * z + 1.0 / 3628800;
+	series = series * z + 1.0 / 362880;
+	series = series * z + 1.0 / 40320;
+	series = series * z + 1.0 / 5040;
+	series = series * z + 1.0 / 720;
+	series = series * z + 1.0 / 120;
+	series = series * z + 1.0 / 24;
+	series = series * z + 1.0 / 6;
+	series = series * z + 1.0 / 2;
+	series = series * z + 1.0;
+	series = series * z + 1.0;
+
+	//2^k is applied in two halves, so that neither goes past the exponents a double can have
+	double half = (k / 2 + ROUNDER) - ROUNDER;
+	return series * lane_power_of_two(half) * lane_power_of_two(k - half);
+}
+
+/*
+ * lane_pow - raises LANES numbers to the same power, like pow
+ * @param x      - the numbers, none of them negative
+ * @param e      - the power, positive
+ * @param result - out param; each number to the power e
+ */
+static void lane_pow(double *x, double e, double *result)
+{
+	double powers[LANES];
+	size_t k;
+	for (k = 0; k < LANES; k++)
+	{
+		powers[k] = e * lane_log2(x[k]);
+		result[k] = lane_exp2(powers[k]);
+	}
+
+	//0, subnormal numbers, infinity, and results that are not normal numbers, all rare, are
+	//left to pow
+	for (k = 0; k < LANES; k++)
+	{
+		if (!(x[k] >= DBL_MIN && x[k] <= DBL_MAX && fabs(powers[k]) <= LANE_POWER_LIMIT))
+		{
+			result[k] = pow(x[k], e);
+		}
+	}
+}
+
+/*
+ * inside_outside_lanes - evaluates the inside-outside function of a superellipsoid at LANES points
+ * @param implicit - the constants of the function
+ * @param x        - the x coordinates of the points
+ * @param y        - the y coordinates of the points
+ * @param z        - the z coordinates of the points
+ * @param values   - out param; the value at each point
+ */
+static void inside_outside_lanes(implicit_t *implicit, double *x, double *y, double *z, double *values)
+{
+	double inverse_x = implicit->inverse[0], inverse_y = implicit->inverse[1], inverse_z = implicit->inverse[2];
+	double scaled[3][LANES], terms[3][LANES];
+	size_t k;
+	for (k = 0; k < LANES; k++)
+	{
+		scaled[0][k] = fabs(x[k] * inverse_x);
+		scaled[1][k] = fabs(y[k] * inverse_y);
+		scaled[2][k] = fabs(z[k] * inverse_z);
+	}
+
+	lane_pow(scaled[0], implicit->xy_power, terms[0]);
+	lane_pow(scaled[1], implicit->xy_power, terms[1]);
+	lane_pow(scaled[2], implicit->z_power, terms[2]);
+	for (k = 0; k < LANES; k++)
+	{
+		terms[0][k] += terms[1][k];
+	}
+
+	lane_pow(terms[0], implicit->ring_power, terms[1]);
+	for (k = 0; k < LANES; k++)
+	{
+		values[k] = terms[1][k] + terms[2][k];
+	}
+}
+
+//The inside-outside function ((x/A)^(2/s2) + (y/B)^(2/s2))^(s2/s1) + (z/C)^(2/s1) at each point:
+//below 1 inside the superellipsoid, 1 on its surface, and above 1 outside
+void sellipsoid_inside_outside(sellipsoid_t *sellipsoid, point3d_t *points, size_t num_points, double *values)
+{
+	implicit_t implicit;
+	implicit_initialize(&implicit, sellipsoid);
+
+	size_t i, k;
+	for (i = 0; i < num_points; i += LANES)
+	{
+		//The last few points are padded out to a full set with copies of the last one
+		size_t count = num_points - i < LANES ? num_points - i : LANES;
+		double x[LANES], y[LANES], z[LANES], lane_values[LANES];
+		for (k = 0; k < LANES; k++)
+		{
+			point3d_t *point = points + i + (k < count ? k : count - 1);
+			x[k] = point->x;
+			y[k] = point->y;
+			z[k] = point->z;
+		}
+
+		inside_outside_lanes(&implicit, x, y, z, lane_values);
+		memcpy(values + i, lane_values, count * sizeof *values);
+	}
+}
+
+/*
+ * gauge - evaluates the inside-outside function raised to the power s1 / 2, which grows in
+ * proportion to the distance from the centre along any line through it, and so is far better
+ * suited to Newton's method, along with its gradient
+ * @param implicit - the constants of the function
+ * @param point    - the point at which to evaluate it
+ * @param gradient - out param; the gradient there, which faces out of the surface
+ * @return - the value there; 1 on the surface
+ */
+static double gauge(implicit_t *implicit, point3d_t *point, point3d_t *gradient)
+{
+	double x = point->x * implicit->inverse[0];
+	double y = point->y * implicit->inverse[1];
+	double z = point->z * implicit->inverse[2];
+	double x_term = pow(fabs(x), implicit->xy_power);
+	double y_term = pow(fabs(y), implicit->xy_power);
+	double z_term = pow(fabs(z), implicit->z_power);
+	double ring = x_term + y_term;
+	double ring_term = pow(ring, implicit->ring_power);
+	double value = ring_term + z_term;
+	double result = pow(value, implicit->gauge_power);
+
+	//The powers are differentiated through their ratios to their bases, which spares any more pow
+	double outer = value > 0.0 ? result / value : 0.0;
+	double inner = ring > 0.0 ? outer * ring_term / ring : 0.0;
+	gradient->x = (x != 0.0 ? inner * x_term / x : 0.0) * implicit->inverse[0];
+	gradient->y = (y != 0.0 ? inner * y_term / y : 0.0) * implicit->inverse[1];
+	gradient->z = (z != 0.0 ? outer * z_term / z : 0.0) * implicit->inverse[2];
+	return result;
+}
+
+//The gauge less 1 at a distance along a ray, and its rate of change along it
+static double ray_gauge(implicit_t *implicit, sellipsoid_ray_t *ray, double t, double *slope)
+{
+	point3d_t point =
+	{
+		ray->origin.x + t * ray->direction.x,
+		ray->origin.y + t * ray->direction.y,
+		ray->origin.z + t * ray->direction.z,
+	};
+	point3d_t gradient;
+	double value = gauge(implicit, &point, &gradient) - 1.0;
+	*slope = gradient.x * ray->direction.x + gradient.y * ray->direction.y + gradient.z * ray->direction.z;
+	return value;
+}
+
+/*
+ * clip_ray - finds the stretch of a ray inside the box around a superellipsoid, which the surface
+ * cannot be outside of
+ * @param implicit - the constants of the superellipsoid
+ * @param ray      - the ray
+ * @param near     - out param; the start of the stretch
+ * @param far      - out param; the end of the stretch
+ * @return - 1 if any of the ray between t_min and t_max is in the box; 0 otherwise
+ */
+static uint8_t clip_ray(implicit_t *implicit, sellipsoid_ray_t *ray, double *near, double *far)
+{
+	double origin[3] = { ray->origin.x, ray->origin.y, ray->origin.z };
+	double direction[3] = { ray->direction.x, ray->direction.y, ray->direction.z };
+	*near = ray->t_min;
+	*far = ray->t_max;
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		double low = (-implicit->extent[a] - origin[a]) / direction[a];
+		double high = (implicit->extent[a] - origin[a]) / direction[a];
+		if (direction[a] == 0.0)
+		{
+			//Parallel to this pair of faces, the ray is between them everywhere or nowhere
+			low = fabs(origin[a]) <= implicit->extent[a] ? -HUGE_VAL : HUGE_VAL;
+			high = -low;
+		}
+
+		*near = fmax(*near, fmin(low, high));
+		*far = fmin(*far, fmax(low, high));
+	}
+
+	return *near <= *far;
+}
+
+/*
+ * bracketed_newton - finds where the gauge crosses 1 between two distances along a ray, on either
+ * side of which it is on opposite sides of 1, by Newton's method, falling back on bisection whenever
+ * a step would leave the bracket
+ * @param implicit  - the constants of the superellipsoid
+ * @param ray       - the ray
+ * @param low       - the nearer end of the bracket
+ * @param high      - the further end of the bracket
+ * @param low_value - the gauge less 1 at low
+ * @param tolerance - the shortest step worth taking
+ * @return - the distance of the crossing
+ */
+static double bracketed_newton(implicit_t *implicit, sellipsoid_ray_t *ray, double low, double high, double low_value,
+	double tolerance)
+{
+	double t = (low + high) / 2;
+	size_t step;
+	for (step = 0; step < RAY_MAX_STEPS && high - low > tolerance; step++)
+	{
+		double slope;
+		double value = ray_gauge(implicit, ray, t, &slope);
+		if (value == 0.0)
+		{
+			break;
+		}
+		if ((value > 0.0) == (low_value > 0.0))
+		{
+			low = t;
+		}
+		else
+		{
+			high = t;
+		}
+
+		double next = t - value / slope;
+		next = next > low && next < high ? next : (low + high) / 2;
+		double change = fabs(next - t);
+		t = next;
+		if (change <= tolerance)
+		{
+			break;
+		}
+	}
+
+	return t;
+}
+
+/*
+ * split_ray - splits the stretch of a ray in the box where it crosses the coordinate planes, so
+ * that each piece lies within a single octant
+ * @param ray   - the ray
+ * @param near  - the start of the stretch
+ * @param far   - the end of the stretch
+ * @param stops - out param; the ends of the pieces in order, the last of them far
+ * @return - the number of pieces, at most RAY_MAX_PIECES
+ */
+static size_t split_ray(sellipsoid_ray_t *ray, double near, double far, double *stops)
+{
+	double origin[3] = { ray->origin.x, ray->origin.y, ray->origin.z };
+	double direction[3] = { ray->direction.x, ray->direction.y, ray->direction.z };
+	size_t num_stops = 0;
+	size_t a;
+	for (a = 0; a < 3; a++)
+	{
+		//Not a number or infinite when the ray runs parallel to the plane, and so left out
+		double crossing = -origin[a] / direction[a];
+		if (crossing > near && crossing < far)
+		{
+			size_t k;
+			for (k = num_stops++; k > 0 && stops[k - 1] > crossing; k--)
+			{
+				stops[k] = stops[k - 1];
+			}
+			stops[k] = crossing;
+		}
+	}
+
+	stops[num_stops++] = far;
+	return num_stops;
+}
+
+/*
+ * find_peak - looks for a point outside the superellipsoid between two distances along a ray at
+ * which the ray is inside it, where the gauge is concave along the ray and so has a single peak,
+ * by bisecting on the sign of its slope until the peak is found to be outside or, from the
+ * tangents on either side of it, to be inside
+ * @param implicit  - the constants of the superellipsoid
+ * @param ray       - the ray
+ * @param low       - the nearer distance
+ * @param high      - the further distance
+ * @param tolerance - the shortest stretch worth bisecting
+ * @param outside   - out param; the point outside
+ * @return - 1 if a point outside was found; 0 otherwise
+ */
+static uint8_t find_peak(implicit_t *implicit, sellipsoid_ray_t *ray, double low, double high, double tolerance,
+	double *outside)
+{
+	//The slopes at the ends themselves are left out, as they may lie on the coordinate planes,
+	//where the slope can be infinite
+	double low_value = 0.0, high_value = 0.0;
+	double low_slope = HUGE_VAL, high_slope = -HUGE_VAL;
+	size_t step;
+	for (step = 0; step < RAY_MAX_STEPS && high - low > tolerance; step++)
+	{
+		if (isfinite(low_slope) && isfinite(high_slope))
+		{
+			//The tangents on either side bound the gauge from above
+			double meet = (high_value - low_value + low_slope * low - high_slope * high) / (low_slope - high_slope);
+			if (low_value + low_slope * (meet - low) < 0.0)
+			{
+				return 0;
+			}
+		}
+
+		double t = (low + high) / 2;
+		double slope;
+		double value = ray_gauge(implicit, ray, t, &slope);
+		if (value >= 0.0)
+		{
+			*outside = t;
+			return 1;
+		}
+		if (slope > 0.0)
+		{
+			low = t;
+			low_value = value;
+			low_slope = slope;
+		}
+		else
+		{
+			high = t;
+			high_value = value;
+			high_slope = slope;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * find_dip - looks for a point on the other side of the surface between two distances along a
+ * ray, around a dip of the gauge towards 1 seen among sampled points, by bisecting on the sign of
+ * its slope, until the dip is found to cross or looks too shallow to, the gauge being further from
+ * 1 than its slope could cover across what is left of the stretch
+ * @param implicit  - the constants of the superellipsoid
+ * @param ray       - the ray
+ * @param low       - the nearer distance
+ * @param high      - the further distance
+ * @param side      - 1 if the ray is outside the surface on either side of the dip; -1 if inside
+ * @param tolerance - the shortest stretch worth bisecting
+ * @param across    - out param; the point on the other side
+ * @return - 1 if a point on the other side was found; 0 otherwise
+ */
+static uint8_t find_dip(implicit_t *implicit, sellipsoid_ray_t *ray, double low, double high, double side,
+	double tolerance, double *across)
+{
+	size_t step;
+	for (step = 0; step < RAY_MAX_STEPS && high - low > tolerance; step++)
+	{
+		double t = (low + high) / 2;
+		double slope;
+		double value = side * ray_gauge(implicit, ray, t, &slope);
+		slope *= side;
+		if (value <= 0.0)
+		{
+			*across = t;
+			return 1;
+		}
+		if (value > fabs(slope) * (high - low))
+		{
+			return 0;
+		}
+
+		if (slope < 0.0)
+		{
+			low = t;
+		}
+		else
+		{
+			high = t;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * sample_piece - looks for a crossing between two distances along a ray among a row of points in
+ * between, the first of which on the other side of the surface from the nearer distance brackets
+ * it; failing that, each dip towards the surface among the points is searched, so only a ray that
+ * grazes the surface in a dip too narrow and shallow to show among them is missed
+ * @param implicit  - the constants of the superellipsoid
+ * @param ray       - the ray
+ * @param low       - the nearer distance
+ * @param high      - the further distance
+ * @param low_value - the gauge less 1 at low
+ * @param tolerance - the shortest step worth taking
+ * @param t         - out param; the distance of the crossing
+ * @return - 1 if a crossing was found; 0 otherwise
+ */
+static uint8_t sample_piece(implicit_t *implicit, sellipsoid_ray_t *ray, double low, double high, double low_value,
+	double tolerance, double *t)
+{
+	double x[RAY_SAMPLES], y[RAY_SAMPLES], z[RAY_SAMPLES], samples[RAY_SAMPLES];
+	//stops[k + 1] is where sample k is taken, stops[0] being low
+	double stops[RAY_SAMPLES + 1];
+	stops[0] = low;
+	size_t k;
+	for (k = 0; k < RAY_SAMPLES; k++)
+	{
+		stops[k + 1] = low + (high - low) * (k + 1) / RAY_SAMPLES;
+		x[k] = ray->origin.x + stops[k + 1] * ray->direction.x;
+		y[k] = ray->origin.y + stops[k + 1] * ray->direction.y;
+		z[k] = ray->origin.z + stops[k + 1] * ray->direction.z;
+	}
+	for (k = 0; k < RAY_SAMPLES; k += LANES)
+	{
+		inside_outside_lanes(implicit, x + k, y + k, z + k, samples + k);
+	}
+
+	double side = low_value > 0.0 ? 1.0 : -1.0;
+	for (k = 0; k < RAY_SAMPLES; k++)
+	{
+		if (samples[k] == 1.0)
+		{
+			*t = stops[k + 1];
+			return 1;
+		}
+		if ((samples[k] > 1.0) != (side > 0.0))
+		{
+			*t = bracketed_newton(implicit, ray, stops[k], stops[k + 1], low_value, tolerance);
+			return 1;
+		}
+	}
+
+	//The inside-outside function is the gauge raised to a positive power, so it dips where the
+	//gauge does
+	for (k = 0; k < RAY_SAMPLES; k++)
+	{
+		double distance = side * (samples[k] - 1.0);
+		double across;
+		if ((k > 0 && side * (samples[k - 1] - 1.0) < distance) ||
+			(k + 1 < RAY_SAMPLES && side * (samples[k + 1] - 1.0) < distance) ||
+			!find_dip(implicit, ray, stops[k], k + 1 < RAY_SAMPLES ? stops[k + 2] : high, side, tolerance, &across))
+		{
+			continue;
+		}
+
+		*t = bracketed_newton(implicit, ray, stops[k], across, low_value, tolerance);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * intersect_ray - finds where a ray first crosses the surface of a superellipsoid
+ * @param implicit - the constants of the superellipsoid
+ * @param bend     - how the gauge bends along the ray
+ * @param ray      - the ray
+ * @param t        - out param; the distance of the crossing
+ * @return - 1 if the ray crosses the surface; 0 otherwise
+ */
+static uint8_t intersect_ray(implicit_t *implicit, ray_bend_t bend, sellipsoid_ray_t *ray, double *t)
+{
+	double near, far;
+	if (!clip_ray(implicit, ray, &near, &far) || !isfinite(far - near))
+	{
+		return 0;
+	}
+
+	double tolerance = RAY_TOLERANCE * (far - near);
+	double slope;
+	double value = ray_gauge(implicit, ray, near, &slope);
+	//A ray that enters the box from outside is outside the surface until then, so a gauge that
+	//rounds to just below 1 there, where the surface lies within rounding of the box faces, as it
+	//does for small s1 and s2, marks the entry and not a start inside
+	if (value == 0.0 || (value < 0.0 && near > ray->t_min))
+	{
+		*t = near;
+		return 1;
+	}
+
+	if (bend == RAY_BEND_CONVEX && value > 0.0)
+	{
+		//Newton's method from outside never passes the first crossing, and once the gauge stops
+		//falling, it never comes back down to 1
+		*t = near;
+		size_t step;
+		for (step = 0; step < RAY_MAX_STEPS; step++)
+		{
+			if (!(slope < 0.0))
+			{
+				return 0;
+			}
+
+			double change = -value / slope;
+			*t += change;
+			if (*t > far)
+			{
+				return 0;
+			}
+
+			value = ray_gauge(implicit, ray, *t, &slope);
+			if (value <= 0.0 || change <= tolerance)
+			{
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	double stops[RAY_MAX_PIECES];
+	size_t num_stops = bend == RAY_BEND_CONVEX ? 1 : split_ray(ray, near, far, stops);
+	stops[num_stops - 1] = far;
+	double low = near;
+	size_t k;
+	for (k = 0; k < num_stops; low = stops[k++])
+	{
+		double high = stops[k];
+		if (bend == RAY_BEND_MIXED)
+		{
+			if (sample_piece(implicit, ray, low, high, value, tolerance, t))
+			{
+				return 1;
+			}
+			continue;
+		}
+
+		//Whether convex or concave, the gauge crosses 1 at most once between the ends of a piece
+		//that are on opposite sides of the surface, and never between ends outside it; a concave
+		//gauge may still cross twice between ends inside it, around its peak
+		double high_value = ray_gauge(implicit, ray, high, &slope);
+		double outside = high;
+		if ((value > 0.0 && high_value > 0.0) ||
+			(value < 0.0 && high_value < 0.0 && (bend == RAY_BEND_CONVEX ||
+			!find_peak(implicit, ray, low, high, tolerance, &outside))))
+		{
+			continue;
+		}
+
+		*t = outside == high && high_value == 0.0 ? high :
+			bracketed_newton(implicit, ray, low, outside, value, tolerance);
+		return 1;
+	}
+
+	//The surface is nowhere outside the box, so a ray from inside that leaves the box has crossed
+	//it by then, even where it lies so close to the faces of the box that the gauge there rounds to
+	//just below 1, as it does for small s1 and s2
+	if (value < 0.0 && far < ray->t_max)
+	{
+		*t = far;
+		return 1;
+	}
+
+	return 0;
+}
+
+size_t sellipsoid_intersect_rays(sellipsoid_t *sellipsoid, sellipsoid_ray_t *rays, size_t num_rays, sellipsoid_hit_t *hits)
+{
+	implicit_t implicit;
+	implicit_initialize(&implicit, sellipsoid);
+	ray_bend_t bend = RAY_BEND_MIXED;
+	if (sellipsoid->s1 <= 2.0 && sellipsoid->s2 <= 2.0)
+	{
+		bend = RAY_BEND_CONVEX;
+	}
+	else if (sellipsoid->s1 >= 2.0 && sellipsoid->s2 >= 2.0)
+	{
+		bend = RAY_BEND_CONCAVE;
+	}
+
+	size_t num_hits = 0;
+	size_t i;
+	for (i = 0; i < num_rays; i++)
+	{
+		sellipsoid_ray_t *ray = rays + i;
+		sellipsoid_hit_t *hit = hits + i;
+		hit->t = HUGE_VAL;
+		hit->normal.x = hit->normal.y = hit->normal.z = 0.0;
+		double t;
+		if (!intersect_ray(&implicit, bend, ray, &t))
+		{
+			continue;
+		}
+
+		point3d_t point =
+		{
+			ray->origin.x + t * ray->direction.x,
+			ray->origin.y + t * ray->direction.y,
+			ray->origin.z + t * ray->direction.z,
+		};
+		point3d_t gradient;
+		gauge(&implicit, &point, &gradient);
+		double length = sqrt(gradient.x * gradient.x + gradient.y * gradient.y + gradient.z * gradient.z);
+		if (length > 0.0)
+		{
+			hit->normal.x = gradient.x / length;
+			hit->normal.y = gradient.y / length;
+			hit->normal.z = gradient.z / length;
+		}
+		hit->t = t;
+		num_hits++;
+	}
+
+	return num_hits;
+}
@@ -1,8 +1,10 @@
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "transforms.h"
 
+#include "affine.h"
 #include "matrix.h"
 
 #define CHECK_SIZE(array)\
@@ -45,12 +47,30 @@ matrix_t *rotation_matrix(double t, rotatedir_t dir)
 	}
 }
 
+void rotation_matrix_assign(matrix_t *m, double t, rotatedir_t dir)
+{
+	switch (dir)
+	{
+		case ROTATE_X:
+			rotation_matrix_x_assign(m, t);
+			break;
+		case ROTATE_Y:
+			rotation_matrix_y_assign(m, t);
+			break;
+		case ROTATE_Z:
+			rotation_matrix_z_assign(m, t);
+			break;
+	}
+}
+
+//The cosine and sine are each evaluated once, up front, rather than once per use in the array
 #define ROTATE_ARRAY_X(t)\
+	double cos_t = cos(t), sin_t = sin(t);\
 	double array[] =\
 	{\
 		1, 0, 0, 0,\
-		0, cos(t), -sin(t), 0,\
-		0, sin(t), cos(t), 0,\
+		0, cos_t, -sin_t, 0,\
+		0, sin_t, cos_t, 0,\
 		0, 0, 0, 1\
 	};\
 	CHECK_SIZE(array)
@@ -68,11 +88,12 @@ void rotation_matrix_x_assign(matrix_t *m, double t)
 }
 
 #define ROTATE_ARRAY_Y(t)\
+	double cos_t = cos(t), sin_t = sin(t);\
 	double array[] =\
 	{\
-		cos(t), 0, sin(t), 0,\
+		cos_t, 0, sin_t, 0,\
 		0, 1, 0, 0,\
-		-sin(t), 0, cos(t), 0,\
+		-sin_t, 0, cos_t, 0,\
 		0, 0, 0, 1\
 	};\
 	CHECK_SIZE(array)
@@ -90,10 +111,11 @@ void rotation_matrix_y_assign(matrix_t *m, double t)
 }
 
 #define ROTATE_ARRAY_Z(t)\
+	double cos_t = cos(t), sin_t = sin(t);\
 	double array[] =\
 	{\
-		cos(t), -sin(t), 0, 0,\
-		sin(t), cos(t), 0, 0,\
+		cos_t, -sin_t, 0, 0,\
+		sin_t, cos_t, 0, 0,\
 		0, 0, 1, 0,\
 		0, 0, 0, 1\
 	};\
@@ -110,3 +132,195 @@ void rotation_matrix_z_assign(matrix_t *m, double t)
 	ROTATE_ARRAY_Z(t);
 	matrix_assign_from_array(m, array);
 }
+
+//Fills in the upper-left 3x3 block of the 4x4, row-major array with the rotation around the given
+//axis, leaving the rest of the array untouched
+static void rotation_block(double *array, double t, rotatedir_t dir)
+{
+	double cos_t = cos(t), sin_t = sin(t);
+	size_t a, b, axis;
+	switch (dir)
+	{
+		case ROTATE_X:
+			axis = 0, a = 1, b = 2;
+			break;
+		case ROTATE_Y:
+			axis = 1, a = 2, b = 0;
+			break;
+		case ROTATE_Z:
+		default:
+			axis = 2, a = 0, b = 1;
+			break;
+	}
+
+	//Rotating around the axis takes a toward b, i.e., a' = cos(t) a + sin(t) b and
+	//b' = cos(t) b - sin(t) a
+	array[4 * axis + axis] = 1.0;
+	array[4 * axis + a] = array[4 * axis + b] = 0.0;
+	array[4 * a + axis] = array[4 * b + axis] = 0.0;
+	array[4 * a + a] = cos_t;
+	array[4 * a + b] = -sin_t;
+	array[4 * b + a] = sin_t;
+	array[4 * b + b] = cos_t;
+}
+
+//The first three rows of a 4x4, row-major array are exactly the 3x4 affine layout, so the helpers
+//below only fill those in; the matrix versions then add the constant last row with bottom_row
+static void bottom_row(double *array)
+{
+	array[12] = array[13] = array[14] = 0.0;
+	array[15] = 1.0;
+}
+
+static void trs_array(double *array, double x, double y, double z, double t, rotatedir_t dir, double sx, double sy, double sz)
+{
+	rotation_block(array, t, dir);
+
+	size_t row;
+	for (row = 0; row < 3; row++)
+	{
+		array[4 * row + 0] *= sx;
+		array[4 * row + 1] *= sy;
+		array[4 * row + 2] *= sz;
+	}
+
+	array[3] = x;
+	array[7] = y;
+	array[11] = z;
+}
+
+static void rotation_translation_array(double *array, double t, rotatedir_t dir, double x, double y, double z)
+{
+	rotation_block(array, t, dir);
+
+	size_t row;
+	for (row = 0; row < 3; row++)
+	{
+		double *r = array + 4 * row;
+		r[3] = r[0] * x + r[1] * y + r[2] * z;
+	}
+}
+
+matrix_t *translation_rotation_matrix(double x, double y, double z, double t, rotatedir_t dir)
+{
+	double array[16];
+	trs_array(array, x, y, z, t, dir, 1.0, 1.0, 1.0);
+	bottom_row(array);
+	return matrix_initialize_with_array(4, 4, array);
+}
+
+void translation_rotation_matrix_assign(matrix_t *m, double x, double y, double z, double t, rotatedir_t dir)
+{
+	double array[16];
+	trs_array(array, x, y, z, t, dir, 1.0, 1.0, 1.0);
+	bottom_row(array);
+	matrix_assign_from_array(m, array);
+}
+
+matrix_t *rotation_translation_matrix(double t, rotatedir_t dir, double x, double y, double z)
+{
+	double array[16];
+	rotation_translation_array(array, t, dir, x, y, z);
+	bottom_row(array);
+	return matrix_initialize_with_array(4, 4, array);
+}
+
+void rotation_translation_matrix_assign(matrix_t *m, double t, rotatedir_t dir, double x, double y, double z)
+{
+	double array[16];
+	rotation_translation_array(array, t, dir, x, y, z);
+	bottom_row(array);
+	matrix_assign_from_array(m, array);
+}
+
+matrix_t *trs_matrix(double *translate, double t, rotatedir_t dir, double *scale)
+{
+	double array[16];
+	trs_array(array, translate[0], translate[1], translate[2], t, dir, scale[0], scale[1], scale[2]);
+	bottom_row(array);
+	return matrix_initialize_with_array(4, 4, array);
+}
+
+void trs_matrix_assign(matrix_t *m, double *translate, double t, rotatedir_t dir, double *scale)
+{
+	double array[16];
+	trs_array(array, translate[0], translate[1], translate[2], t, dir, scale[0], scale[1], scale[2]);
+	bottom_row(array);
+	matrix_assign_from_array(m, array);
+}
+
+void transform_rotate(matrix_t *m, double t, rotatedir_t dir)
+{
+	double array[16];
+	matrix_copy_to_array(m, array);
+
+	double cos_t = cos(t), sin_t = sin(t);
+	size_t a, b;
+	switch (dir)
+	{
+		case ROTATE_X:
+			a = 1, b = 2;
+			break;
+		case ROTATE_Y:
+			a = 2, b = 0;
+			break;
+		case ROTATE_Z:
+		default:
+			a = 0, b = 1;
+			break;
+	}
+
+	//Post-multiplying by the rotation only mixes the two columns perpendicular to its axis
+	size_t row;
+	for (row = 0; row < 4; row++)
+	{
+		double *r = array + 4 * row;
+		double ra = r[a], rb = r[b];
+		r[a] = cos_t * ra + sin_t * rb;
+		r[b] = cos_t * rb - sin_t * ra;
+	}
+
+	matrix_assign_from_array(m, array);
+}
+
+void transform_translate(matrix_t *m, double x, double y, double z)
+{
+	double array[16];
+	matrix_copy_to_array(m, array);
+
+	//Post-multiplying by the translation only changes the last column
+	size_t row;
+	for (row = 0; row < 4; row++)
+	{
+		double *r = array + 4 * row;
+		r[3] += r[0] * x + r[1] * y + r[2] * z;
+	}
+
+	matrix_assign_from_array(m, array);
+}
+
+void translation_affine(affine_t *a, double x, double y, double z)
+{
+	TRANS_ARRAY(x, y, z);
+	memcpy(a->m, array, sizeof a->m);
+}
+
+void rotation_affine(affine_t *a, double t, rotatedir_t dir)
+{
+	trs_array(a->m, 0.0, 0.0, 0.0, t, dir, 1.0, 1.0, 1.0);
+}
+
+void translation_rotation_affine(affine_t *a, double x, double y, double z, double t, rotatedir_t dir)
+{
+	trs_array(a->m, x, y, z, t, dir, 1.0, 1.0, 1.0);
+}
+
+void rotation_translation_affine(affine_t *a, double t, rotatedir_t dir, double x, double y, double z)
+{
+	rotation_translation_array(a->m, t, dir, x, y, z);
+}
+
+void trs_affine(affine_t *a, double *translate, double t, rotatedir_t dir, double *scale)
+{
+	trs_array(a->m, translate[0], translate[1], translate[2], t, dir, scale[0], scale[1], scale[2]);
+}
@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "writer.h"
+
+#include "status.h"
+
+//Enough room for any double that takes the fast path, i.e., with an integer part below 2^64
+#define FAST_DOUBLE_LENGTH (1 + 20 + 1 + WRITER_MAX_PRECISION)
+//Enough room for printf's output for any double, whose integer part has at most 309 digits
+#define SLOW_DOUBLE_LENGTH 512
+
+static const uint64_t powers_of_ten[WRITER_MAX_PRECISION + 1] =
+{
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+	1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+	100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+};
+
+writer_t *writer_initialize(int fd, int precision)
+{
+	writer_t *writer;
+	if ((writer = malloc(sizeof *writer)) == NULL)
+	{
+		goto error0;
+	}
+
+	if ((writer->buffer = malloc(WRITER_BUFFER_SIZE)) == NULL)
+	{
+		goto error1;
+	}
+
+	writer->fd = fd;
+	writer->size = 0;
+	writer->capacity = WRITER_BUFFER_SIZE;
+	writer->precision = precision < 0 ? 0 :
+		precision > WRITER_MAX_PRECISION ? WRITER_MAX_PRECISION : precision;
+	writer->error = SUCCESS;
+
+	goto success;
+
+error1:
+	free(writer);
+	writer = NULL;
+error0:
+
+success:
+	return writer;
+}
+
+void writer_uninitialize(writer_t *writer)
+{
+	free(writer->buffer);
+	free(writer);
+}
+
+static void write_all(writer_t *writer, const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(writer->fd, data, length);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			writer->error = FILE_WRITE_ERROR;
+			return;
+		}
+
+		data += written;
+		length -= written;
+	}
+}
+
+status_t writer_flush(writer_t *writer)
+{
+	if (writer->fd != WRITER_NO_FD && !writer->error)
+	{
+		write_all(writer, writer->buffer, writer->size);
+		writer->size = 0;
+	}
+
+	return writer->error;
+}
+
+void writer_clear(writer_t *writer)
+{
+	writer->size = 0;
+}
+
+status_t writer_error(writer_t *writer)
+{
+	return writer->error;
+}
+
+//Makes room for at least length more bytes, returning 0 if that is not possible
+static int reserve(writer_t *writer, size_t length)
+{
+	if (writer->error)
+	{
+		return 0;
+	}
+
+	if (writer->capacity - writer->size >= length)
+	{
+		return 1;
+	}
+
+	if (writer->fd != WRITER_NO_FD)
+	{
+		writer_flush(writer);
+		return !writer->error && writer->capacity >= length;
+	}
+
+	size_t capacity = writer->capacity;
+	while (capacity - writer->size < length)
+	{
+		capacity *= 2;
+	}
+
+	char *buffer;
+	if ((buffer = realloc(writer->buffer, capacity)) == NULL)
+	{
+		writer->error = OUT_OF_MEM;
+		return 0;
+	}
+
+	writer->buffer = buffer;
+	writer->capacity = capacity;
+	return 1;
+}
+
+void writer_bytes(writer_t *writer, const char *data, size_t length)
+{
+	if (reserve(writer, length))
+	{
+		memcpy(writer->buffer + writer->size, data, length);
+		writer->size += length;
+	}
+	else if (!writer->error)
+	{
+		//Only reachable when the data is larger than the whole buffer, which was just flushed
+		write_all(writer, data, length);
+	}
+}
+
+void writer_string(writer_t *writer, const char *string)
+{
+	writer_bytes(writer, string, strlen(string));
+}
+
+//Writes the digits of value right-aligned to end, padded with zeros to at least width digits, and
+//returns a pointer to the first digit
+static char *format_digits(char *end, uint64_t value, int width)
+{
+	char *p = end;
+	while (value > 0 || width > 0)
+	{
+		*--p = '0' + value % 10;
+		value /= 10;
+		width--;
+	}
+
+	return p;
+}
+
+//Formats |value| < 2^64 exactly, returning the length, or 0 if the value is out of range. The
+//fractional part is f = m * 2^-s with m < 2^53, so f * 10^p = m * 10^p / 2^s is computed exactly in
+//128 bits and rounded half to even, just as glibc rounds the exact binary value.
+static size_t format_fixed(char *out, double value, int precision)
+{
+	if (!(fabs(value) < 18446744073709551616.0))
+	{
+		return 0;
+	}
+
+	double magnitude = fabs(value);
+	double whole = floor(magnitude);
+	uint64_t integer = (uint64_t) whole;
+	double fraction = magnitude - whole;
+	uint64_t scale = powers_of_ten[precision];
+	int carry = 0;
+
+	uint64_t digits = 0;
+	if (precision == 0)
+	{
+		//With no digits after the point, the integer part itself is rounded half to even
+		carry = fraction > 0.5 || (fraction == 0.5 && (integer & 1));
+	}
+	else if (fraction > 0.0)
+	{
+		int exponent;
+		double mantissa = frexp(fraction, &exponent);
+		uint64_t m = (uint64_t) ldexp(mantissa, 53);
+		int shift = 53 - exponent;
+
+		//Beyond this shift, the product is below half of one unit and rounds to zero
+		if (shift < 127)
+		{
+			unsigned __int128 product = (unsigned __int128) m * scale;
+			unsigned __int128 one = (unsigned __int128) 1 << shift;
+			unsigned __int128 remainder = product & (one - 1);
+			unsigned __int128 half = one >> 1;
+			digits = (uint64_t) (product >> shift);
+			if (remainder > half || (remainder == half && (digits & 1)))
+			{
+				digits++;
+			}
+		}
+
+		if (digits == scale)
+		{
+			carry = 1;
+			digits = 0;
+		}
+	}
+
+	if (carry)
+	{
+		if (integer == UINT64_MAX)
+		{
+			return 0;
+		}
+		integer++;
+	}
+
+	char scratch[FAST_DOUBLE_LENGTH];
+	char *end = scratch + sizeof scratch;
+	char *p = end;
+	if (precision > 0)
+	{
+		p = format_digits(p, digits, precision);
+		*--p = '.';
+	}
+	p = format_digits(p, integer, 1);
+	if (signbit(value))
+	{
+		*--p = '-';
+	}
+
+	size_t length = end - p;
+	memcpy(out, p, length);
+	return length;
+}
+
+void writer_double(writer_t *writer, double value)
+{
+	if (!reserve(writer, FAST_DOUBLE_LENGTH))
+	{
+		return;
+	}
+
+	size_t length = format_fixed(writer->buffer + writer->size, value, writer->precision);
+	if (length > 0)
+	{
+		writer->size += length;
+		return;
+	}
+
+	//Huge values, infinities, and NaNs are rare enough to leave to printf
+	char scratch[SLOW_DOUBLE_LENGTH];
+	int printed = snprintf(scratch, sizeof scratch, "%.*f", writer->precision, value);
+	writer_bytes(writer, scratch, printed < (int) sizeof scratch ? (size_t) printed : sizeof scratch - 1);
+}
+
+//Formats the value as writer_double would into scratch, which must hold SLOW_DOUBLE_LENGTH
+//characters, returning the length
+static size_t format_double(char *scratch, double value, int precision)
+{
+	size_t length = format_fixed(scratch, value, precision);
+	if (length > 0)
+	{
+		return length;
+	}
+
+	int printed = snprintf(scratch, SLOW_DOUBLE_LENGTH, "%.*f", precision, value);
+	return printed < SLOW_DOUBLE_LENGTH ? (size_t) printed : SLOW_DOUBLE_LENGTH - 1;
+}
+
+size_t writer_double_length(double value, int precision)
+{
+	char scratch[SLOW_DOUBLE_LENGTH];
+	return format_double(scratch, value, precision);
+}
+
+void writer_format_double(char *out, double value, int precision, size_t width)
+{
+	char scratch[SLOW_DOUBLE_LENGTH];
+	size_t length = format_double(scratch, value, precision);
+	memset(out, ' ', width - length);
+	memcpy(out + width - length, scratch, length);
+}
+
+void writer_format_size(char *out, size_t value, size_t width)
+{
+	char *p = format_digits(out + width, value, 1);
+	memset(out, ' ', p - out);
+}
+
+size_t writer_size_length(size_t value)
+{
+	size_t length = 1;
+	while (value >= 10)
+	{
+		value /= 10;
+		length++;
+	}
+
+	return length;
+}
+
+void writer_point(writer_t *writer, double x, double y, double z)
+{
+	writer_double(writer, x);
+	writer_bytes(writer, " ", 1);
+	writer_double(writer, y);
+	writer_bytes(writer, " ", 1);
+	writer_double(writer, z);
+}
+
+void writer_size(writer_t *writer, size_t value)
+{
+	char scratch[24];
+	char *end = scratch + sizeof scratch;
+	char *p = format_digits(end, value, 1);
+	writer_bytes(writer, p, end - p);
+}
+
+status_t writer_parse_precision(char *string, int *precision)
+{
+	char *end;
+	long value = strtol(string, &end, 10);
+	if (*string == '\0' || *end != '\0' || value < 0 || value > WRITER_MAX_PRECISION)
+	{
+		return ARGS_ERROR;
+	}
+
+	*precision = value;
+	return SUCCESS;
+}